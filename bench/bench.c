@@ -0,0 +1,633 @@
+/*
+MIT License
+Copyright (c) 2025 András Broskó
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+/**
+ * \file bench/bench.c
+ * \brief Benchmarks of the hot paths of the result library.
+ * \details Every case is run in batches of BENCH_BATCH operations on 1 to
+ * the given number of threads. The time and the cycles of each batch are
+ * sampled, and ns/op percentiles, cycles/op and the throughput of all threads
+ * together are reported as CSV or JSON. Where the kernel allows it, the
+ * cache misses of each thread are counted as well, which shows the
+ * coherence traffic between the threads.
+ * */
+
+#include "result_utils.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+/** Number of operations timed together. */
+#define BENCH_BATCH 64
+
+/** Stores a typed handle into an array element through its words, which
+ * unlike the id are not const.
+ * \param dst The handle to write.
+ * \param src The handle to copy. */
+#define BENCH_STORE(dst, src)\
+	memcpy((dst).res_words, (src).res_words, sizeof((src).res_words))
+/** Default number of batches per case and thread. */
+#define BENCH_SAMPLES 2000
+/** Number of batches run before sampling. */
+#define BENCH_WARMUP 100
+/** Number of threads the region cases can run on, each holding a region
+ * slot. Slot 0 stands for no region. */
+#ifdef RES_THREAD_LOCAL
+#define BENCH_REGION_THREADS 0
+#else
+#define BENCH_REGION_THREADS (RES_REGION_COUNT - 1)
+#endif
+
+/** Time and cycles of a batch. */
+typedef struct bench_sample {
+	uint64_t ns;
+	uint64_t cycles;
+} bench_sample_t;
+
+/** A benchmark case. run() performs BENCH_BATCH operations and times them
+ * between BENCH_BEGIN and BENCH_END. */
+typedef struct bench_case {
+	const char *name;
+	size_t payload;
+	void (*run)(bench_sample_t *sample);
+	/** The most threads the case can run on, 0 if unlimited. */
+	size_t max_threads;
+} bench_case_t;
+
+/** Arguments and samples of a thread. */
+typedef struct bench_thread {
+	pthread_t thread;
+	const bench_case_t *bench_case;
+	size_t samples;
+	bench_sample_t *sample;
+	uint64_t start;
+	uint64_t end;
+	/** The cache misses of the sampled batches, including their untimed setup. */
+	uint64_t misses;
+	/** Whether the cache misses could be counted. */
+	int has_misses;
+} bench_thread_t;
+
+/** Output formats. */
+typedef enum bench_format {
+	BENCH_CSV,
+	BENCH_JSON
+} bench_format_t;
+
+/** Starts the threads of a run together. */
+static pthread_barrier_t g_barrier;
+/** Sink the benchmarks write to so the compiler can't drop the work. */
+static volatile size_t g_sink;
+
+/** Returns the monotonic time in nanoseconds. */
+static inline uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000LU + (uint64_t)ts.tv_nsec;
+}
+
+/** Returns the time stamp counter or 0 where there is none. */
+static inline uint64_t now_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/** Opens a counter of the cache misses of the calling thread in user space.
+ * \return The file descriptor of the disabled counter or -1 where there is none. */
+static int open_misses() {
+#ifdef __linux__
+	struct perf_event_attr attr = {
+		.type = PERF_TYPE_HARDWARE,
+		.size = sizeof(attr),
+		.config = PERF_COUNT_HW_CACHE_MISSES,
+		.disabled = 1,
+		.exclude_kernel = 1,
+		.exclude_hv = 1,
+	};
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+	return -1;
+#endif
+}
+
+/** Starts timing a batch.
+ * \param sample The sample of the batch. */
+#define BENCH_BEGIN(sample)\
+	do {\
+		(sample)->cycles = now_cycles();\
+		(sample)->ns = now_ns();\
+	} while(0)
+
+/** Stops timing a batch.
+ * \param sample The sample of the batch. */
+#define BENCH_END(sample)\
+	do {\
+		(sample)->ns = now_ns() - (sample)->ns;\
+		(sample)->cycles = now_cycles() - (sample)->cycles;\
+	} while(0)
+
+/** Generates the cases of a payload size: OK, emplace, TRY, UNW and take on an OK
+ * result of N bytes, deleting it, releasing a region of them and creating
+ * and deleting them in batches.
+ * \param N The size of the payload. */
+#define BENCH_PAYLOAD(N)\
+	typedef struct payload_##N { unsigned char bytes[N]; } payload_##N;\
+	TYPEDEF_RES(payload_##N);\
+	static void bench_ok_##N(bench_sample_t *sample) {\
+		payload_##N value = {{1}};\
+		RES(payload_##N) res[BENCH_BATCH];\
+		BENCH_BEGIN(sample);\
+		for (size_t i = 0; i < BENCH_BATCH; i++) {\
+			RES(payload_##N) created = OK(payload_##N, value);\
+			BENCH_STORE(res[i], created);\
+		}\
+		BENCH_END(sample);\
+		for (size_t i = 0; i < BENCH_BATCH; i++) res_payload_##N##_del(res[i], ERRINFO);\
+	}\
+	static void bench_emplace_##N(bench_sample_t *sample) {\
+		RES(payload_##N) res[BENCH_BATCH];\
+		BENCH_BEGIN(sample);\
+		for (size_t i = 0; i < BENCH_BATCH; i++) {\
+			size_t id;\
+			payload_##N *value = res_payload_##N##_reserve(&id, ERRINFO);\
+			if (value) value->bytes[0] = 1;\
+			RES(payload_##N) created = res_payload_##N##_commit(id, ERRINFO);\
+			BENCH_STORE(res[i], created);\
+		}\
+		BENCH_END(sample);\
+		for (size_t i = 0; i < BENCH_BATCH; i++) res_payload_##N##_del(res[i], ERRINFO);\
+	}\
+	static void bench_region_##N(bench_sample_t *sample) {\
+		payload_##N value = {{1}};\
+		res_region_t region;\
+		BENCH_BEGIN(sample);\
+		if (res_region_begin(&region)) abort();\
+		for (size_t i = 0; i < BENCH_BATCH; i++) {\
+			RES(payload_##N) created = OK(payload_##N, value);\
+			g_sink += created.id;\
+		}\
+		if (res_region_end(region)) abort();\
+		BENCH_END(sample);\
+	}\
+	static void bench_batch_##N(bench_sample_t *sample) {\
+		payload_##N values[BENCH_BATCH] = {{{1}}};\
+		size_t ids[BENCH_BATCH];\
+		BENCH_BEGIN(sample);\
+		res_payload_##N##_ok_n(values, BENCH_BATCH, ids, ERRINFO);\
+		res_payload_##N##_del_n(ids, BENCH_BATCH, ERRINFO);\
+		BENCH_END(sample);\
+	}\
+	static void bench_del_##N(bench_sample_t *sample) {\
+		payload_##N value = {{1}};\
+		RES(payload_##N) res[BENCH_BATCH];\
+		for (size_t i = 0; i < BENCH_BATCH; i++) {\
+			RES(payload_##N) created = OK(payload_##N, value);\
+			BENCH_STORE(res[i], created);\
+		}\
+		BENCH_BEGIN(sample);\
+		for (size_t i = 0; i < BENCH_BATCH; i++) res_payload_##N##_del(res[i], ERRINFO);\
+		BENCH_END(sample);\
+	}\
+	__attribute__((noinline))\
+	static RES(void) try_##N(RES(payload_##N) res, payload_##N *value) {\
+		TRY(payload_##N, res, value, void);\
+		return OK_VOID();\
+	}\
+	static void bench_try_##N(bench_sample_t *sample) {\
+		payload_##N value = {{1}};\
+		RES(payload_##N) res[BENCH_BATCH];\
+		for (size_t i = 0; i < BENCH_BATCH; i++) {\
+			RES(payload_##N) created = OK(payload_##N, value);\
+			BENCH_STORE(res[i], created);\
+		}\
+		BENCH_BEGIN(sample);\
+		for (size_t i = 0; i < BENCH_BATCH; i++) {\
+			RES(void) ret = try_##N(res[i], &value);\
+			g_sink += ret.id;\
+		}\
+		BENCH_END(sample);\
+	}\
+	static void bench_take_##N(bench_sample_t *sample) {\
+		payload_##N value = {{1}};\
+		RES(payload_##N) res[BENCH_BATCH];\
+		for (size_t i = 0; i < BENCH_BATCH; i++) {\
+			RES(payload_##N) created = OK(payload_##N, value);\
+			BENCH_STORE(res[i], created);\
+		}\
+		BENCH_BEGIN(sample);\
+		for (size_t i = 0; i < BENCH_BATCH; i++) {\
+			g_sink += res_payload_##N##_take(&res[i], ERRINFO)->bytes[0];\
+		}\
+		BENCH_END(sample);\
+	}\
+	static void bench_unw_##N(bench_sample_t *sample) {\
+		payload_##N value = {{1}};\
+		RES(payload_##N) res[BENCH_BATCH];\
+		for (size_t i = 0; i < BENCH_BATCH; i++) {\
+			RES(payload_##N) created = OK(payload_##N, value);\
+			BENCH_STORE(res[i], created);\
+		}\
+		BENCH_BEGIN(sample);\
+		for (size_t i = 0; i < BENCH_BATCH; i++) {\
+			UNW(payload_##N, res[i], &value);\
+			g_sink += value.bytes[0];\
+		}\
+		BENCH_END(sample);\
+	}
+
+BENCH_PAYLOAD(1)
+BENCH_PAYLOAD(16)
+BENCH_PAYLOAD(64)
+BENCH_PAYLOAD(256)
+BENCH_PAYLOAD(1024)
+
+_Static_assert(OK_BUFF_SIZE == 1024, "The biggest payload must be OK_BUFF_SIZE");
+
+/** Creates error results and deletes them untimed. */
+static void bench_err(bench_sample_t *sample) {
+	size_t ids[BENCH_BATCH];
+	BENCH_BEGIN(sample);
+	for (size_t i = 0; i < BENCH_BATCH; i++) ids[i] = ERR(void, "bench").id;
+	BENCH_END(sample);
+	for (size_t i = 0; i < BENCH_BATCH; i++) res_void_del((RES(void)){.id = ids[i]}, ERRINFO);
+}
+
+/** Deletes error results. */
+static void bench_err_del(bench_sample_t *sample) {
+	size_t ids[BENCH_BATCH];
+	for (size_t i = 0; i < BENCH_BATCH; i++) ids[i] = ERR(void, "bench").id;
+	BENCH_BEGIN(sample);
+	for (size_t i = 0; i < BENCH_BATCH; i++) res_void_del((RES(void)){.id = ids[i]}, ERRINFO);
+	BENCH_END(sample);
+}
+
+/** Propagates the result with TRY_VOID.
+ * \param res The result. */
+__attribute__((noinline))
+static RES(void) try_void(RES(void) res) {
+	TRY_VOID(res, void);
+	return OK_VOID();
+}
+
+/** TRY_VOID on OK results. */
+static void bench_try_void_ok(bench_sample_t *sample) {
+	BENCH_BEGIN(sample);
+	for (size_t i = 0; i < BENCH_BATCH; i++) {
+		RES(void) ret = try_void(OK_VOID());
+		g_sink += ret.id;
+	}
+	BENCH_END(sample);
+}
+
+/** TRY_VOID on error results, including creating and deleting the errors. */
+static void bench_try_void_err(bench_sample_t *sample) {
+	BENCH_BEGIN(sample);
+	for (size_t i = 0; i < BENCH_BATCH; i++) {
+		RES(void) ret = try_void(ERR(void, "bench"));
+		res_void_del(ret, ERRINFO);
+	}
+	BENCH_END(sample);
+}
+
+TYPEDEF_RES(int);
+
+/** Leaf of the call chain of the mixes.
+ * \param i The number of the call.
+ * \param errors The number of failing calls out of ten. */
+__attribute__((noinline))
+static RES(int) leaf(size_t i, size_t errors) {
+	if (i % 10 < errors) return ERR(int, "bench");
+	return OK(int, (int)i);
+}
+
+/** Middle of the call chain of the mixes.
+ * \param i The number of the call.
+ * \param errors The number of failing calls out of ten. */
+__attribute__((noinline))
+static RES(void) middle(size_t i, size_t errors) {
+	int value = 0;
+	RES(int) res = leaf(i, errors);
+	TRY(int, res, &value, void);
+	g_sink += (size_t)value;
+	return OK_VOID();
+}
+
+/** Runs the call chain with the error ratio.
+ * \param sample The sample of the batch.
+ * \param errors The number of failing calls out of ten. */
+static inline void bench_mix(bench_sample_t *sample, size_t errors) {
+	BENCH_BEGIN(sample);
+	for (size_t i = 0; i < BENCH_BATCH; i++) {
+		RES(void) res = middle(i, errors);
+		if (res_void_get_ok(res, ERRINFO)) res_void_del(res, ERRINFO);
+	}
+	BENCH_END(sample);
+}
+
+/** One call in ten fails. */
+static void bench_mix_ok_heavy(bench_sample_t *sample) {
+	bench_mix(sample, 1);
+}
+
+/** Nine calls in ten fail. */
+static void bench_mix_err_heavy(bench_sample_t *sample) {
+	bench_mix(sample, 9);
+}
+
+/** Hands out the size classes of bench_spread to the threads. */
+static _Atomic size_t g_next_class;
+/** The size class of the calling thread in bench_spread. */
+static _Thread_local size_t g_class = SIZE_MAX;
+
+/** Creates and deletes an OK result of a different size class on each
+ * thread, so the threads share no pool, only what lies between the pools. */
+static void bench_spread(bench_sample_t *sample) {
+	if (g_class == SIZE_MAX) g_class = g_next_class++ % RES_CLASS_COUNT;
+	size_t size = RES_CLASS_SIZE(g_class);
+	BENCH_BEGIN(sample);
+	for (size_t i = 0; i < BENCH_BATCH; i++)
+		res_generic_del(res_generic_ok(NULL, 1, size, ERRINFO), ERRINFO);
+	BENCH_END(sample);
+}
+
+/** All benchmark cases. */
+static const bench_case_t g_cases[] = {
+	{"ok", 1, bench_ok_1, 0},
+	{"ok", 16, bench_ok_16, 0},
+	{"ok", 64, bench_ok_64, 0},
+	{"ok", 256, bench_ok_256, 0},
+	{"ok", 1024, bench_ok_1024, 0},
+	{"emplace", 1, bench_emplace_1, 0},
+	{"emplace", 16, bench_emplace_16, 0},
+	{"emplace", 64, bench_emplace_64, 0},
+	{"emplace", 256, bench_emplace_256, 0},
+	{"emplace", 1024, bench_emplace_1024, 0},
+	{"region", 1, bench_region_1, BENCH_REGION_THREADS},
+	{"region", 16, bench_region_16, BENCH_REGION_THREADS},
+	{"region", 64, bench_region_64, BENCH_REGION_THREADS},
+	{"region", 256, bench_region_256, BENCH_REGION_THREADS},
+	{"region", 1024, bench_region_1024, BENCH_REGION_THREADS},
+	{"batch", 1, bench_batch_1, 0},
+	{"batch", 16, bench_batch_16, 0},
+	{"batch", 64, bench_batch_64, 0},
+	{"batch", 256, bench_batch_256, 0},
+	{"batch", 1024, bench_batch_1024, 0},
+	{"del", 1, bench_del_1, 0},
+	{"del", 16, bench_del_16, 0},
+	{"del", 64, bench_del_64, 0},
+	{"del", 256, bench_del_256, 0},
+	{"del", 1024, bench_del_1024, 0},
+	{"try", 1, bench_try_1, 0},
+	{"try", 16, bench_try_16, 0},
+	{"try", 64, bench_try_64, 0},
+	{"try", 256, bench_try_256, 0},
+	{"try", 1024, bench_try_1024, 0},
+	{"take", 1, bench_take_1, 0},
+	{"take", 16, bench_take_16, 0},
+	{"take", 64, bench_take_64, 0},
+	{"take", 256, bench_take_256, 0},
+	{"take", 1024, bench_take_1024, 0},
+	{"unw", 1, bench_unw_1, 0},
+	{"unw", 16, bench_unw_16, 0},
+	{"unw", 64, bench_unw_64, 0},
+	{"unw", 256, bench_unw_256, 0},
+	{"unw", 1024, bench_unw_1024, 0},
+	{"err", 0, bench_err, 0},
+	{"err_del", 0, bench_err_del, 0},
+	{"try_void_ok", 0, bench_try_void_ok, 0},
+	{"try_void_err", 0, bench_try_void_err, 0},
+	{"mix_ok_heavy", 0, bench_mix_ok_heavy, 0},
+	{"mix_err_heavy", 0, bench_mix_err_heavy, 0},
+	{"spread", 0, bench_spread, 0},
+};
+
+/** Runs the case on a thread.
+ * \param arg The bench_thread_t of the thread. */
+static void *bench_thread(void *arg) {
+	bench_thread_t *self = arg;
+	bench_sample_t warmup;
+	for (size_t i = 0; i < BENCH_WARMUP; i++) self->bench_case->run(&warmup);
+	int misses = open_misses();
+	pthread_barrier_wait(&g_barrier);
+	self->start = now_ns();
+#ifdef __linux__
+	if (misses >= 0) ioctl(misses, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+	for (size_t i = 0; i < self->samples; i++) self->bench_case->run(&self->sample[i]);
+#ifdef __linux__
+	if (misses >= 0) ioctl(misses, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+	self->end = now_ns();
+	if (misses >= 0) {
+		self->has_misses = read(misses, &self->misses, sizeof(self->misses)) ==
+			sizeof(self->misses);
+		close(misses);
+	}
+	return NULL;
+}
+
+/** Compares samples by time for qsort. */
+static int compare_samples(const void *a, const void *b) {
+	uint64_t x = ((const bench_sample_t *)a)->ns;
+	uint64_t y = ((const bench_sample_t *)b)->ns;
+	return (x > y) - (x < y);
+}
+
+/** Returns the ns/op at the percentile of the sorted samples.
+ * \param sample The sorted samples.
+ * \param count The number of samples.
+ * \param p The percentile. */
+static double percentile(const bench_sample_t *sample, size_t count, double p) {
+	size_t i = (size_t)(p / 100.0 * (double)(count - 1));
+	return (double)sample[i].ns / BENCH_BATCH;
+}
+
+/** Runs the case on the threads and prints the results.
+ * \param bench_case The case.
+ * \param threads The number of threads.
+ * \param samples The number of batches per thread.
+ * \param format The output format.
+ * \param first Whether this is the first result printed. */
+static void bench_run(
+	const bench_case_t *bench_case, size_t threads, size_t samples,
+	bench_format_t format, int first
+) {
+	bench_thread_t *thread = calloc(threads, sizeof(bench_thread_t));
+	bench_sample_t *sample = calloc(threads * samples, sizeof(bench_sample_t));
+	if (!thread || !sample) {
+		fprintf(stderr, "Not enough memory\n");
+		exit(1);
+	}
+	pthread_barrier_init(&g_barrier, NULL, (unsigned)threads + 1);
+	for (size_t i = 0; i < threads; i++) {
+		thread[i] = (bench_thread_t){
+			.bench_case = bench_case,
+			.samples = samples,
+			.sample = sample + i * samples
+		};
+		pthread_create(&thread[i].thread, NULL, bench_thread, &thread[i]);
+	}
+	pthread_barrier_wait(&g_barrier);
+	uint64_t start = UINT64_MAX;
+	uint64_t end = 0;
+	uint64_t misses = 0;
+	int has_misses = 1;
+	for (size_t i = 0; i < threads; i++) {
+		pthread_join(thread[i].thread, NULL);
+		if (thread[i].start < start) start = thread[i].start;
+		if (thread[i].end > end) end = thread[i].end;
+		misses += thread[i].misses;
+		has_misses &= thread[i].has_misses;
+	}
+	pthread_barrier_destroy(&g_barrier);
+
+	size_t count = threads * samples;
+	uint64_t cycles = 0;
+	uint64_t ns = 0;
+	for (size_t i = 0; i < count; i++) {
+		cycles += sample[i].cycles;
+		ns += sample[i].ns;
+	}
+	qsort(sample, count, sizeof(bench_sample_t), compare_samples);
+	double ops = (double)(count * BENCH_BATCH);
+	double mean = (double)ns / ops;
+	double p50 = percentile(sample, count, 50);
+	double p90 = percentile(sample, count, 90);
+	double p99 = percentile(sample, count, 99);
+	double max = percentile(sample, count, 100);
+	double cycles_op = (double)cycles / ops;
+	// The wall time includes the untimed setup of the batches
+	double mops = ops / (double)(end - start) * 1000.0;
+	// Empty in CSV and null in JSON where the misses couldn't be counted
+	char misses_op[32] = "";
+	if (has_misses) snprintf(misses_op, sizeof(misses_op), "%.3f", (double)misses / ops);
+
+	if (format == BENCH_CSV) {
+		printf(
+			"%s,%zu,%zu,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.3f,%s\n",
+			bench_case->name, bench_case->payload, threads,
+			mean, p50, p90, p99, max, cycles_op, mops, misses_op);
+	} else {
+		printf(
+			"%s\n\t{\"case\": \"%s\", \"payload\": %zu, \"threads\": %zu, "
+			"\"ns_op_mean\": %.2f, \"ns_op_p50\": %.2f, \"ns_op_p90\": %.2f, "
+			"\"ns_op_p99\": %.2f, \"ns_op_max\": %.2f, \"cycles_op\": %.2f, "
+			"\"mops\": %.3f, \"misses_op\": %s}",
+			first ? "" : ",", bench_case->name, bench_case->payload, threads,
+			mean, p50, p90, p99, max, cycles_op, mops, has_misses ? misses_op : "null");
+	}
+	fflush(stdout);
+	free(sample);
+	free(thread);
+}
+
+/** Returns the next thread count: the powers of 2 below max_threads
+ * followed by max_threads itself.
+ * \param threads The current thread count.
+ * \param max_threads The maximum thread count.
+ * \return The next thread count or 0 after max_threads. */
+static size_t next_threads(size_t threads, size_t max_threads) {
+	if (threads >= max_threads) return 0;
+	return threads * 2 < max_threads ? threads * 2 : max_threads;
+}
+
+/** Prints the usage.
+ * \param name The name of the program. */
+static void usage(const char *name) {
+	fprintf(stderr,
+		"Usage: %s [-t max_threads] [-n batches] [-f csv|json] [-c case]\n"
+		"\t-t\tRun on 1, 2, 4, ... up to max_threads threads (default: CPU count)\n"
+		"\t-n\tNumber of batches of %d operations per thread (default: %d)\n"
+		"\t-f\tOutput format (default: csv)\n"
+		"\t-c\tOnly run the cases with this name\n",
+		name, BENCH_BATCH, BENCH_SAMPLES);
+}
+
+int main(int argc, char **argv) {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t max_threads = cpus > 0 ? (size_t)cpus : 1;
+	size_t samples = BENCH_SAMPLES;
+	bench_format_t format = BENCH_CSV;
+	const char *only = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "t:n:f:c:h")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			samples = strtoul(optarg, NULL, 10);
+			break;
+		case 'f':
+			if (!strcmp(optarg, "csv")) {
+				format = BENCH_CSV;
+			} else if (!strcmp(optarg, "json")) {
+				format = BENCH_JSON;
+			} else {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'c':
+			only = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt != 'h';
+		}
+	}
+	if (!max_threads || !samples) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (format == BENCH_CSV) {
+		printf("case,payload,threads,ns_op_mean,ns_op_p50,ns_op_p90,ns_op_p99,ns_op_max,cycles_op,mops,misses_op\n");
+	} else {
+		printf("[");
+	}
+	int first = 1;
+	for (size_t i = 0; i < sizeof(g_cases) / sizeof(g_cases[0]); i++) {
+		if (only && strcmp(only, g_cases[i].name)) continue;
+		size_t case_threads = max_threads;
+		if (g_cases[i].max_threads && g_cases[i].max_threads < case_threads)
+			case_threads = g_cases[i].max_threads;
+		for (size_t threads = 1; threads; threads = next_threads(threads, case_threads)) {
+			bench_run(&g_cases[i], threads, samples, format, first);
+			first = 0;
+		}
+	}
+	if (format == BENCH_JSON) printf("\n]\n");
+	return 0;
+}
@@ -31,15 +31,73 @@ SOFTWARE.
 #include <stddef.h>
 #include <stdalign.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
 
 /** Flag for testing macros that call exit() */
 extern int g_is_exit_called;
 /** Flag for testing macros that return from the caller */
 extern int g_is_return_called;
 
-/** Shorthand for passing error information to functions */
+/** The id of result objects in OK state whose value is stored in the
+ * handle itself. */
+#define RES_INLINE_ID ((size_t)-2)
+
+/** Whether the OK value of the type is stored in the handle instead of
+ * the result buffer.
+ * \param T The type of the OK value. */
+#define RES_IS_INLINE(T)\
+	(sizeof(T) <= sizeof(void *))
+
+/** The size of the inline storage in the handle.
+ * \param T The type of the OK value. */
+#define RES_INLINE_SIZE(T)\
+	(RES_IS_INLINE(T) ? sizeof(T) : 0)
+
+/** The inline storage of a handle, the word after its id. An OK value that
+ * is no bigger than a pointer is no bigger than size_t and no stricter
+ * aligned either, so a word holds it.
+ * \param res The handle. */
+#define RES_INLINE_OK(res)\
+	((res).res_words + 1)
+
+#ifndef RES_FAST_PATH
+/* The fast paths of the typed wrappers are defined in result_fast.h, which
+ * is included at the end if RES_FAST_PATH is defined. Without it, the wrappers
+ * always call into the library. */
+#define res_fast_ok(value, alignment, size, id, err_info) 1
+#define res_fast_lazy_ok(value, alignment, size, id) 1
+#define res_fast_get_ok(id, value, size) 1
+#define res_fast_unwrap(id, value, size) 1
+#define res_fast_del(id) 1
+#endif
+
+/** Shorthand for passing error information to functions. Expands to a
+ * pointer to a static descriptor of the call site, so a single register is
+ * passed. The descriptors are placed into the res_sites section, which is
+ * registered for res_list_sites() when the module is loaded. The descriptor
+ * is declared in a statement expression, so ERRINFO can only be used inside
+ * a function; at file scope GCC rejects it with "braced-group within
+ * expression allowed only inside a function". Declare a site with RES_SITE
+ * there instead. */
 #define ERRINFO\
-	(res_err_info_t){__FILE__, __func__, __LINE__}
+	(__extension__({\
+		RES_SITE(res_site, __func__);\
+		&res_site;\
+	}))
+
+/** Defines a static descriptor of a site in the res_sites section. Unlike
+ * ERRINFO, it can be used at file scope as well, where the address of the
+ * descriptor is a constant:
+ * \code
+ * RES_SITE(g_load_site, "load");
+ * static const res_err_info_t *g_load_info = &g_load_site;
+ * \endcode
+ * \param name The name of the descriptor.
+ * \param func The function the site is reported in. */
+#define RES_SITE(name, func)\
+	__attribute__((section("res_sites"), used, aligned(sizeof(void *))))\
+	static const res_err_info_t name = {__FILE__, (func), __LINE__}
 
 /** Type-alias wrapper for a uniform look
  * \param T The type of the result object. */
@@ -53,60 +111,72 @@ extern int g_is_return_called;
 #define ERR(T, msg)\
 	res_##T##_err((msg), ERRINFO)
 
-/** Creates a new result object with OK state.
+#ifdef RES_TRACK
+#define OK(T, value)\
+	res_##T##_ok((value), ERRINFO)
+#else
+/** Creates a new result object with OK state. No error information is
+ * passed, the return address stands in for it if the call fails. The lazy
+ * wrappers are always inlined, so the return address is in the caller of
+ * OK() even without optimization. If
+ * RES_TRACK is defined, the creation site is passed instead, so leaks of
+ * the result object are reported with file, function and line.
  * \param T The type of the OK value.
  * \param value The OK value.
  * \return The result object. */
 #define OK(T, value)\
-	res_##T##_ok(value, ERRINFO)
+	res_##T##_lazy_ok(value)
+#endif
 
 #ifdef TEST
 #define TRY(T, res, out_param, RT)\
 	do {\
-		if (res_##T##_get_ok((res), (out_param), ERRINFO) != 0) {\
-			res_##RT##_t return_res = res_##RT##_err_from((res).id, ERRINFO);\
-			res_##T##_del((res), ERRINFO);\
+		size_t try_err_id;\
+		if (res_##T##_unwrap((res), (out_param), &try_err_id, ERRINFO) != 0) {\
 			g_is_return_called = 1;\
-			return return_res;\
+			return (res_##RT##_t){.id = try_err_id};\
 		}\
 	} while(0)
 #else
 /** Attempts to return the OK value through an out parameter.
- * Returns from the caller on failure.
+ * Returns from the caller on failure. The result object is consumed in
+ * either case: an OK result object is deleted, an error result object is
+ * moved into the returned result in place with a propagation frame appended.
  * \param T The type of the OK value.
- * \param res The result object.
+ * \param res The result object. It is evaluated once.
  * \param out_param Pointer to the variable to copy the OK value into.
  * \param RT The type of result the caller is expected to return.
  * */
 #define TRY(T, res, out_param, RT)\
 	do {\
-		if (res_##T##_get_ok((res), (out_param), ERRINFO) != 0) {\
-			res_##RT##_t return_res = res_##RT##_err_from((res).id, ERRINFO);\
-			res_##T##_del((res), ERRINFO);\
-			return return_res;\
-		}\
+		size_t try_err_id;\
+		if (res_##T##_unwrap((res), (out_param), &try_err_id, ERRINFO) != 0)\
+			return (res_##RT##_t){.id = try_err_id};\
 	} while(0)
 #endif
 
 #ifdef TEST
 #define UNW(T, res, out_param)\
 	do {\
-		if (res_##T##_get_ok((res), (out_param), ERRINFO) != 0) {\
-			res_##T##_print_err((res), ERRINFO);\
+		size_t unw_err_id;\
+		if (res_##T##_unwrap((res), (out_param), &unw_err_id, ERRINFO) != 0) {\
+			res_generic_print_err(unw_err_id, ERRINFO);\
 			g_is_exit_called = 1;\
 		}\
 	} while(0)
 #else
 /** Attempts to return the OK value through an out parameter.
- * Prints the error info and exits the program on failure.
+ * Prints the error info and exits the program on failure. An OK result
+ * object is deleted.
  * \param T The type of the OK value.
- * \param res The result object.
+ * \param res The result object. It is evaluated once.
  * \param out_param Pointer to the variable to copy the OK value into.
  * */
 #define UNW(T, res, out_param)\
 	do {\
-		if (res_##T##_get_ok((res), (out_param), ERRINFO) != 0) {\
-			res_##T##_print_err((res), ERRINFO);\
+		size_t unw_err_id;\
+		if (res_##T##_unwrap((res), (out_param), &unw_err_id, ERRINFO) != 0) {\
+			res_generic_print_err(unw_err_id, ERRINFO);\
 			exit(1);\
 		}\
 	} while(0)
@@ -120,45 +190,45 @@ extern int g_is_return_called;
 #ifdef TEST
 #define TRY_VOID(res, RT)\
 	do {\
-		if (res_void_get_ok((res), ERRINFO) != 0) {\
-			res_##RT##_t return_res = res_##RT##_err_from((res).id, ERRINFO);\
-			res_void_del((res));\
+		size_t try_err_id;\
+		if (res_void_unwrap((res), &try_err_id, ERRINFO) != 0) {\
 			g_is_return_called = 1;\
-			return return_res;\
+			return (res_##RT##_t){.id = try_err_id};\
 		}\
 	} while(0)
 #else
 /** Returns from the caller if the result object is in ERROR sate.
- * \param res The result object.
+ * The error result object is moved into the returned result in place.
+ * \param res The result object. It is evaluated once.
  * \param RT The type of result the caller is expected to return.
  * */
 #define TRY_VOID(res, RT)\
 	do {\
-		if (res_void_get_ok((res), ERRINFO) != 0) {\
-			res_##RT##_t return_res = res_##RT##_err_from((res).id, ERRINFO);\
-			res_void_del((res));\
-			return return_res;\
-		}\
+		size_t try_err_id;\
+		if (res_void_unwrap((res), &try_err_id, ERRINFO) != 0)\
+			return (res_##RT##_t){.id = try_err_id};\
 	} while(0)
 #endif
 
 #ifdef TEST
 #define UNW_VOID(res)\
 	do {\
-		if (res_void_get_ok((res), ERRINFO) != 0) {\
-			res_void_print_err((res), ERRINFO);\
+		size_t unw_err_id;\
+		if (res_void_unwrap((res), &unw_err_id, ERRINFO) != 0) {\
+			res_generic_print_err(unw_err_id, ERRINFO);\
 			g_is_exit_called = 1;\
 		}\
 	} while(0)
 #else
 /** Prints the error information and exits the program if 
  * the result object is in ERROR state.
- * \param res The result object.
+ * \param res The result object. It is evaluated once.
  * */
 #define UNW_VOID(res)\
 	do {\
-		if (res_void_get_ok((res), ERRINFO) != 0) {\
-			res_void_print_err((res), ERRINFO);\
+		size_t unw_err_id;\
+		if (res_void_unwrap((res), &unw_err_id, ERRINFO) != 0) {\
+			res_generic_print_err(unw_err_id, ERRINFO);\
 			exit(1);\
 		}\
 	} while(0)
@@ -171,43 +241,246 @@ typedef struct res_err_info {
 	int line;
 } res_err_info_t;
 
+/** Bounds of the res_sites section of the module including this header,
+ * defined by the linker. Weak, since a module may have no sites at all. */
+extern const res_err_info_t __start_res_sites[] __attribute__((weak, visibility("hidden")));
+extern const res_err_info_t __stop_res_sites[] __attribute__((weak, visibility("hidden")));
+
+/** Registers the site descriptors of a module. Called by a constructor of
+ * every translation unit including this header, registering the same
+ * module again is a no-op.
+ * \param start The first descriptor of the module.
+ * \param stop The end of the descriptors of the module. */
+void res_register_sites(const res_err_info_t *start, const res_err_info_t *stop);
+
+/** Registers the site descriptors of the module when it is loaded. */
+__attribute__((constructor, unused))
+static void res_register_module_sites(void) {
+	if (__start_res_sites) res_register_sites(__start_res_sites, __stop_res_sites);
+}
+
+/** Struct for configuring the result pools. Fields left zero take
+ * their default values. */
+typedef struct res_config {
+	/** The number of result objects preallocated in the pool of each size class. */
+	size_t initial_capacity;
+	/** The maximum number of result objects in the pool of each size class.
+	 * Creating a result object fails with "Not enough memory" beyond it. */
+	size_t max_capacity;
+	/** Allocates the memory of the pools. Defaults to mmap. */
+	void *(*alloc)(size_t size);
+	/** Frees memory allocated with alloc. Defaults to munmap. */
+	void (*free)(void *ptr, size_t size);
+	/** Writes a batch of formatted reports, errors and leaks, each ending in
+	 * a newline. Called from the background writer thread, one batch at a time.
+	 * Defaults to writing the batch to stderr with a single writev. */
+	void (*sink)(const struct iovec *reports, size_t count);
+	/** The number of errors of the same site reported per window. The rest
+	 * are counted and summarized in a single report. Defaults to 8. */
+	size_t report_burst;
+	/** The length of the rate limiting window in milliseconds. Defaults to 1000. */
+	size_t report_window;
+} res_config_t;
+
+/** Struct for reporting the runtime statistics of the result pools. */
+typedef struct res_stats {
+	/** The number of result objects currently in use. */
+	size_t live;
+	/** The highest number of result objects ever in use at the same time,
+	 * summed over the pools of the size classes. */
+	size_t high_water;
+	/** The number of deleted result objects waiting to be reused. */
+	size_t free;
+	/** The number of times the fallback result object was set. */
+	size_t fallbacks;
+	/** The number of error results created with res_generic_err. */
+	size_t errors_created;
+	/** The number of errors propagated with TRY or res_generic_err_from. */
+	size_t errors_propagated;
+	/** The number of times a thread had to wait for the internal mutex. */
+	size_t mutex_contentions;
+	/** The number of reports dropped because the report queue was full. */
+	size_t reports_dropped;
+	/** The number of errors not reported because their site exceeded its
+	 * rate limit. They are summarized instead. */
+	size_t reports_suppressed;
+} res_stats_t;
+
+/** Handle of a region of result objects. */
+typedef struct res_region {
+	/** The region slot. */
+	size_t slot;
+	/** The region slot that was the innermost one before the region began. */
+	size_t prev;
+} res_region_t;
+
+/** Struct for reporting the live result objects created at the same site. */
+typedef struct res_leak {
+	/** The creation site. Zero if the result objects were created without
+	 * error information. */
+	res_err_info_t site;
+	/** The return address of the creating call if site is zero. */
+	const void *caller;
+	/** The number of live result objects created at the site. */
+	size_t count;
+} res_leak_t;
+
 /** \brief Generates a type-specific opaque handle and static inline functions 
  * for the desired result type. The functions are just type-safe
  * wrappers around the type generic functions filling out some type-specific fields
  * automatically. Please refer to the res_generic_* function documentation
  * for more details about the fundamental behaviour of each of these functions.
+ * OK values no bigger than a pointer are stored in the handle itself with
+ * the id set to RES_INLINE_ID, so they never touch the result buffer.
+ * res_T_peek and res_T_take take the handle by pointer, since such a value
+ * is borrowed from the handle itself. A handle is one word, the id, or two
+ * words if the value can be stored inline. The batch functions res_T_ok_n,
+ * res_T_get_ok_n and res_T_del_n work on arrays of plain ids and always
+ * store the values in the result buffer. A handle is made from such an id
+ * by value, as in (res_T_t){.id = ids[i]}.
+ * If RES_FAST_PATH is defined, the success paths of creating, checking,
+ * unwrapping and deleting bigger values are inlined into the caller as well,
+ * and only the rest calls into the library.
  * \param T The type of the result object.
  * */
 #define TYPEDEF_RES(T)\
 	typedef struct res_##T {\
-		const size_t id;\
+		union {\
+			const size_t id;\
+			size_t res_words[1 + RES_IS_INLINE(T)];\
+		};\
 	} res_##T##_t;\
 	__attribute__((unused))\
-	static inline res_##T##_t res_##T##_ok(T value, res_err_info_t err_info) {\
+	static inline res_##T##_t res_##T##_ok(T value, const res_err_info_t *err_info) {\
+		if (RES_IS_INLINE(T)) {\
+			res_##T##_t res = {.id = RES_INLINE_ID};\
+			memcpy(RES_INLINE_OK(res), &value, RES_INLINE_SIZE(T));\
+			return res;\
+		}\
+		size_t id;\
+		if (!res_fast_ok(&value, alignof(T), sizeof(T), &id, err_info))\
+			return (res_##T##_t){.id = id};\
 		return (res_##T##_t){\
 			.id = res_generic_ok(&value, alignof(T), sizeof(T), err_info)\
 		};\
 	}\
 	__attribute__((unused))\
-	static inline res_##T##_t res_##T##_err(const char *msg, res_err_info_t err_info) {\
+	static inline size_t res_##T##_ok_n(\
+		const T *values, size_t count, size_t *ids, const res_err_info_t *err_info\
+	) {\
+		return res_generic_ok_n(values, alignof(T), sizeof(T), count, ids, err_info);\
+	}\
+	__attribute__((always_inline, unused))\
+	static inline res_##T##_t res_##T##_lazy_ok(T value) {\
+		if (RES_IS_INLINE(T)) {\
+			res_##T##_t res = {.id = RES_INLINE_ID};\
+			memcpy(RES_INLINE_OK(res), &value, RES_INLINE_SIZE(T));\
+			return res;\
+		}\
+		size_t id;\
+		if (!res_fast_lazy_ok(&value, alignof(T), sizeof(T), &id))\
+			return (res_##T##_t){.id = id};\
+		return (res_##T##_t){.id = res_generic_lazy_ok(&value, alignof(T), sizeof(T))};\
+	}\
+	__attribute__((unused))\
+	static inline T *res_##T##_reserve(size_t *id, const res_err_info_t *err_info) {\
+		return res_generic_reserve(alignof(T), sizeof(T), id, err_info);\
+	}\
+	__attribute__((unused))\
+	static inline res_##T##_t res_##T##_commit(size_t id, const res_err_info_t *err_info) {\
+		return (res_##T##_t){.id = res_generic_commit(id, err_info)};\
+	}\
+	__attribute__((unused))\
+	static inline res_##T##_t res_##T##_commit_err(\
+		size_t id, const char *msg, const res_err_info_t *err_info\
+	) {\
+		return (res_##T##_t){.id = res_generic_commit_err(id, msg, err_info)};\
+	}\
+	__attribute__((unused))\
+	static inline res_##T##_t res_##T##_err(const char *msg, const res_err_info_t *err_info) {\
 		return (res_##T##_t){.id = res_generic_err(msg, err_info)};\
 	}\
 	__attribute__((unused))\
-	static inline int res_##T##_get_ok(res_##T##_t res, T *value, res_err_info_t err_info) {\
+	static inline int res_##T##_get_ok(res_##T##_t res, T *value, const res_err_info_t *err_info) {\
+		if (RES_IS_INLINE(T) && res.id == RES_INLINE_ID) {\
+			if (value) memcpy(value, RES_INLINE_OK(res), RES_INLINE_SIZE(T));\
+			return 0;\
+		}\
+		if (!res_fast_get_ok(res.id, value, sizeof(T))) return 0;\
 		return res_generic_get_ok(res.id, value, sizeof(T), err_info);\
 	}\
 	__attribute__((unused))\
-	static inline res_##T##_t res_##T##_err_from(size_t src_id, res_err_info_t err_info) {\
+	static inline size_t res_##T##_get_ok_n(\
+		const size_t *ids, size_t count, T *values, unsigned char *oks,\
+		const res_err_info_t *err_info\
+	) {\
+		return res_generic_get_ok_n(ids, count, values, sizeof(T), oks, err_info);\
+	}\
+	__attribute__((always_inline, unused))\
+	static inline int res_##T##_lazy_get_ok(res_##T##_t res, T *value) {\
+		if (RES_IS_INLINE(T) && res.id == RES_INLINE_ID) {\
+			if (value) memcpy(value, RES_INLINE_OK(res), RES_INLINE_SIZE(T));\
+			return 0;\
+		}\
+		if (!res_fast_get_ok(res.id, value, sizeof(T))) return 0;\
+		return res_generic_lazy_get_ok(res.id, value, sizeof(T));\
+	}\
+	__attribute__((unused))\
+	static inline const T *res_##T##_peek(const res_##T##_t *res, const res_err_info_t *err_info) {\
+		if (RES_IS_INLINE(T) && res->id == RES_INLINE_ID)\
+			return (const T *)(const void *)RES_INLINE_OK(*res);\
+		return res_generic_peek(res->id, sizeof(T), err_info);\
+	}\
+	__attribute__((unused))\
+	static inline const T *res_##T##_take(const res_##T##_t *res, const res_err_info_t *err_info) {\
+		if (RES_IS_INLINE(T) && res->id == RES_INLINE_ID)\
+			return (const T *)(const void *)RES_INLINE_OK(*res);\
+		return res_generic_take(res->id, sizeof(T), err_info);\
+	}\
+	__attribute__((unused))\
+	static inline int res_##T##_unwrap(\
+		res_##T##_t res, T *value, size_t *err_id, const res_err_info_t *err_info\
+	) {\
+		if (RES_IS_INLINE(T) && res.id == RES_INLINE_ID) {\
+			if (value) memcpy(value, RES_INLINE_OK(res), RES_INLINE_SIZE(T));\
+			return 0;\
+		}\
+		if (!res_fast_unwrap(res.id, value, sizeof(T))) return 0;\
+		return res_generic_unwrap(res.id, value, sizeof(T), err_id, err_info);\
+	}\
+	__attribute__((unused))\
+	static inline res_##T##_t res_##T##_err_from(size_t src_id, const res_err_info_t *err_info) {\
 		return (res_##T##_t){.id = res_generic_err_from(src_id, err_info)};\
 	}\
 	__attribute__((unused))\
-	static inline void res_##T##_del(res_##T##_t res, res_err_info_t err_info) {\
-		res_generic_del(res.id, err_info);\
+	static inline void res_##T##_del(res_##T##_t res, const res_err_info_t *err_info) {\
+		if (RES_IS_INLINE(T) && res.id == RES_INLINE_ID) return;\
+		if (res_fast_del(res.id)) res_generic_del(res.id, err_info);\
+	}\
+	__attribute__((unused))\
+	static inline void res_##T##_del_n(\
+		const size_t *ids, size_t count, const res_err_info_t *err_info\
+	) {\
+		res_generic_del_n(ids, count, err_info);\
+	}\
+	__attribute__((always_inline, unused))\
+	static inline void res_##T##_lazy_del(res_##T##_t res) {\
+		if (RES_IS_INLINE(T) && res.id == RES_INLINE_ID) return;\
+		if (res_fast_del(res.id)) res_generic_lazy_del(res.id);\
 	}\
 	__attribute__((unused))\
-	static inline void res_##T##_print_err(res_##T##_t res, res_err_info_t err_info) {\
+	static inline void res_##T##_print_err(res_##T##_t res, const res_err_info_t *err_info) {\
 		res_generic_print_err(res.id, err_info);\
 	}\
+	__attribute__((unused))\
+	static inline res_##T##_t res_##T##_share(res_##T##_t res, const res_err_info_t *err_info) {\
+		if (RES_IS_INLINE(T) && res.id == RES_INLINE_ID) return res;\
+		return (res_##T##_t){.id = res_generic_share(res.id, err_info)};\
+	}\
+	_Static_assert(\
+		sizeof(res_##T##_t) == sizeof(size_t) * (1 + RES_IS_INLINE(T)),\
+		"The handle of " #T " is not made of words"\
+	)
 
 /** Creates a new result object with OK state.
  * \param value Pointer to the OK value. Can take NULL if the result is of type void.
@@ -215,50 +488,252 @@ typedef struct res_err_info {
  * \param size The size of the data to be stored.
  * \param err_info The error information to be used on failure. 
  * \return A unique id to initialize a new instance of a result struct with. */
-size_t res_generic_ok(const void *value, size_t alignment, size_t size, res_err_info_t err_info);
+size_t res_generic_ok(const void *value, size_t alignment, size_t size, const res_err_info_t *err_info);
+/** Creates a new result object with OK state without taking error
+ * information. If the call fails, the fallback records its return address,
+ * which is resolved into a module and a symbol only when it is printed.
+ * \param value Pointer to the OK value.
+ * \param alignment The alignment of the data to be stored. It must be a power of 2.
+ * \param size The size of the data to be stored.
+ * \return A unique id to initialize a new instance of a result struct with. */
+size_t res_generic_lazy_ok(const void *value, size_t alignment, size_t size);
+/** Creates count result objects with OK state, taking them from the buffer
+ * with a single synchronization step.
+ * \param values Array of count OK values of size bytes each. Can take NULL.
+ * \param alignment The alignment of the data to be stored. It must be a power of 2.
+ * \param size The size of each OK value.
+ * \param count The number of result objects to create.
+ * \param ids Set to the ids of the result objects, g_res_fallback_id for those
+ * that couldn't be created.
+ * \param err_info The error information to be used on failure.
+ * \return The number of result objects created. */
+size_t res_generic_ok_n(
+	const void *values, size_t alignment, size_t size, size_t count, size_t *ids,
+	const res_err_info_t *err_info
+);
+/** Reserves a result object for an OK value to be constructed in place.
+ * The result object must be finished with res_generic_commit or
+ * res_generic_commit_err, or deleted.
+ * \param alignment The alignment of the data to be stored. It must be a power of 2.
+ * \param size The size of the data to be stored.
+ * \param id Set to the id of the result object or the fallback id on failure.
+ * \param err_info The error information to be used on failure.
+ * \return Pointer to the uninitialized, aligned data or NULL on failure. */
+void *res_generic_reserve(size_t alignment, size_t size, size_t *id, const res_err_info_t *err_info);
+/** Commits a reserved result object as OK.
+ * \param id The id of the reserved result object.
+ * \param err_info The error information to be used on failure.
+ * \return The id to initialize a new instance of a result struct with.
+ * The fallback id of a failed reservation is returned as is. */
+size_t res_generic_commit(size_t id, const res_err_info_t *err_info);
+/** Turns a reserved result object into a result object with ERROR state
+ * without leaking the reservation.
+ * \param id The id of the reserved result object.
+ * \param msg The error message.
+ * \param err_info Additional error information.
+ * \return The id to initialize a new instance of a result struct with.
+ * The fallback id of a failed reservation is returned as is. */
+size_t res_generic_commit_err(size_t id, const char *msg, const res_err_info_t *err_info);
 /** Creates a new result object with ERROR state.
  * \param msg The error message.
  * \param err_info Additional error information.
  * \return A unique id to initialize a new instance of a result struct with. */
-size_t res_generic_err(const char *msg, res_err_info_t err_info);
+size_t res_generic_err(const char *msg, const res_err_info_t *err_info);
 /** Checks the state of the result object. 
  * \param id The id of the result object.
  * \param value A pointer to the variable to copy the OK value into.
  * Can take NULL in case the result object is of type void. 
  * \param size The size of the OK value. 
  * \param err_info The error information to be used on failure. */
-int res_generic_get_ok(size_t id, void *value, size_t size, res_err_info_t err_info);
-/** Creates a new result object with ERROR state and initializes it with the 
- * error information stored in another result object.
- * \param src_id The id of the source result object.
- * \err_info The error information to be used on failure. */
-size_t res_generic_err_from(size_t src_id, res_err_info_t err_info);
+int res_generic_get_ok(size_t id, void *value, size_t size, const res_err_info_t *err_info);
+/** Checks the state of the result object without taking error information.
+ * \param id The id of the result object.
+ * \param value A pointer to the variable to copy the OK value into. Can take NULL.
+ * \param size The size of the OK value.
+ * \return 0 if the result is OK, 1 if it isn't, 2 if any of the arguments are invalid. */
+int res_generic_lazy_get_ok(size_t id, void *value, size_t size);
+/** Checks the states of count result objects. Unlike res_generic_get_ok, a
+ * result in RES_STATE_ERR doesn't set the fallback.
+ * \param ids The ids of the result objects.
+ * \param count The number of result objects.
+ * \param values Array of count variables to copy the OK values into. Can take NULL.
+ * \param size The size of each OK value.
+ * \param oks Set to 1 for each OK result and 0 for the rest. Can take NULL.
+ * \param err_info The error information to be used on failure.
+ * \return The number of OK results. */
+size_t res_generic_get_ok_n(
+	const size_t *ids, size_t count, void *values, size_t size, unsigned char *oks,
+	const res_err_info_t *err_info
+);
+/** Returns a pointer to the OK value inside the result object without
+ * copying it. The pointer stays valid until the result object is deleted.
+ * \param id The id of the result object.
+ * \param size The size of the OK value.
+ * \param err_info The error information to be used on failure.
+ * \return Pointer to the OK value or NULL on failure. */
+const void *res_generic_peek(size_t id, size_t size, const res_err_info_t *err_info);
+/** Deletes the result object and returns a pointer to its OK value without
+ * copying it. The pointer stays valid until the next take on the same thread.
+ * Result objects handed over with res_generic_share can't be taken if the
+ * library is built with RES_THREAD_LOCAL.
+ * \param id The id of the result object.
+ * \param size The size of the OK value.
+ * \param err_info The error information to be used on failure.
+ * \return Pointer to the OK value or NULL on failure. */
+const void *res_generic_take(size_t id, size_t size, const res_err_info_t *err_info);
+/** Consumes the result object: copies the OK value out and deletes the
+ * result object, or moves the error result object to a new id in the same
+ * slot with a propagation frame appended. Used by TRY, TRY_VOID, UNW and
+ * UNW_VOID.
+ * \param id The id of the result object.
+ * \param value Pointer to the variable to copy the OK value into. Can take NULL.
+ * \param size The size of the OK value.
+ * \param err_id Set to the id the caller has to return or print if the
+ * result isn't OK. The caller owns it from now on.
+ * \param err_info The error information to be used on failure.
+ * \return 0 if the result was OK, 1 if it wasn't, 2 if any of the arguments
+ * are invalid. */
+int res_generic_unwrap(
+	size_t id, void *value, size_t size, size_t *err_id, const res_err_info_t *err_info
+);
+/** Propagates the error stored in another result object and appends a
+ * propagation frame to it. An error result object is moved to a new id in
+ * the same slot without allocating, only the fallback is copied into a new
+ * result object.
+ * \param src_id The id of the source result object. It is consumed and
+ * must not be used after the call.
+ * \param err_info The site the error is propagated through, also used on failure.
+ * \return The id to initialize a new instance of a result struct with. */
+size_t res_generic_err_from(size_t src_id, const res_err_info_t *err_info);
 /** Sets the state of the result object INVALID. Its memory in the buffer is marked 
- * to be reused. 
+ * to be reused. Deleting the fallback result object clears the error of the
+ * failed call it holds. 
  * \param id The id of thet result object. 
  * \param err_info The error information to be used on failure. */
-void res_generic_del(size_t id, res_err_info_t err_info);
-/** Prints the error information stored in the result object.
+void res_generic_del(size_t id, const res_err_info_t *err_info);
+/** Deletes the result object without taking error information.
+ * \param id The id of thet result object. */
+void res_generic_lazy_del(size_t id);
+/** Deletes count result objects, returning them to the buffer in runs with
+ * a single synchronization step each. The fallback id may appear any number
+ * of times and clears the error of the fallback.
+ * \param ids The ids of the result objects.
+ * \param count The number of result objects.
+ * \param err_info The error information to be used on failure. */
+void res_generic_del_n(const size_t *ids, size_t count, const res_err_info_t *err_info);
+/** Prints the error information stored in the result object. The fallback
+ * result object is only printed for the fallback id or an invalid id.
  * \param id The id of the result object.
  * \param err_info The error information to be used on failure. */
-void res_generic_print_err(size_t id, res_err_info_t err_info);
+void res_generic_print_err(size_t id, const res_err_info_t *err_info);
+/** Configures the result pools. Must be called before any result object
+ * is created. If the library is built with RES_THREAD_LOCAL, the capacities
+ * apply to the pool of every thread.
+ * \param config The configuration. Can take NULL to restore the defaults.
+ * \return 0 on success, 1 if the configuration is invalid, 2 if result objects
+ * have already been created, 3 if the initial capacity couldn't be allocated. */
+int res_init(const res_config_t *config);
+/** Reads the runtime statistics of the result pools. The counters are
+ * global, the pool figures belong to the calling thread if the library is
+ * built with RES_THREAD_LOCAL. The figures are read without stopping other
+ * threads, so they are only consistent with each other when no result
+ * objects are created or deleted meanwhile.
+ * \param stats The struct to write the statistics into.
+ * \return 0 on success, 1 if stats is NULL or the library is built with
+ * RES_NO_STATS. The pool figures and the dropped reports are filled in even
+ * without the counters. */
+int res_stats(res_stats_t *stats);
+/** Lists the live result objects grouped by their creation site. Creation
+ * sites are only recorded if the library is built with RES_TRACK, otherwise
+ * no sites are listed. If the library is built with RES_THREAD_LOCAL, only
+ * the pools of the calling thread are listed.
+ * \param leaks The array to write the sites into, the site with the most
+ * live result objects first. Can take NULL if size is 0.
+ * \param size The number of elements of leaks.
+ * \return The number of sites, which may be bigger than size. */
+size_t res_leaks(res_leak_t *leaks, size_t size);
+/** Prints the live result objects grouped by their creation site. If the
+ * library is built with RES_TRACK, this is also done automatically at exit.
+ * \return The number of live result objects. */
+size_t res_print_leaks(void);
+/** Writes the queued reports to the sink and waits until they are written.
+ * Printing an error only queues its report for the background writer
+ * thread; the queue is also flushed at exit, so the report of UNW is never
+ * lost. Call this before leaving the process in any other way, such as _exit.
+ * The errors suppressed by the rate limit so far are summarized as well. */
+void res_flush_reports(void);
+/** Starts printing errors as fixed-size binary records into a ring file
+ * instead of reporting them as text. Nothing is formatted: a record holds
+ * the time, the thread, the message id and the site ids of the error, and
+ * every site and message is copied into the file once. Errors of calls made
+ * without error information are still reported as text. Decode the file
+ * with the res-decode tool. Must not be called while errors are printed.
+ * \param path The path of the file. It is truncated if it exists.
+ * \param capacity The number of records the ring keeps, the oldest ones are
+ * overwritten. 0 takes the default of 65536.
+ * \return 0 on success, 1 if capacity is too big, 2 if the file couldn't
+ * be created or mapped. */
+int res_log_open(const char *path, size_t capacity);
+/** Stops printing errors into the binary log and closes it. Must not be
+ * called while errors are printed. */
+void res_log_close(void);
+/** Begins a region on the calling thread. Every result object the thread
+ * creates until the region ends belongs to the region, and all of them are
+ * released at once when it ends, whether they were deleted or not. Regions
+ * nest: the innermost one gets the result objects. Up to 15 regions can be
+ * in use at the same time, per thread if the library is built with
+ * RES_THREAD_LOCAL and per process otherwise. Without RES_THREAD_LOCAL that
+ * means 15 threads at most, counting every nesting level. The limit is fixed
+ * because every id stores its region slot. When no region is free, the
+ * result objects are simply created outside of any region.
+ * \param region The handle to write the region into.
+ * \return 0 on success, 1 if region is NULL, 2 if all regions are in use. */
+int res_region_begin(res_region_t *region);
+/** Ends the innermost region of the calling thread and releases all of its
+ * result objects at once, like an arena reset. Their ids turn
+ * invalid, and their memory is kept for the next region to use. The result
+ * objects must not be used by other threads while the region ends.
+ * Pointers returned by res_generic_peek and res_generic_take for the result
+ * objects of the region dangle after the call, since the next region
+ * overwrites their memory, even if the result objects were never deleted.
+ * \param region The handle of the region.
+ * \return 0 on success, 1 if region is not the innermost region of the thread. */
+int res_region_end(res_region_t region);
+/** Lists the site descriptors of all registered modules, that is every
+ * ERRINFO in the program and its loaded libraries.
+ * \param sites The array to write the descriptors into. Can take NULL if size is 0.
+ * \param size The number of elements of sites.
+ * \return The number of sites, which may be bigger than size. */
+size_t res_list_sites(const res_err_info_t **sites, size_t size);
+/** Hands the result object over to another thread. If the library is built
+ * with RES_THREAD_LOCAL, every thread owns its own pool and the result object
+ * is moved into a shared pool, otherwise the id is returned as is. The ids
+ * of a thread's own pool carry its owner and are rejected on other threads.
+ * The shared pool grows up to max_capacity result objects.
+ * The source id must not be used after the call.
+ * \param id The id of the result object.
+ * \param err_info The error information to be used on failure.
+ * \return The id that is valid on any thread. */
+size_t res_generic_share(size_t id, const res_err_info_t *err_info);
 
 /** Opaque handle for the result object. */
 typedef struct res_void {
 	const size_t id;
 } res_void_t;
 
-/** Creates new result object with OK state.
+/** Creates new result object with OK state. There is no value to store,
+ * so the result object never touches the result buffer.
  * \param err_info The error information to be used on failure. 
  * \return The result object. */
-static inline res_void_t res_void_ok(res_err_info_t err_info) {
-	return (res_void_t){.id = res_generic_ok(NULL, 2, 2, err_info)};
+static inline res_void_t res_void_ok(const res_err_info_t *err_info) {
+	(void)err_info;
+	return (res_void_t){.id = RES_INLINE_ID};
 }
 /** Creates a new result object with ERROR state.
  * \param msg The error message. 
  * \param err_info Additional error information. 
  * \return The result object. */
-static inline res_void_t res_void_err(const char *msg, res_err_info_t err_info) {
+static inline res_void_t res_void_err(const char *msg, const res_err_info_t *err_info) {
 	return (res_void_t){.id = res_generic_err(msg, err_info)};
 }
 /** Checks the state of the result object.
@@ -266,29 +741,68 @@ static inline res_void_t res_void_err(const char *msg, res_err_info_t err_info)
  * \param err_info The error information to be used on failure.
  * \return 0 if the result is OK, 1 if the result is not OK, 2 if any of the 
  * arguments are invalid. */
-static inline int res_void_get_ok(res_void_t res, res_err_info_t err_info) {
+static inline int res_void_get_ok(res_void_t res, const res_err_info_t *err_info) {
+	if (res.id == RES_INLINE_ID) return 0;
 	return res_generic_get_ok(res.id, NULL, 2, err_info);
 }
-/** Creates a new result object with ERROR state and initializes it with 
- * the error information of another result object. 
+/** Consumes the result object.
+ * \param res The result object.
+ * \param err_id Set to the id of the error result object if the result isn't OK.
+ * \param err_info The error information to be used on failure.
+ * \return 0 if the result is OK, 1 if the result is not OK, 2 if any of the
+ * arguments are invalid. */
+static inline int res_void_unwrap(res_void_t res, size_t *err_id, const res_err_info_t *err_info) {
+	if (res.id == RES_INLINE_ID) return 0;
+	return res_generic_unwrap(res.id, NULL, 2, err_id, err_info);
+}
+/** Propagates the error of another result object and consumes it.
  * \param src_id The id of the source result object.
  * \param err_info The error information to be used on failure. 
  * \return The result object. */
-static inline res_void_t res_void_err_from(size_t src_id, res_err_info_t err_info) {
+static inline res_void_t res_void_err_from(size_t src_id, const res_err_info_t *err_info) {
 	return (res_void_t){.id = res_generic_err_from(src_id, err_info)};
 }
+/** Checks the state of the result object without taking error information.
+ * \param res The result object.
+ * \return 0 if the result is OK, 1 if the result is not OK, 2 if any of the
+ * arguments are invalid. */
+__attribute__((always_inline))
+static inline int res_void_lazy_get_ok(res_void_t res) {
+	if (res.id == RES_INLINE_ID) return 0;
+	return res_generic_lazy_get_ok(res.id, NULL, 2);
+}
+/** Deletes the result object without taking error information.
+ * \param res The result object. */
+__attribute__((always_inline))
+static inline void res_void_lazy_del(res_void_t res) {
+	if (res.id == RES_INLINE_ID) return;
+	res_generic_lazy_del(res.id);
+}
 /** Deletes the result object.
  * \param res The result object.
  * \param err_info The error information to be used on failure. */
-static inline void res_void_del(res_void_t res, res_err_info_t err_info) {
+static inline void res_void_del(res_void_t res, const res_err_info_t *err_info) {
+	if (res.id == RES_INLINE_ID) return;
 	res_generic_del(res.id, err_info);
 }
 /** Prints the error information stored in the result object. 
  * \param res The result object.
  * \param err_info The error information to be used on failure. */\
-static inline void res_void_print_err(res_void_t res, res_err_info_t err_info) {
+static inline void res_void_print_err(res_void_t res, const res_err_info_t *err_info) {
 	res_generic_print_err(res.id, err_info);
 }
+/** Hands the result object over to another thread.
+ * \param res The result object.
+ * \param err_info The error information to be used on failure.
+ * \return The result object that is valid on any thread. */
+static inline res_void_t res_void_share(res_void_t res, const res_err_info_t *err_info) {
+	if (res.id == RES_INLINE_ID) return res;
+	return (res_void_t){.id = res_generic_share(res.id, err_info)};
+}
+
+#ifdef RES_FAST_PATH
+#include "result_fast.h"
+#endif
 
 #endif
 
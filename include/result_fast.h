@@ -0,0 +1,746 @@
+/*
+MIT License
+Copyright (c) 2025 András Broskó
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+/**
+ * \file include/result_fast.h
+ * \brief Inline fast path of the result library
+ * \details This file contains the layout of the result pools and the inline
+ * functions reading and claiming result objects without calling into the
+ * library. It is included by result.h if RES_FAST_PATH is defined and by
+ * the library itself, so both agree on the layout.
+ * */
+
+#ifndef RESULT_FAST_H
+#define RESULT_FAST_H
+
+#include "result.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+/** Number of result objects in the first chunk of a pool. Every further
+ * chunk doubles the capacity of the pool. */
+#define RES_CHUNK_SIZE 32LU
+/** Log2 of RES_CHUNK_SIZE. */
+#define RES_CHUNK_SHIFT 5
+/** Alignment of the parts of a chunk. */
+#define RES_CACHE_LINE 64LU
+/** Number of result objects per word of the free bitmap. */
+#define RES_WORD_BITS 64LU
+/** Number of size classes. */
+#define RES_CLASS_COUNT 4LU
+/** Size of the data of the smallest size class. */
+#define RES_CLASS_MIN_SIZE 16LU
+/** Size of the data of a size class. Each class is four times
+ * the size of the previous one: 16, 64, 256 and 1024 bytes.
+ * \param c The size class. */
+#define RES_CLASS_SIZE(c) (RES_CLASS_MIN_SIZE << (2 * (c)))
+/** Number of bits of an id holding the index of the result object in its pool.
+ * The bits above hold the size class. */
+#define RES_INDEX_BITS 24
+/** Mask of the index part of an id. */
+#define RES_INDEX_MASK ((1LU << RES_INDEX_BITS) - 1)
+/** Number of bits of an id holding the size class. */
+#define RES_CLASS_BITS 7
+/** Shift of the generation part of an id. The generation is incremented
+ * every time the result object is deleted, so a stale id never matches
+ * the result object that reuses its memory. */
+#define RES_GEN_SHIFT 32
+#ifdef RES_THREAD_LOCAL
+/** Number of bits of the generation. The bits above hold the owner. */
+#define RES_GEN_BITS 24
+/** Number of bits of an id holding its owner, the number of the thread
+ * whose pools hold the result object. An id used on another thread fails
+ * validation instead of matching the slot with the same index there. */
+#define RES_OWNER_BITS 8
+#else
+/** Number of bits of the generation. */
+#define RES_GEN_BITS 30
+/** One pool is shared by all threads, so ids have no owner. */
+#define RES_OWNER_BITS 0
+#endif
+/** Mask of the generation. */
+#define RES_GEN_MASK ((1LU << RES_GEN_BITS) - 1)
+/** Shift of the owner part of an id. Without RES_THREAD_LOCAL the bits
+ * from here on are always zero. */
+#define RES_OWNER_SHIFT (RES_GEN_SHIFT + RES_GEN_BITS)
+/** Number of owners. The threads beyond the first RES_OWNER_COUNT - 1
+ * alive at once share owner 0. */
+#define RES_OWNER_COUNT (1LU << RES_OWNER_BITS)
+/** Number of bits of a tag holding the state. The bits above hold
+ * the generation. */
+#define RES_STATE_BITS 2
+/** Mask of the state part of a tag. */
+#define RES_STATE_MASK ((1U << RES_STATE_BITS) - 1)
+/** Maximum number of chunks of a pool. */
+#define RES_MAX_CHUNKS (RES_INDEX_BITS - RES_CHUNK_SHIFT + 1)
+/** Number of region slots. Slot 0 stands for the pools outside of any
+ * region, every other slot has a pool for each size class. */
+#define RES_REGION_COUNT 16LU
+/** Number of pools. Pool p holds the size class p % RES_CLASS_COUNT of the
+ * region slot p / RES_CLASS_COUNT, so the pools outside of any region come
+ * first. The pool is stored in the class part of an id. */
+#define RES_POOL_COUNT (RES_CLASS_COUNT * RES_REGION_COUNT)
+/** Number of bits of the generation of a region result object that belong
+ * to its slot. The bits above hold the epoch of the region, which is
+ * incremented every time the region ends. */
+#define RES_SLOT_GEN_BITS 14
+/** Mask of the slot part of the generation of a region result object. */
+#define RES_SLOT_GEN_MASK ((1LU << RES_SLOT_GEN_BITS) - 1)
+/** Number of bits of the epoch in the generation of a region result
+ * object: 16, or 10 if RES_THREAD_LOCAL is defined. */
+#define RES_EPOCH_BITS (RES_GEN_BITS - RES_SLOT_GEN_BITS)
+
+#ifdef RES_THREAD_LOCAL
+/** Storage class of the result pool. Every thread owns its own pool. */
+#define RES_TLS _Thread_local
+/** The pool is never touched by another thread, so its fields and
+ * operations are plain. */
+#define RES_ATOMIC(T) T
+#define RES_LOAD(obj, order) (*(obj))
+#define RES_STORE(obj, desired, order) ((void)(*(obj) = (desired)))
+#define RES_CAS(obj, expected, desired, succ, fail)\
+	__extension__ ({\
+		int res_cas_ok = *(obj) == *(expected);\
+		if (res_cas_ok) *(obj) = (desired); else *(expected) = *(obj);\
+		res_cas_ok;\
+	})
+#define RES_ADD(obj, n, order) ((void)(*(obj) += (n)))
+#define RES_SUB(obj, n, order) ((void)(*(obj) -= (n)))
+#define RES_FETCH_OR(obj, mask, order)\
+	__extension__ ({\
+		__typeof__(*(obj)) res_old = *(obj);\
+		*(obj) = res_old | (mask);\
+		res_old;\
+	})
+#define RES_FETCH_AND(obj, mask, order)\
+	__extension__ ({\
+		__typeof__(*(obj)) res_old = *(obj);\
+		*(obj) = res_old & (mask);\
+		res_old;\
+	})
+#else
+/** Storage class of the result pool. One pool is shared by all threads. */
+#define RES_TLS
+/** The pool is shared, so its fields and operations are atomic. */
+#define RES_ATOMIC(T) _Atomic(T)
+#define RES_LOAD atomic_load_explicit
+#define RES_STORE atomic_store_explicit
+#define RES_CAS atomic_compare_exchange_weak_explicit
+#define RES_ADD(obj, n, order) ((void)atomic_fetch_add_explicit((obj), (n), (order)))
+#define RES_SUB(obj, n, order) ((void)atomic_fetch_sub_explicit((obj), (n), (order)))
+#define RES_FETCH_OR atomic_fetch_or_explicit
+#define RES_FETCH_AND atomic_fetch_and_explicit
+#endif
+
+#ifdef RES_THREAD_LOCAL
+#define RES_CONFIG_TLS tls
+#else
+#define RES_CONFIG_TLS shared
+#endif
+#ifdef RES_TRACK
+#define RES_CONFIG_TRACK track
+#else
+#define RES_CONFIG_TRACK notrack
+#endif
+#ifdef RES_NO_STATS
+#define RES_CONFIG_STATS nostats
+#else
+#define RES_CONFIG_STATS stats
+#endif
+#define RES_CONFIG_NAME_(tls, track, stats) res_config_##tls##_##track##_##stats
+#define RES_CONFIG_NAME(tls, track, stats) RES_CONFIG_NAME_(tls, track, stats)
+/** Symbol named after the options that change the layout of the pools,
+ * e.g. res_config_shared_notrack_stats. The library defines it and the
+ * inline fast path references it, so a client compiled with other options
+ * than the library fails to link instead of corrupting the pools. */
+#define RES_CONFIG RES_CONFIG_NAME(RES_CONFIG_TLS, RES_CONFIG_TRACK, RES_CONFIG_STATS)
+extern const int RES_CONFIG;
+
+/** Result states enum */
+typedef enum res_state {
+	RES_STATE_INVALID,
+	RES_STATE_ERR,
+	RES_STATE_OK,
+	/** Allocated by res_generic_reserve, but not committed yet. */
+	RES_STATE_RESERVED
+} res_state_t;
+
+/** Creation site of a result object. */
+typedef struct res_site_ref {
+	/** The descriptor of the site or NULL if it was created without one. */
+	const res_err_info_t *info;
+	/** The return address of the creating call if info is NULL. */
+	const void *caller;
+} res_site_ref_t;
+
+/** Pool of the result objects of one size class. The result objects live in
+ * chunks that are allocated as the pool grows and are never moved, so an
+ * index stays valid across growth. Chunk 0 holds RES_CHUNK_SIZE result
+ * objects, chunk k > 0 holds RES_CHUNK_SIZE << (k - 1). Each chunk starts
+ * with the tags of its result objects, followed by the free bitmap, the
+ * creation sites if RES_TRACK is defined and the data, each part aligned to
+ * RES_CACHE_LINE. A tag holds the
+ * state of the result object in its lower RES_STATE_BITS bits and the
+ * generation above, so both are checked and changed with a single atomic
+ * operation. A bit of the free bitmap is set while its result object is
+ * deleted and waits to be reused, so 64 of them are found and claimed with
+ * a single atomic operation. */
+typedef struct res_pool {
+	/** The chunks of the pool. */
+	RES_ATOMIC(unsigned char *) chunks[RES_MAX_CHUNKS];
+	/** The number of currently active result objects. */
+	RES_ATOMIC(size_t) count;
+	/** The highest count of the pool before its region last ended, which
+	 * resets the count. Only region pools have it. */
+	RES_ATOMIC(size_t) peak;
+	/** The number of currently active result objects ready to be reused.
+	 * It changes on every create and delete, so it starts a cache line of
+	 * its own, away from the chunks and the count that every access reads.
+	 * The alignment also keeps neighbouring pools off each other's lines. */
+	alignas(RES_CACHE_LINE) RES_ATOMIC(size_t) free_count;
+	/** The index of a recently freed result object, where the search of the
+	 * free bitmap starts. */
+	RES_ATOMIC(size_t) free_hint;
+} res_pool_t;
+
+/** The pools of each size class, outside of any region first. */
+extern RES_TLS res_pool_t g_res_pools[RES_POOL_COUNT];
+/** The epoch of each region slot, incremented every time the region ends. */
+extern RES_TLS RES_ATOMIC(size_t) g_res_region_epochs[RES_REGION_COUNT];
+/** The innermost region slot of the calling thread, 0 if it is outside of
+ * any region. */
+extern _Thread_local size_t g_res_region;
+/** The id for the fallback result object. */
+extern const size_t g_res_fallback_id;
+/** Whether the calling thread is registered for the cleanup. */
+extern _Thread_local int g_res_thread_registered;
+#ifdef RES_THREAD_LOCAL
+/** The owner of the ids created by the calling thread, assigned when it
+ * is registered. */
+extern _Thread_local size_t g_res_owner;
+#endif
+
+/** Finds the smallest size class that can hold the data.
+ * \param size The size of the data.
+ * \return The size class or RES_CLASS_COUNT if the data is too big. */
+static inline size_t res_size_class(size_t size) {
+	size_t c = 0;
+	while (c < RES_CLASS_COUNT && RES_CLASS_SIZE(c) < size) c++;
+	return c;
+}
+
+/** Rounds the size up to RES_CACHE_LINE.
+ * \param size The size to be rounded. */
+static inline size_t res_round_to_line(size_t size) {
+	return (size + RES_CACHE_LINE - 1) & ~(RES_CACHE_LINE - 1);
+}
+
+/** Returns the chunk that holds the index.
+ * \param index The index of the result object in its pool. */
+static inline size_t res_chunk_of(size_t index) {
+	if (index < RES_CHUNK_SIZE) return 0;
+	return (size_t)(64 - __builtin_clzl(index)) - RES_CHUNK_SHIFT;
+}
+
+/** Returns the index of the first result object of the chunk.
+ * \param k The chunk. */
+static inline size_t res_chunk_start(size_t k) {
+	return k ? RES_CHUNK_SIZE << (k - 1) : 0;
+}
+
+/** Returns the number of result objects in the chunk.
+ * \param k The chunk. */
+static inline size_t res_chunk_slots(size_t k) {
+	return k ? RES_CHUNK_SIZE << (k - 1) : RES_CHUNK_SIZE;
+}
+
+/** Returns the number of words of the free bitmap of the chunk.
+ * \param k The chunk. */
+static inline size_t res_chunk_words(size_t k) {
+	return (res_chunk_slots(k) + RES_WORD_BITS - 1) / RES_WORD_BITS;
+}
+
+/** Returns the offset of the free bitmap in the chunk.
+ * \param k The chunk. */
+static inline size_t res_chunk_bitmap_offset(size_t k) {
+	return res_round_to_line(res_chunk_slots(k) * sizeof(uint32_t));
+}
+
+/** Returns the offset of the creation sites in the chunk.
+ * \param k The chunk. */
+static inline size_t res_chunk_sites_offset(size_t k) {
+	return res_chunk_bitmap_offset(k) + res_round_to_line(res_chunk_words(k) * sizeof(uint64_t));
+}
+
+/** Returns the offset of the data in the chunk.
+ * \param k The chunk. */
+static inline size_t res_chunk_data_offset(size_t k) {
+#ifdef RES_TRACK
+	return res_chunk_sites_offset(k) + res_round_to_line(res_chunk_slots(k) * sizeof(res_site_ref_t));
+#else
+	return res_chunk_sites_offset(k);
+#endif
+}
+
+/** Returns the chunk of the pool holding the index.
+ * \param pool The pool.
+ * \param index The index of the result object.
+ * \return The chunk or NULL if the chunk hasn't been allocated yet. */
+static inline unsigned char *res_get_chunk(res_pool_t *pool, size_t index) {
+	return RES_LOAD(&pool->chunks[res_chunk_of(index)], memory_order_acquire);
+}
+
+/** Returns the tag of the result object. The chunk has to exist.
+ * \param pool The pool.
+ * \param index The index of the result object. */
+static inline RES_ATOMIC(uint32_t) *res_tag_of(res_pool_t *pool, size_t index) {
+	size_t k = res_chunk_of(index);
+	return (RES_ATOMIC(uint32_t) *)(void *)res_get_chunk(pool, index) + (index - res_chunk_start(k));
+}
+
+/** Creates a tag from a generation and a state.
+ * \param gen The generation.
+ * \param state The state. */
+static inline uint32_t res_make_tag(size_t gen, res_state_t state) {
+	return (uint32_t)((gen & RES_GEN_MASK) << RES_STATE_BITS) | (uint32_t)state;
+}
+
+/** Returns the generation of the tag.
+ * \param tag The tag. */
+static inline size_t res_tag_gen(uint32_t tag) {
+	return tag >> RES_STATE_BITS;
+}
+
+/** Returns the word of the free bitmap holding the bit of the result
+ * object. The chunk has to exist.
+ * \param pool The pool.
+ * \param index The index of the result object. */
+static inline RES_ATOMIC(uint64_t) *res_free_word_of(res_pool_t *pool, size_t index) {
+	size_t k = res_chunk_of(index);
+	return (RES_ATOMIC(uint64_t) *)(void *)(res_get_chunk(pool, index) + res_chunk_bitmap_offset(k)) +
+		(index - res_chunk_start(k)) / RES_WORD_BITS;
+}
+
+/** Returns the bit of the result object in its word of the free bitmap.
+ * \param index The index of the result object. */
+static inline uint64_t res_free_bit(size_t index) {
+	return (uint64_t)1 << ((index - res_chunk_start(res_chunk_of(index))) % RES_WORD_BITS);
+}
+
+/** Returns the index of the first result object of the word of the free
+ * bitmap holding the index.
+ * \param index The index of the result object. */
+static inline size_t res_word_start(size_t index) {
+	return index - (index - res_chunk_start(res_chunk_of(index))) % RES_WORD_BITS;
+}
+
+/** Returns the index of the first result object of the next word of the
+ * free bitmap. The words of the two smallest chunks are only half used.
+ * \param index The index of the result object. */
+static inline size_t res_next_word(size_t index) {
+	size_t k = res_chunk_of(index);
+	size_t next = res_word_start(index) + RES_WORD_BITS;
+	size_t end = res_chunk_start(k) + res_chunk_slots(k);
+	return next < end ? next : end;
+}
+
+#ifdef RES_TRACK
+/** Returns the creation site of the result object. The chunk has to exist.
+ * \param pool The pool.
+ * \param index The index of the result object. */
+static inline res_site_ref_t *res_site_of(res_pool_t *pool, size_t index) {
+	size_t k = res_chunk_of(index);
+	return (res_site_ref_t *)(void *)(res_get_chunk(pool, index) + res_chunk_sites_offset(k)) +
+		(index - res_chunk_start(k));
+}
+#endif
+
+/** Returns the owner of the ids created by the calling thread, always 0
+ * without RES_THREAD_LOCAL. */
+static inline size_t res_owner(void) {
+#ifdef RES_THREAD_LOCAL
+	return g_res_owner;
+#else
+	return 0;
+#endif
+}
+
+/** Creates an id of the calling thread from a pool, an index and a generation.
+ * \param p The pool. Outside of any region, this is the size class.
+ * \param index The index of the result object in the pool.
+ * \param gen The generation of the result object.
+ * \return The id. */
+static inline size_t res_make_id(size_t p, size_t index, size_t gen) {
+	return (res_owner() << RES_OWNER_SHIFT) | ((gen & RES_GEN_MASK) << RES_GEN_SHIFT) |
+		(p << RES_INDEX_BITS) | index;
+}
+
+/** Returns the pool part of the id.
+ * \param id The id of the result object. */
+static inline size_t res_id_pool(size_t id) {
+	return (id >> RES_INDEX_BITS) & ((1LU << RES_CLASS_BITS) - 1);
+}
+
+/** Returns the size class of the id.
+ * \param id The id of the result object. */
+static inline size_t res_id_class(size_t id) {
+	return res_id_pool(id) % RES_CLASS_COUNT;
+}
+
+/** Returns the region slot of the id, 0 if it is outside of any region.
+ * \param id The id of the result object. */
+static inline size_t res_id_region(size_t id) {
+	return res_id_pool(id) / RES_CLASS_COUNT;
+}
+
+/** Returns the index part of the id.
+ * \param id The id of the result object. */
+static inline size_t res_id_index(size_t id) {
+	return id & RES_INDEX_MASK;
+}
+
+/** Returns the generation part of the id.
+ * \param id The id of the result object. */
+static inline size_t res_id_gen(size_t id) {
+	return (id >> RES_GEN_SHIFT) & RES_GEN_MASK;
+}
+
+/** Returns the owner part of the id.
+ * \param id The id of the result object. */
+static inline size_t res_id_owner(size_t id) {
+	return id >> RES_OWNER_SHIFT;
+}
+
+/** Returns the generation of a result object allocated in a region slot.
+ * \param region The region slot.
+ * \param gen The generation the slot of the result object is at.
+ * \return The generation with the current epoch of the region. */
+static inline size_t res_region_gen(size_t region, size_t gen) {
+	size_t epoch = RES_LOAD(&g_res_region_epochs[region], memory_order_relaxed);
+	return ((epoch << RES_SLOT_GEN_BITS) & RES_GEN_MASK) | (gen & RES_SLOT_GEN_MASK);
+}
+
+/** Checks that the region of the id hasn't ended since the id was created.
+ * Always true outside of any region.
+ * \param id The id of the result object. */
+static inline int res_is_region_alive(size_t id) {
+	size_t region = res_id_region(id);
+	return !region || res_region_gen(region, res_id_gen(id)) == res_id_gen(id);
+}
+
+/** Returns the generation of the next use of the slot of the id. The slot
+ * part of the generation of a region result object wraps without carrying
+ * into the epoch.
+ * \param id The id of the result object. */
+static inline size_t res_next_gen(size_t id) {
+	size_t gen = res_id_gen(id);
+	if (!res_id_region(id)) return gen + 1;
+	return (gen & ~RES_SLOT_GEN_MASK) | ((gen + 1) & RES_SLOT_GEN_MASK);
+}
+
+/** Returns the pool of the result object.
+ * \param id The id of the result object.
+ * \return The pool or NULL if the id is out of range, belongs to another
+ * thread or its region ended. */
+static inline res_pool_t *res_get_pool(size_t id) {
+	size_t p = res_id_pool(id);
+	if (p >= RES_POOL_COUNT || res_id_owner(id) != res_owner() || !res_is_region_alive(id))
+		return NULL;
+	res_pool_t *pool = &g_res_pools[p];
+	size_t index = res_id_index(id);
+	if (index >= RES_LOAD(&pool->count, memory_order_acquire) || !res_get_chunk(pool, index))
+		return NULL;
+	return pool;
+}
+
+/** Returns the data of the result object. The id has to be in range.
+ * \param id The id of the result object.
+ * \return Pointer to the OK value or the error struct. */
+static inline unsigned char *res_get_data(size_t id) {
+	size_t c = res_id_class(id);
+	size_t index = res_id_index(id);
+	size_t k = res_chunk_of(index);
+	return res_get_chunk(&g_res_pools[res_id_pool(id)], index) + res_chunk_data_offset(k) +
+		(index - res_chunk_start(k)) * RES_CLASS_SIZE(c);
+}
+
+/** Checks that the result object hasn't been deleted since its state was
+ * read. Data copied out of a result object between get_state and a
+ * successful check belongs to the id.
+ * \param id The id of the result object.
+ * \param state The state read before the copy. */
+static inline int res_is_unchanged(size_t id, res_state_t state) {
+	atomic_thread_fence(memory_order_acquire);
+	return RES_LOAD(res_tag_of(&g_res_pools[res_id_pool(id)], res_id_index(id)), memory_order_relaxed) ==
+		res_make_tag(res_id_gen(id), state);
+}
+
+/** Marks result objects of one word of the free bitmap as free with a
+ * single atomic operation.
+ * \param pool The pool.
+ * \param index The index of one of the result objects.
+ * \param mask The bits of the result objects in the word.
+ * \param n The number of bits set in mask. */
+static inline void res_free_bits(res_pool_t *pool, size_t index, uint64_t mask, size_t n) {
+	RES_FETCH_OR(res_free_word_of(pool, index), mask, memory_order_release);
+	RES_STORE(&pool->free_hint, index, memory_order_relaxed);
+	RES_ADD(&pool->free_count, n, memory_order_relaxed);
+}
+
+/** Marks a result object as free to be reused.
+ * \param pool The pool.
+ * \param index The index of the result object. */
+static inline void res_free_index(res_pool_t *pool, size_t index) {
+	res_free_bits(pool, index, res_free_bit(index), 1);
+}
+
+/** Publishes the state of a freshly allocated result object. If RES_TRACK
+ * is defined, the creation site is recorded as well.
+ * \param id The id of the result object.
+ * \param state The new state.
+ * \param err_info The creation site. */
+static inline void res_publish(size_t id, res_state_t state, const res_err_info_t *err_info) {
+#ifdef RES_TRACK
+	*res_site_of(&g_res_pools[res_id_pool(id)], res_id_index(id)) = (res_site_ref_t){err_info, NULL};
+#else
+	(void)err_info;
+#endif
+	RES_STORE(
+		res_tag_of(&g_res_pools[res_id_pool(id)], res_id_index(id)),
+		res_make_tag(res_id_gen(id), state), memory_order_release);
+}
+
+/** Checks the alignment and the size of an OK value.
+ * \param alignment The alignment of the data to be stored.
+ * \param size The size of the data to be stored.
+ * \return 1 if they are valid, 0 otherwise. */
+static inline int res_is_valid_value(size_t alignment, size_t size) {
+	return alignment && size && !(alignment & (alignment - 1)) &&
+		alignment <= alignof(max_align_t);
+}
+
+/** Moves the result object out of RES_STATE_OK or RES_STATE_ERR into
+ * RES_STATE_INVALID and bumps its generation.
+ * \param pool The pool of the result object.
+ * \param id The id of the result object.
+ * \return 1 if the calling thread invalidated it, 0 if it was already invalid. */
+static inline int res_invalidate(res_pool_t *pool, size_t id) {
+	RES_ATOMIC(uint32_t) *tag_ptr = res_tag_of(pool, res_id_index(id));
+	uint32_t tag = RES_LOAD(tag_ptr, memory_order_relaxed);
+	do {
+		if (res_tag_gen(tag) != res_id_gen(id) || (tag & RES_STATE_MASK) == RES_STATE_INVALID)
+			return 0;
+	} while (!RES_CAS(
+		tag_ptr, &tag, res_make_tag(res_next_gen(id), RES_STATE_INVALID),
+		memory_order_acq_rel, memory_order_relaxed));
+	return 1;
+}
+
+/** Claims up to n free result objects of the pool. The free bitmap is
+ * searched a word at a time, starting at the word of the last freed result
+ * object, and every word is claimed with a single atomic operation. A bit
+ * cleared by another thread in the meantime is simply not claimed.
+ * \param pool The pool.
+ * \param n The maximum number of result objects to claim.
+ * \param indices Set to the indices of the claimed result objects.
+ * \return The number of result objects claimed. */
+static inline size_t res_claim_free_ids(res_pool_t *pool, size_t n, size_t *indices) {
+	if (!n || !RES_LOAD(&pool->free_count, memory_order_relaxed)) return 0;
+	size_t count = RES_LOAD(&pool->count, memory_order_acquire);
+	if (!count) return 0;
+	size_t start = RES_LOAD(&pool->free_hint, memory_order_relaxed);
+	start = res_word_start(start < count ? start : 0);
+	size_t index = start;
+	size_t taken = 0;
+	do {
+		if (!res_get_chunk(pool, index)) {
+			index = res_next_word(index);
+			if (index >= count) index = 0;
+			continue;
+		}
+		RES_ATOMIC(uint64_t) *word = res_free_word_of(pool, index);
+		uint64_t bits = RES_LOAD(word, memory_order_relaxed);
+		while (bits && taken < n) {
+			uint64_t want = bits;
+			if (n - taken < RES_WORD_BITS) {
+				want = 0;
+				for (size_t i = taken; i < n && (bits & ~want); i++)
+					want |= (bits & ~want) & -(bits & ~want);
+			}
+			uint64_t old = RES_FETCH_AND(word, ~want, memory_order_acquire);
+			for (uint64_t got = old & want; got; got &= got - 1)
+				indices[taken++] = index + (size_t)__builtin_ctzl(got);
+			bits = old & ~want;
+		}
+		if (taken == n) break;
+		index = res_next_word(index);
+		if (index >= count) index = 0;
+	} while (index != start);
+	if (!taken) return 0;
+	RES_STORE(&pool->free_hint, index, memory_order_relaxed);
+	RES_SUB(&pool->free_count, taken, memory_order_relaxed);
+	return taken;
+}
+
+/** Claims a free result object of the pool. The word of the last freed
+ * result object is tried first, only then is the bitmap searched.
+ * \param pool The pool.
+ * \return The index or g_res_fallback_id if none is free. */
+static inline size_t res_claim_free_id(res_pool_t *pool) {
+	size_t index = RES_LOAD(&pool->free_hint, memory_order_relaxed);
+	if (
+		RES_LOAD(&pool->free_count, memory_order_relaxed) &&
+		index < RES_LOAD(&pool->count, memory_order_acquire) &&
+		res_get_chunk(pool, index)
+	) {
+		RES_ATOMIC(uint64_t) *word = res_free_word_of(pool, index);
+		uint64_t bits = RES_LOAD(word, memory_order_relaxed);
+		while (bits) {
+			uint64_t bit = bits & -bits;
+			uint64_t old = RES_FETCH_AND(word, ~bit, memory_order_acquire);
+			if (old & bit) {
+				RES_SUB(&pool->free_count, 1, memory_order_relaxed);
+				return res_word_start(index) + (size_t)__builtin_ctzl(bit);
+			}
+			bits = old & ~bit;
+		}
+	}
+	return res_claim_free_ids(pool, 1, &index) ? index : g_res_fallback_id;
+}
+
+/** Returns the id of a result object just claimed in a pool of the
+ * innermost region of the calling thread.
+ * \param p The pool.
+ * \param index The index of the result object in the pool.
+ * \return The id with the current generation of the result object. */
+static inline size_t res_new_id(size_t p, size_t index) {
+	size_t gen = res_tag_gen(RES_LOAD(res_tag_of(&g_res_pools[p], index), memory_order_relaxed));
+	return res_make_id(p, index, g_res_region ? res_region_gen(g_res_region, gen) : gen);
+}
+
+#ifdef RES_FAST_PATH
+/** Reference to the configuration symbol of the library, kept in every
+ * object file using the fast path. */
+__attribute__((used)) static const int *const g_res_config_check = &RES_CONFIG;
+
+/** Inline fast path of res_generic_ok used by the typed wrappers. Only a
+ * free result object found at the free hint of the pool is taken, growing
+ * the pool and reporting failures are left to res_generic_ok.
+ * \param value Pointer to the OK value.
+ * \param alignment The alignment of the data to be stored.
+ * \param size The size of the data to be stored.
+ * \param id Set to the id of the result object on success.
+ * \param err_info The creation site.
+ * \return 0 on success, 1 if res_generic_ok has to be called instead. */
+__attribute__((always_inline))
+static inline int res_fast_ok(
+	const void *value, size_t alignment, size_t size, size_t *id, const res_err_info_t *err_info
+) {
+#ifdef RES_THREAD_LOCAL
+	if (!g_res_thread_registered) return 1;
+#endif
+	size_t c = res_size_class(size);
+	if (!res_is_valid_value(alignment, size) || c == RES_CLASS_COUNT) return 1;
+	size_t p = g_res_region * RES_CLASS_COUNT + c;
+	size_t index = res_claim_free_id(&g_res_pools[p]);
+	if (index == g_res_fallback_id) return 1;
+	*id = res_new_id(p, index);
+	memcpy(res_get_data(*id), value, size);
+	res_publish(*id, RES_STATE_OK, err_info);
+	return 0;
+}
+
+/** Inline fast path of res_generic_lazy_ok. If RES_TRACK is defined, the
+ * caller is recorded by res_generic_lazy_ok only, so it is always called.
+ * \param value Pointer to the OK value.
+ * \param alignment The alignment of the data to be stored.
+ * \param size The size of the data to be stored.
+ * \param id Set to the id of the result object on success.
+ * \return 0 on success, 1 if res_generic_lazy_ok has to be called instead. */
+__attribute__((always_inline))
+static inline int res_fast_lazy_ok(const void *value, size_t alignment, size_t size, size_t *id) {
+#ifdef RES_TRACK
+	(void)value, (void)alignment, (void)size, (void)id;
+	return 1;
+#else
+	return res_fast_ok(value, alignment, size, id, NULL);
+#endif
+}
+
+/** Inline fast path of res_generic_get_ok for OK result objects. The value
+ * is copied into a temporary first and only copied out once the copy is
+ * validated, so a value that changed meanwhile never reaches the caller.
+ * \param id The id of the result object.
+ * \param value A pointer to the variable to copy the OK value into. Can take NULL.
+ * \param size The size of the OK value.
+ * \return 0 if the result is OK, 1 if res_generic_get_ok has to be called instead. */
+__attribute__((always_inline))
+static inline int res_fast_get_ok(size_t id, void *value, size_t size) {
+	res_pool_t *pool = res_get_pool(id);
+	if (!pool || !size || size > RES_CLASS_SIZE(res_id_class(id))) return 1;
+	if (RES_LOAD(res_tag_of(pool, res_id_index(id)), memory_order_acquire) !=
+		res_make_tag(res_id_gen(id), RES_STATE_OK)) return 1;
+	// A constant size for the typed wrappers, so this is a plain array there
+	unsigned char copy[size];
+	if (value) memcpy(copy, res_get_data(id), size);
+	if (!res_is_unchanged(id, RES_STATE_OK)) return 1;
+	if (value) memcpy(value, copy, size);
+	return 0;
+}
+
+/** Inline fast path of res_generic_unwrap for OK result objects.
+ * \param id The id of the result object.
+ * \param value A pointer to the variable to copy the OK value into. Can take NULL.
+ * \param size The size of the OK value.
+ * \return 0 if the result was OK and is deleted, 1 if res_generic_unwrap
+ * has to be called instead. */
+__attribute__((always_inline))
+static inline int res_fast_unwrap(size_t id, void *value, size_t size) {
+	res_pool_t *pool = res_get_pool(id);
+	if (!pool || !size || size > RES_CLASS_SIZE(res_id_class(id))) return 1;
+	RES_ATOMIC(uint32_t) *tag_ptr = res_tag_of(pool, res_id_index(id));
+	uint32_t tag = res_make_tag(res_id_gen(id), RES_STATE_OK);
+	if (RES_LOAD(tag_ptr, memory_order_acquire) != tag) return 1;
+	unsigned char copy[size];
+	if (value) memcpy(copy, res_get_data(id), size);
+	if (!RES_CAS(
+		tag_ptr, &tag, res_make_tag(res_next_gen(id), RES_STATE_INVALID),
+		memory_order_acq_rel, memory_order_relaxed)
+	) return 1;
+	res_free_index(pool, res_id_index(id));
+	if (value) memcpy(value, copy, size);
+	return 0;
+}
+
+/** Inline fast path of res_generic_del.
+ * \param id The id of the result object.
+ * \return 0 if the result object is deleted, 1 if res_generic_del has to
+ * be called instead. */
+__attribute__((always_inline))
+static inline int res_fast_del(size_t id) {
+	res_pool_t *pool = res_get_pool(id);
+	if (!pool || !res_invalidate(pool, id)) return 1;
+	res_free_index(pool, res_id_index(id));
+	return 0;
+}
+#endif
+
+#endif
@@ -25,32 +25,343 @@ SOFTWARE.
  * necessary for using and testing the result library.
  * */
 
-#include "result_utils.h"
+#define _GNU_SOURCE
+#include "result_decode.h"
+#include <dlfcn.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <fcntl.h>
 
 /** Flag for testing public macros that call exit() */
 int g_is_exit_called;
 /** Flag for testing public macros that return from the caller */
 int g_is_return_called;
-/** Buffer to store the generic result structs in. */
-res_t g_res_buff[RES_BUFF_SIZE];
-/** The number of currently active result objects. */
-size_t g_res_count;
-/** Buffer to store the id-s of result objects ready to be reused. */
-size_t g_free_buff[FREE_BUFF_SIZE];
-/** The number of currently active result objects ready to be reused. */
-size_t g_free_count;
-/** Fallback result object to be used when g_res_buff is full and g_free_count is 0. */
-res_t g_res_fallback = {.state = RES_STATE_INVALID};
+/** The pools of each size class, outside of any region first. */
+RES_TLS res_pool_t g_res_pools[RES_POOL_COUNT];
+/** The epoch of each region slot, incremented every time the region ends. */
+RES_TLS RES_ATOMIC(size_t) g_res_region_epochs[RES_REGION_COUNT];
+/** Mask of the region slots in use. It changes whenever a region begins or
+ * ends, so it is kept off the line of the epochs that region ids are
+ * checked against. */
+alignas(RES_CACHE_LINE) RES_TLS RES_ATOMIC(size_t) g_res_regions_used;
+/** The innermost region slot of the calling thread, 0 if it is outside of
+ * any region. */
+_Thread_local size_t g_res_region;
+/** The configuration of the pools. */
+res_config_t g_res_config = {
+	.initial_capacity = RES_BUFF_SIZE,
+	.max_capacity = RES_MAX_CAPACITY,
+	.alloc = mmap_alloc,
+	.free = mmap_free,
+	.sink = writev_sink,
+	.report_burst = RES_REPORT_BURST,
+	.report_window = RES_REPORT_WINDOW
+};
+/** Set once a chunk is allocated on demand, after which the configuration
+ * can no longer be changed. */
+_Atomic int g_res_config_locked;
+/** Fallback result object of the calling thread. Holds the error of the
+ * last failed call on the thread until it is deleted. */
+_Thread_local res_t g_res_fallback = {.state = RES_STATE_INVALID};
 /** The id for the fallback result object. */
-const size_t g_fallback_id = (size_t)-1;
-/** Mutex object. */
+const size_t g_res_fallback_id = (size_t)-1;
+/** Mutex object. Guards g_res_modules and, if RES_THREAD_LOCAL is defined,
+ * the shared pool and g_res_owners. */
 pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+#ifdef RES_THREAD_LOCAL
+/** The chunks of the shared pool, which holds the result structs handed
+ * over between threads. */
+res_t *g_shared_chunks[RES_MAX_CHUNKS];
+/** The number of structs of the shared pool ever used. */
+size_t g_shared_count;
+/** The first free struct of the shared pool or g_res_fallback_id if there
+ * is none. */
+size_t g_shared_free = (size_t)-1;
+/** The owners taken by the threads alive, one bit each. */
+uint64_t g_res_owners[RES_OWNER_COUNT / 64];
+/** The owner of the ids created by the calling thread. */
+_Thread_local size_t g_res_owner;
+/** The owner taken last. */
+static size_t g_owner_last;
+#endif
+/** The interned sites of propagation frames. */
+res_site_t g_res_sites[RES_SITE_COUNT];
+/** The modules whose site descriptors are registered. */
+res_module_t g_res_modules[RES_MODULE_COUNT];
+/** The number of registered modules. */
+size_t g_res_module_count;
+#ifndef RES_NO_STATS
+/** Counters of the runtime statistics. */
+res_counters_t g_res_counters;
+#endif
+/** The id of the result object taken last by the calling thread. */
+_Thread_local size_t g_res_taken = (size_t)-1;
+/** Whether the calling thread is registered for the cleanup. */
+_Thread_local int g_res_thread_registered;
+/** The configuration of the library, checked when linking the fast path. */
+const int RES_CONFIG = 1;
+/** The queue of the reports waiting for the background writer thread. */
+res_queue_t g_res_queue;
+/** The rate limiters of the reports of each site. */
+res_limit_t g_res_limits[RES_SITE_COUNT];
+/** The rate limiters of the reports of failed calls made without error
+ * information. */
+res_limit_t g_res_caller_limits[RES_CALLER_COUNT];
+/** Set when a site has suppressed errors that are not summarized yet. */
+_Atomic int g_res_limit_pending;
+/** The binary log errors are printed into, its header is NULL if closed. */
+res_log_t g_res_log;
+/** The messages interned into the binary log, indexed by the message id. */
+_Atomic(const char *) g_res_log_msgs[RES_LOG_MSG_COUNT];
 #ifdef TEST
 /** Flag for testing functions that print fallback error. */
 int g_is_fallback_error_printed = 0;
 /** Flag for testing functions that print normal error. */
 int g_is_error_printed = 0;
+/** Called after a result object is copied and before the copy is validated. */
+void (*g_res_copied_hook)(size_t id);
+#endif
+
+#ifdef RES_THREAD_LOCAL
+/** Checks if the id refers to the shared pool.
+ * \param id The id of the result object. */
+static inline int is_shared_id(size_t id) {
+	return id < RES_INLINE_ID && (id & RES_SHARED_BIT);
+}
+
+/** Returns a struct of the shared pool. g_mutex has to be locked.
+ * \param index The index of the struct.
+ * \return The struct or NULL if the index was never used. */
+static inline res_t *shared_res(size_t index) {
+	if (index >= g_shared_count) return NULL;
+	size_t k = res_chunk_of(index);
+	return &g_shared_chunks[k][index - res_chunk_start(k)];
+}
+
+/** Claims a free struct of the shared pool, growing the pool by a chunk
+ * if needed. g_mutex has to be locked.
+ * \return The index of the struct or g_res_fallback_id if the pool holds
+ * max_capacity structs or the allocation failed. */
+static inline size_t shared_claim() {
+	size_t index = g_shared_free;
+	if (index != g_res_fallback_id) {
+		memcpy(&g_shared_free, shared_res(index)->ok, sizeof(size_t));
+		return index;
+	}
+	index = g_shared_count;
+	if (index >= g_res_config.max_capacity) return g_res_fallback_id;
+	size_t k = res_chunk_of(index);
+	if (!g_shared_chunks[k]) {
+		if (!g_res_config_locked) g_res_config_locked = 1;
+		g_shared_chunks[k] = g_res_config.alloc(res_chunk_slots(k) * sizeof(res_t));
+		if (!g_shared_chunks[k]) return g_res_fallback_id;
+	}
+	g_shared_count++;
+	return index;
+}
+
+/** Copies a result object out of the shared pool.
+ * \param id The id of the result object in the shared pool.
+ * \param res The struct to copy the result object into.
+ * \param del Whether to delete the result object from the shared pool.
+ * \return The state of the result object. */
+static res_state_t shared_copy(size_t id, res_t *res, int del) {
+	res_state_t state = RES_STATE_INVALID;
+	id &= ~RES_SHARED_BIT;
+	lock_mutex();
+	res_t *shared = shared_res(id);
+	if (shared) state = shared->state;
+	if (state != RES_STATE_INVALID) {
+		if (res) *res = *shared;
+		if (del) {
+			shared->state = RES_STATE_INVALID;
+			memcpy(shared->ok, &g_shared_free, sizeof(size_t));
+			g_shared_free = id;
+		}
+	}
+	pthread_mutex_unlock(&g_mutex);
+	return state;
+}
+
+/** Takes a free owner for the calling thread, searching from the one after
+ * the owner taken last, so a released owner is reused as late as possible.
+ * The threads beyond the first RES_OWNER_COUNT - 1 alive at once share
+ * owner 0. */
+static void take_owner() {
+	lock_mutex();
+	g_res_owner = 0;
+	for (size_t i = 1; i < RES_OWNER_COUNT; i++) {
+		size_t owner = (g_owner_last + i) % RES_OWNER_COUNT;
+		if (!owner || g_res_owners[owner / 64] & (1LU << owner % 64)) continue;
+		g_res_owners[owner / 64] |= 1LU << owner % 64;
+		g_res_owner = g_owner_last = owner;
+		break;
+	}
+	pthread_mutex_unlock(&g_mutex);
+}
+
+/** Releases the owner of the calling thread. */
+static void release_owner() {
+	lock_mutex();
+	g_res_owners[g_res_owner / 64] &= ~(1LU << g_res_owner % 64);
+	pthread_mutex_unlock(&g_mutex);
+}
+#endif
+
+/** Key whose destructor cleans up after an exiting thread. */
+static pthread_key_t g_thread_key;
+/** Guards the creation of g_thread_key. */
+static pthread_once_t g_thread_once = PTHREAD_ONCE_INIT;
+
+/** Releases the result object taken last by the calling thread.
+ * Its id is already invalid, only its memory is returned to the pool.
+ * If its region ended meanwhile, the memory went back with the region. */
+static inline void release_taken() {
+	if (g_res_taken == g_res_fallback_id) return;
+	if (res_is_region_alive(g_res_taken))
+		res_free_index(&g_res_pools[res_id_pool(g_res_taken)], res_id_index(g_res_taken));
+	g_res_taken = g_res_fallback_id;
+}
+
+/** Releases the result object taken last by an exiting thread and, if
+ * RES_THREAD_LOCAL is defined, frees its pools.
+ * \param arg Unused. */
+static void thread_destructor(void *arg) {
+	(void)arg;
+	release_taken();
+#ifdef RES_THREAD_LOCAL
+	free_pools();
+	release_owner();
+#endif
+}
+
+/** Creates g_thread_key. */
+static void create_thread_key() {
+	pthread_key_create(&g_thread_key, thread_destructor);
+}
+
+/** Registers the calling thread for the cleanup when it exits. */
+static inline void register_thread() {
+	if (g_res_thread_registered) return;
+	pthread_once(&g_thread_once, create_thread_key);
+	pthread_setspecific(g_thread_key, &g_res_thread_registered);
+#ifdef RES_THREAD_LOCAL
+	take_owner();
+#endif
+	g_res_thread_registered = 1;
+}
+
+/** Configures the result pools. Must be called before any result object
+ * is created. The chunks preallocated with the previous configuration are
+ * freed and the initial capacity is preallocated with the new one.
+ * \param config The configuration. Can take NULL to restore the defaults.
+ * \return 0 on success, 1 if the configuration is invalid, 2 if result objects
+ * have already been created, 3 if the initial capacity couldn't be allocated. */
+int res_init(const res_config_t *config) {
+	res_config_t new_config = config ? *config : (res_config_t){0};
+	if (!new_config.initial_capacity) new_config.initial_capacity = RES_BUFF_SIZE;
+	if (!new_config.max_capacity) new_config.max_capacity = RES_MAX_CAPACITY;
+	if (!new_config.alloc != !new_config.free) return 1;
+	if (!new_config.alloc) {
+		new_config.alloc = mmap_alloc;
+		new_config.free = mmap_free;
+	}
+	if (!new_config.sink) new_config.sink = writev_sink;
+	if (!new_config.report_burst) new_config.report_burst = RES_REPORT_BURST;
+	if (!new_config.report_window) new_config.report_window = RES_REPORT_WINDOW;
+	if (
+		new_config.initial_capacity > new_config.max_capacity ||
+		new_config.max_capacity > RES_INDEX_MASK + 1
+	) return 1;
+	if (g_res_config_locked) return 2;
+	for (size_t p = 0; p < RES_POOL_COUNT; p++)
+		if (RES_LOAD(&g_res_pools[p].count, memory_order_relaxed)) return 2;
+	free_pools();
+	g_res_config = new_config;
+	if (reserve_pools()) {
+		free_pools();
+		return 3;
+	}
+	return 0;
+}
+
+/** Allocates a result object in the pool of the size class in the
+ * innermost region of the calling thread. The id carries the current
+ * generation of the result object.
+ * \param c The size class.
+ * \return The id of the result object or g_res_fallback_id if the pool is full. */
+static inline size_t alloc_id(size_t c) {
+#ifdef RES_THREAD_LOCAL
+	register_thread();
+#endif
+	size_t p = g_res_region * RES_CLASS_COUNT + c;
+	res_pool_t *pool = &g_res_pools[p];
+	size_t index = set_id(pool);
+	return index == g_res_fallback_id ? g_res_fallback_id : res_new_id(p, index);
+}
+
+/** Allocates up to count result objects like alloc_id, with a single
+ * synchronization step on the pool.
+ * \param c The size class.
+ * \param count The number of result objects to allocate.
+ * \param ids Set to the ids of the result objects.
+ * \return The number of result objects allocated. */
+static inline size_t alloc_ids(size_t c, size_t count, size_t *ids) {
+#ifdef RES_THREAD_LOCAL
+	register_thread();
 #endif
+	size_t p = g_res_region * RES_CLASS_COUNT + c;
+	res_pool_t *pool = &g_res_pools[p];
+	size_t n = set_ids(pool, count, ids);
+	for (size_t i = 0; i < n; i++) ids[i] = res_new_id(p, ids[i]);
+	return n;
+}
+
+/** Allocates a result object for an OK value.
+ * \param alignment The alignment of the data to be stored. It must be a power of 2.
+ * \param size The size of the data to be stored.
+ * \param err_info The error information to be used on failure.
+ * \return The id of the result object or g_res_fallback_id on failure. */
+static inline size_t alloc_value(size_t alignment, size_t size, const res_err_info_t *err_info) {
+	err_t err = {.err_info = err_info};
+	if (!res_is_valid_value(alignment, size)) {
+		set_fallback(err, "Invalid argument");
+		return g_res_fallback_id;
+	}
+	size_t c = res_size_class(size);
+	size_t id = c < RES_CLASS_COUNT ? alloc_id(c) : g_res_fallback_id;
+	if (id == g_res_fallback_id) set_fallback(err, "Not enough memory");
+	return id;
+}
+
+/** Resolves the return address of a call made without error information
+ * into a site. Only the module and the nearest symbol are known, so the
+ * line is 0. Called only when an error or a leak is printed.
+ * \param caller The return address.
+ * \param func The buffer to format the function into.
+ * \return The site. The strings live as long as the module and func. */
+__attribute__((unused))
+static res_err_info_t resolve_caller(const void *caller, char func[RES_SYMBOL_SIZE]) {
+	Dl_info info = {0};
+	if (!caller || !dladdr(caller, &info)) info.dli_fname = "<unknown>";
+	if (info.dli_sname) {
+		snprintf(func, RES_SYMBOL_SIZE, "%s+0x%tx", info.dli_sname,
+			(const char *)caller - (const char *)info.dli_saddr);
+	} else {
+		snprintf(func, RES_SYMBOL_SIZE, "%p", caller);
+	}
+	return (res_err_info_t){info.dli_fname, func, 0};
+}
+
+/** Records the caller of a failed call made without error information in
+ * the fallback, unless the fallback still holds the error of an earlier call.
+ * \param caller The return address of the call. */
+static inline void set_fallback_caller(const void *caller) {
+	if (
+		g_res_fallback.state == RES_STATE_ERR &&
+		!g_res_fallback.err.err_info && !g_res_fallback.err.caller
+	) g_res_fallback.err.caller = caller;
+}
 
 /** Creates a new result object with OK state.
  * \param value Pointer to the OK value. Can take NULL if the result is of type void.
@@ -58,30 +369,108 @@ int g_is_error_printed = 0;
  * \param size The size of the data to be stored.
  * \param err_info The error information to be used on failure. 
  * \return A unique id to initialize a new instance of a result struct with. */
-size_t res_generic_ok(const void *value, size_t alignment, size_t size, res_err_info_t err_info) {
+size_t res_generic_ok(const void *value, size_t alignment, size_t size, const res_err_info_t *err_info) {
+	size_t id = alloc_value(alignment, size, err_info);
+	if (id == g_res_fallback_id) return g_res_fallback_id;
+	if (value) memcpy(res_get_data(id), value, size);
+	res_publish(id, RES_STATE_OK, err_info);
+	return id;
+}
+
+/** Creates count result objects with OK state, taking their indices from
+ * the pool with a single synchronization step instead of one per result.
+ * \param values Array of count OK values of size bytes each. Can take NULL.
+ * \param alignment The alignment of the data to be stored. It must be a power of 2.
+ * \param size The size of each OK value.
+ * \param count The number of result objects to create.
+ * \param ids Set to the ids of the result objects. The ids of the result
+ * objects that couldn't be created are set to g_res_fallback_id.
+ * \param err_info The error information to be used on failure.
+ * \return The number of result objects created. */
+size_t res_generic_ok_n(
+	const void *values, size_t alignment, size_t size, size_t count, size_t *ids,
+	const res_err_info_t *err_info
+) {
 	err_t err = {.err_info = err_info};
-	pthread_mutex_lock(&g_mutex);
-	if (
-		!alignment || !size || (alignment & (alignment - 1)) ||
-		alignment > alignof(max_align_t)
+	if (!count) return 0;
+	if (!res_is_valid_value(alignment, size) || !ids) {
+		if (ids) for (size_t i = 0; i < count; i++) ids[i] = g_res_fallback_id;
+		set_fallback(err, "Invalid argument");
+		return 0;
+	}
+	size_t c = res_size_class(size);
+	size_t n = c < RES_CLASS_COUNT ? alloc_ids(c, count, ids) : 0;
+	for (size_t i = 0; i < n; i++) {
+		if (values) memcpy(res_get_data(ids[i]), (const unsigned char *)values + i * size, size);
+		res_publish(ids[i], RES_STATE_OK, err_info);
+	}
+	for (size_t i = n; i < count; i++) ids[i] = g_res_fallback_id;
+	if (n < count) set_fallback(err, "Not enough memory");
+	return n;
+}
+
+/** Allocates a result object for an OK value to be constructed in place
+ * and publishes it in RES_STATE_RESERVED.
+ * \param alignment The alignment of the data to be stored. It must be a power of 2.
+ * \param size The size of the data to be stored.
+ * \param id Set to the id of the result object or g_res_fallback_id on failure.
+ * \param err_info The error information to be used on failure.
+ * \return Pointer to the uninitialized data or NULL on failure. */
+void *res_generic_reserve(size_t alignment, size_t size, size_t *id, const res_err_info_t *err_info) {
+	*id = alloc_value(alignment, size, err_info);
+	if (*id == g_res_fallback_id) return NULL;
+	res_publish(*id, RES_STATE_RESERVED, err_info);
+	return res_get_data(*id);
+}
+
+/** Commits a reserved result object as OK.
+ * \param id The id of the reserved result object.
+ * \param err_info The error information to be used on failure.
+ * \return The id or g_res_fallback_id on failure. The fallback id is
+ * returned as is, so a failed reservation can be committed unchecked. */
+size_t res_generic_commit(size_t id, const res_err_info_t *err_info) {
+	err_t err = {.err_info = err_info};
+	if (is_fallback_set(id)) return id;
+	res_pool_t *pool = res_get_pool(id);
+	uint32_t tag = res_make_tag(res_id_gen(id), RES_STATE_RESERVED);
+	if (!pool || !RES_CAS(
+		res_tag_of(pool, res_id_index(id)), &tag, res_make_tag(res_id_gen(id), RES_STATE_OK),
+		memory_order_release, memory_order_relaxed)
 	) {
-		err.msg = "Invalid argument";
-		g_res_fallback.err = err;
-		g_res_fallback.state = RES_STATE_ERR;
-		pthread_mutex_unlock(&g_mutex);
-		return g_fallback_id;
+		set_fallback(err, "Invalid argument");
+		return g_res_fallback_id;
 	}
-	if (size > OK_BUFF_SIZE || (g_res_count + 1 > RES_BUFF_SIZE && !g_free_count)) {
-		err.msg = "Not enough memory";
-		g_res_fallback.err = err;
-		g_res_fallback.state = RES_STATE_ERR;
-		pthread_mutex_unlock(&g_mutex);
-		return g_fallback_id;
+	return id;
+}
+
+/** Turns a reserved result object into an error result. The error is
+ * stored in place if the size class of the reservation can hold it,
+ * otherwise a new error result is created and the reservation is deleted.
+ * \param id The id of the reserved result object.
+ * \param msg The error message.
+ * \param err_info Additional error information.
+ * \return The id of the error result. The fallback id is returned as is. */
+size_t res_generic_commit_err(size_t id, const char *msg, const res_err_info_t *err_info) {
+	err_t err = {.msg = msg, .err_info = err_info};
+	if (is_fallback_set(id)) return id;
+	if (get_state(id) != RES_STATE_RESERVED) {
+		set_fallback(err, "Invalid argument");
+		return g_res_fallback_id;
 	}
-	size_t id = set_id();
-	if (value) memcpy(g_res_buff[id].ok, value, size);
-	g_res_buff[id].state = RES_STATE_OK;
-	pthread_mutex_unlock(&g_mutex);
+	if (RES_CLASS_SIZE(res_id_class(id)) < sizeof(err_t)) {
+		res_generic_del(id, err_info);
+		return res_generic_err(msg, err_info);
+	}
+	*get_err(id) = err;
+	uint32_t tag = res_make_tag(res_id_gen(id), RES_STATE_RESERVED);
+	if (!RES_CAS(
+		res_tag_of(&g_res_pools[res_id_pool(id)], res_id_index(id)), &tag,
+		res_make_tag(res_id_gen(id), RES_STATE_ERR), memory_order_release, memory_order_relaxed)
+	) {
+		set_fallback(err, "Invalid argument");
+		return g_res_fallback_id;
+	}
+	RES_STAT_INC(errors_created);
 	return id;
 }
 
@@ -89,134 +478,1029 @@ size_t res_generic_ok(const void *value, size_t alignment, size_t size, res_err_
  * \param msg The error message.
  * \param err_info Additional error information.
  * \return A unique id to initialize a new instance of a result struct with. */
-size_t res_generic_err(const char *msg, res_err_info_t err_info) {
+size_t res_generic_err(const char *msg, const res_err_info_t *err_info) {
 	err_t err = {.msg = msg, .err_info = err_info};
-	pthread_mutex_lock(&g_mutex);
-	if (g_res_count + 1 > RES_BUFF_SIZE && !g_free_count) {
-		err.msg = "Not enough memory";
-		g_res_fallback.err = err;
-		g_res_fallback.state = RES_STATE_ERR;
-		pthread_mutex_unlock(&g_mutex);
-		return g_fallback_id;
+	size_t id = alloc_id(RES_ERR_CLASS);
+	if (id == g_res_fallback_id) {
+		set_fallback(err, "Not enough memory");
+		return g_res_fallback_id;
 	}
-	size_t id = set_id();
-	g_res_buff[id].state = RES_STATE_ERR;
-	g_res_buff[id].err = err;
-	pthread_mutex_unlock(&g_mutex);
+	*get_err(id) = err;
+	res_publish(id, RES_STATE_ERR, err_info);
+	RES_STAT_INC(errors_created);
 	return id;
 }
 
+/** Checks the size of the OK value the caller expects against the room
+ * of the result object. Error result objects live in RES_ERR_CLASS whatever
+ * the type of the OK value, so only the size of OK and reserved result
+ * objects is limited.
+ * \param state The state of the result object.
+ * \param size The size of the OK value.
+ * \param room The room for the OK value in the result object.
+ * \return 1 if the size is valid, 0 otherwise. */
+static inline int is_valid_size(res_state_t state, size_t size, size_t room) {
+	return size && (state == RES_STATE_ERR || size <= room);
+}
+
 /** Checks the state of the result object. 
  * \param id The id of the result object.
  * \param value A pointer to the variable to copy the OK value into.
  * Can take NULL in case the result object is of type void. 
  * \param size The size of the OK value. 
  * \param err_info The error information to be used on failure. */
-int res_generic_get_ok(size_t id, void *value, size_t size, res_err_info_t err_info) {
+int res_generic_get_ok(size_t id, void *value, size_t size, const res_err_info_t *err_info) {
 	err_t err = {.err_info = err_info};
-	pthread_mutex_lock(&g_mutex);
-	if (id >= g_res_count || size > OK_BUFF_SIZE || !size) {
-		err.msg = "Invalid argument";
-		g_res_fallback.err = err;
-		g_res_fallback.state = RES_STATE_ERR;
-		pthread_mutex_unlock(&g_mutex);
+	if (is_fallback_set(id)) return 1;
+#ifdef RES_THREAD_LOCAL
+	if (is_shared_id(id)) {
+		res_t res;
+		res_state_t state = shared_copy(id, &res, 0);
+		if (state == RES_STATE_INVALID || !is_valid_size(state, size, OK_BUFF_SIZE)) {
+			set_fallback(err, "Invalid argument");
+			return 2;
+		}
+		if (state != RES_STATE_OK) {
+			set_fallback(err, "Result state is not RES_STATE_OK");
+			return 1;
+		}
+		if (value) memcpy(value, res.ok, size);
+		return 0;
+	}
+#endif
+	res_state_t state = get_state(id);
+	if (
+		state == RES_STATE_INVALID ||
+		!is_valid_size(state, size, RES_CLASS_SIZE(res_id_class(id)))
+	) {
+		set_fallback(err, "Invalid argument");
 		return 2;
 	}
-	if (g_res_buff[id].state != RES_STATE_OK) {
-		err.msg = "Result state is not RES_STATE_OK";
-		g_res_fallback.err = err;
-		g_res_fallback.state = RES_STATE_ERR;
-		pthread_mutex_unlock(&g_mutex);
+	if (state != RES_STATE_OK) {
+		set_fallback(err, "Result state is not RES_STATE_OK");
 		return 1;
 	}
-	if (value) memcpy(value, &g_res_buff[id].ok, size);
-	pthread_mutex_unlock(&g_mutex);
+	// Copied out only once validated, so a changed value never reaches value
+	unsigned char copy[OK_BUFF_SIZE];
+	if (value) memcpy(copy, res_get_data(id), size);
+#ifdef TEST
+	if (g_res_copied_hook) g_res_copied_hook(id);
+#endif
+	if (!res_is_unchanged(id, state)) {
+		set_fallback(err, "Invalid argument");
+		return 2;
+	}
+	if (value) memcpy(value, copy, size);
 	return 0;
 }
 
-/** Creates a new result object with ERROR state and initializes it with the 
- * error information stored in another result object.
- * \param src_id The id of the source result object.
- * \err_info The error information to be used on failure. */
-size_t res_generic_err_from(size_t src_id, res_err_info_t err_info) {
+/** Checks the states of count result objects and copies the OK values out of
+ * them. Results in a different state are reported through oks only, the
+ * fallback is set just for invalid ids.
+ * \param ids The ids of the result objects.
+ * \param count The number of result objects.
+ * \param values Array of count variables to copy the OK values into. The
+ * variables of results that aren't OK are left untouched. Can take NULL.
+ * \param size The size of each OK value.
+ * \param oks Set to 1 for each OK result and 0 for the rest. Can take NULL.
+ * \param err_info The error information to be used on failure.
+ * \return The number of OK results. */
+size_t res_generic_get_ok_n(
+	const size_t *ids, size_t count, void *values, size_t size, unsigned char *oks,
+	const res_err_info_t *err_info
+) {
 	err_t err = {.err_info = err_info};
-	pthread_mutex_lock(&g_mutex);
-	if (src_id >= g_res_count || g_res_buff[src_id].state != RES_STATE_ERR) {
-		err.msg = "Invalid argument";
-		g_res_fallback.err = err;
-		g_res_fallback.state = RES_STATE_ERR;
+	size_t n = 0;
+	for (size_t i = 0; i < count; i++) {
+		size_t id = ids[i];
+		unsigned char *value = values ? (unsigned char *)values + i * size : NULL;
+		res_state_t state;
+#ifdef RES_THREAD_LOCAL
+		if (is_shared_id(id)) {
+			res_t res;
+			state = shared_copy(id, value ? &res : NULL, 0);
+			if (!is_valid_size(state, size, OK_BUFF_SIZE)) state = RES_STATE_INVALID;
+			if (state == RES_STATE_OK && value) memcpy(value, res.ok, size);
+		} else
+#endif
+		{
+			state = get_state(id);
+			if (!is_valid_size(state, size, RES_CLASS_SIZE(res_id_class(id))))
+				state = RES_STATE_INVALID;
+			if (state == RES_STATE_OK && value) {
+				unsigned char copy[OK_BUFF_SIZE];
+				memcpy(copy, res_get_data(id), size);
+#ifdef TEST
+				if (g_res_copied_hook) g_res_copied_hook(id);
+#endif
+				if (!res_is_unchanged(id, state)) state = RES_STATE_INVALID;
+				else memcpy(value, copy, size);
+			}
+		}
+		if (state == RES_STATE_INVALID && id != g_res_fallback_id)
+			set_fallback(err, "Invalid argument");
+		if (oks) oks[i] = state == RES_STATE_OK;
+		n += state == RES_STATE_OK;
+	}
+	return n;
+}
+
+/** Returns a pointer to the OK value inside the result object without
+ * copying it. The pointer stays valid until the result object is deleted.
+ * \param id The id of the result object.
+ * \param size The size of the OK value.
+ * \param err_info The error information to be used on failure.
+ * \return Pointer to the OK value or NULL on failure. */
+const void *res_generic_peek(size_t id, size_t size, const res_err_info_t *err_info) {
+	err_t err = {.err_info = err_info};
+	if (is_fallback_set(id)) return NULL;
+#ifdef RES_THREAD_LOCAL
+	if (is_shared_id(id)) {
+		res_state_t state = shared_copy(id, NULL, 0);
+		if (state == RES_STATE_INVALID || !is_valid_size(state, size, OK_BUFF_SIZE)) {
+			set_fallback(err, "Invalid argument");
+			return NULL;
+		}
+		if (state != RES_STATE_OK) {
+			set_fallback(err, "Result state is not RES_STATE_OK");
+			return NULL;
+		}
+		lock_mutex();
+		const void *ok = shared_res(id & ~RES_SHARED_BIT)->ok;
 		pthread_mutex_unlock(&g_mutex);
-		return g_fallback_id;
+		return ok;
+	}
+#endif
+	res_state_t state = get_state(id);
+	if (
+		state == RES_STATE_INVALID ||
+		!is_valid_size(state, size, RES_CLASS_SIZE(res_id_class(id)))
+	) {
+		set_fallback(err, "Invalid argument");
+		return NULL;
+	}
+	if (state != RES_STATE_OK) {
+		set_fallback(err, "Result state is not RES_STATE_OK");
+		return NULL;
+	}
+	return res_get_data(id);
+}
+
+/** Deletes the result object and returns a pointer to its OK value without
+ * copying it. The id is invalid from now on, but the memory is only
+ * returned to the pool by the next take on the same thread, so the pointer
+ * stays valid until then. Result objects in the shared pool can't be taken.
+ * \param id The id of the result object.
+ * \param size The size of the OK value.
+ * \param err_info The error information to be used on failure.
+ * \return Pointer to the OK value or NULL on failure. */
+const void *res_generic_take(size_t id, size_t size, const res_err_info_t *err_info) {
+	err_t err = {.err_info = err_info};
+	if (is_fallback_set(id)) return NULL;
+	res_state_t state = get_state(id);
+	if (
+		state == RES_STATE_INVALID ||
+		!is_valid_size(state, size, RES_CLASS_SIZE(res_id_class(id)))
+	) {
+		set_fallback(err, "Invalid argument");
+		return NULL;
+	}
+	if (state != RES_STATE_OK) {
+		set_fallback(err, "Result state is not RES_STATE_OK");
+		return NULL;
+	}
+	uint32_t tag = res_make_tag(res_id_gen(id), RES_STATE_OK);
+	if (!RES_CAS(
+		res_tag_of(&g_res_pools[res_id_pool(id)], res_id_index(id)), &tag,
+		res_make_tag(res_next_gen(id), RES_STATE_INVALID),
+		memory_order_acq_rel, memory_order_relaxed)
+	) {
+		set_fallback(err, "Invalid argument");
+		return NULL;
+	}
+	register_thread();
+	release_taken();
+	g_res_taken = id;
+	return res_get_data(id);
+}
+
+/** Moves an error result object to a new id in the same slot and appends
+ * a propagation frame to it. Bumping the generation turns the source id
+ * stale, so no one else can read the error while the frame is written,
+ * and a racing move or delete of the same id fails.
+ * \param src_id The id of the error result object. It has to be in range.
+ * \param err_info The site the error is propagated through.
+ * \return The new id or g_res_fallback_id if the source is not an error result. */
+static inline size_t move_err(size_t src_id, const res_err_info_t *err_info) {
+	size_t gen = res_next_gen(src_id);
+	uint32_t tag = res_make_tag(res_id_gen(src_id), RES_STATE_ERR);
+	if (!RES_CAS(
+		res_tag_of(&g_res_pools[res_id_pool(src_id)], res_id_index(src_id)), &tag,
+		res_make_tag(gen, RES_STATE_ERR), memory_order_acq_rel, memory_order_relaxed)
+	) return g_res_fallback_id;
+	size_t id = res_make_id(res_id_pool(src_id), res_id_index(src_id), gen);
+	append_frame(get_err(id), err_info);
+	RES_STAT_INC(errors_propagated);
+	return id;
+}
+
+/** Consumes the result object in a single step. An OK value is copied out
+ * and the result object is deleted with the same CAS that validates the
+ * copy. An error result object is not copied at all: it is moved to a new
+ * id in the same slot with a propagation frame appended, which costs a
+ * single CAS. The fallback id is handed over as is.
+ * \param id The id of the result object.
+ * \param value Pointer to the variable to copy the OK value into. Can take NULL.
+ * \param size The size of the OK value.
+ * \param err_id Set to the id of the error result object if the result isn't OK.
+ * \param err_info The error information to be used on failure.
+ * \return 0 if the result was OK, 1 if it wasn't, 2 if any of the arguments
+ * are invalid. */
+int res_generic_unwrap(
+	size_t id, void *value, size_t size, size_t *err_id, const res_err_info_t *err_info
+) {
+	err_t err = {.err_info = err_info};
+	*err_id = g_res_fallback_id;
+	if (is_fallback_set(id)) {
+		append_frame(&g_res_fallback.err, err_info);
+		return 1;
+	}
+#ifdef RES_THREAD_LOCAL
+	if (is_shared_id(id)) {
+		res_t res;
+		// An OK value that doesn't fit is left in place, an error is taken anyway
+		int fits = is_valid_size(RES_STATE_OK, size, OK_BUFF_SIZE);
+		res_state_t state = size ? shared_copy(id, &res, fits) : RES_STATE_INVALID;
+		if (state == RES_STATE_ERR && !fits) state = shared_copy(id, &res, 1);
+		if (state == RES_STATE_INVALID || !is_valid_size(state, size, OK_BUFF_SIZE)) {
+			set_fallback(err, "Invalid argument");
+			return 2;
+		}
+		if (state == RES_STATE_OK) {
+			if (value) memcpy(value, res.ok, size);
+			return 0;
+		}
+		// The shared pool has no room to spare, the error moves to the own pool
+		append_frame(&res.err, err_info);
+		*err_id = alloc_id(RES_ERR_CLASS);
+		if (*err_id == g_res_fallback_id) {
+			g_res_fallback.err = res.err;
+			g_res_fallback.state = RES_STATE_ERR;
+			return 1;
+		}
+		*get_err(*err_id) = res.err;
+		res_publish(*err_id, RES_STATE_ERR, err_info);
+		RES_STAT_INC(errors_propagated);
+		return 1;
 	}
-	if (g_res_count + 1 > RES_BUFF_SIZE && !g_free_count) {
-		err.msg = "Not enough memory";
-		g_res_fallback.err = err;
+#endif
+	res_state_t state = get_state(id);
+	if (
+		state == RES_STATE_INVALID ||
+		!is_valid_size(state, size, RES_CLASS_SIZE(res_id_class(id)))
+	) {
+		set_fallback(err, "Invalid argument");
+		return 2;
+	}
+	if (state == RES_STATE_ERR) {
+		*err_id = move_err(id, err_info);
+		if (*err_id == g_res_fallback_id) {
+			set_fallback(err, "Invalid argument");
+			return 2;
+		}
+		return 1;
+	}
+	if (state != RES_STATE_OK) {
+		set_fallback(err, "Result state is not RES_STATE_OK");
+		return 1;
+	}
+	unsigned char copy[OK_BUFF_SIZE];
+	if (value) memcpy(copy, res_get_data(id), size);
+	res_pool_t *pool = &g_res_pools[res_id_pool(id)];
+	uint32_t tag = res_make_tag(res_id_gen(id), RES_STATE_OK);
+	if (!RES_CAS(
+		res_tag_of(pool, res_id_index(id)), &tag, res_make_tag(res_next_gen(id), RES_STATE_INVALID),
+		memory_order_acq_rel, memory_order_relaxed)
+	) {
+		set_fallback(err, "Invalid argument");
+		return 2;
+	}
+	res_free_index(pool, res_id_index(id));
+	if (value) memcpy(value, copy, size);
+	return 0;
+}
+
+/** Propagates the error stored in another result object. The source
+ * result object is consumed: an error result object in the pool is moved
+ * to a new id in the same slot, so no memory is allocated. Only the
+ * fallback and, if RES_THREAD_LOCAL is defined, errors in the shared pool
+ * are copied into a new result object. A propagation frame is appended
+ * to the error in every case.
+ * \param src_id The id of the source result object. It must not be used
+ * after the call.
+ * \param err_info The site the error is propagated through, also used on failure.
+ * \return The id of the error result object or g_res_fallback_id on failure. */
+size_t res_generic_err_from(size_t src_id, const res_err_info_t *err_info) {
+	err_t err = {.err_info = err_info};
+	err_t src_err;
+	int is_fallback = is_fallback_set(src_id);
+#ifdef RES_THREAD_LOCAL
+	res_t src;
+	if (is_shared_id(src_id)) {
+		if (shared_copy(src_id, &src, 0) != RES_STATE_ERR) {
+			set_fallback(err, "Invalid argument");
+			return g_res_fallback_id;
+		}
+		shared_copy(src_id, NULL, 1);
+		src_err = src.err;
+	} else
+#endif
+	if (is_fallback) {
+		src_err = g_res_fallback.err;
+	} else {
+		size_t id = get_state(src_id) == RES_STATE_ERR ?
+			move_err(src_id, err_info) : g_res_fallback_id;
+		if (id == g_res_fallback_id) set_fallback(err, "Invalid argument");
+		return id;
+	}
+	append_frame(&src_err, err_info);
+	size_t id = alloc_id(RES_ERR_CLASS);
+	if (id == g_res_fallback_id) {
+		// The fallback keeps the error, it is more telling than running out of memory
+		g_res_fallback.err = src_err;
 		g_res_fallback.state = RES_STATE_ERR;
-		pthread_mutex_unlock(&g_mutex);
-		return g_fallback_id;
+		return g_res_fallback_id;
 	}
-	size_t id = set_id();
-	g_res_buff[id].err = g_res_buff[src_id].err;
-	g_res_buff[id].state = RES_STATE_ERR;
-	pthread_mutex_unlock(&g_mutex);
+	*get_err(id) = src_err;
+	res_publish(id, RES_STATE_ERR, err_info);
+	RES_STAT_INC(errors_propagated);
 	return id;
 }
 
 /** Sets the state of the result object INVALID. Its memory in the buffer is marked 
- * to be reused. 
+ * to be reused. Deleting the fallback result object clears the error of the
+ * failed call it holds. Only the caller that moves the state out of RES_STATE_OK or
+ * RES_STATE_ERR marks the id free to be reused, so a double delete is detected
+ * even when racing. The same operation bumps the generation of the result
+ * object, which turns every copy of the id stale.
  * \param id The id of thet result object. 
  * \param err_info The error information to be used on failure. */
-void res_generic_del(size_t id, res_err_info_t err_info) {
+void res_generic_del(size_t id, const res_err_info_t *err_info) {
 	err_t err = {.err_info = err_info};
-	pthread_mutex_lock(&g_mutex);
-	if (id >= RES_BUFF_SIZE || g_res_buff[id].state == RES_STATE_INVALID) {
-		err.msg = "Invalid argument";
-		g_res_fallback.state = RES_STATE_ERR;
-		g_res_fallback.err = err;
-		pthread_mutex_unlock(&g_mutex);
+	if (is_fallback_set(id)) {
+		g_res_fallback.state = RES_STATE_INVALID;
 		return;
 	}
-	if (g_free_count + 1 > FREE_BUFF_SIZE) {
-		err.msg = "Not enough memory";
-		g_res_fallback.state = RES_STATE_ERR;
-		g_res_fallback.err = err;
-		pthread_mutex_unlock(&g_mutex);
+#ifdef RES_THREAD_LOCAL
+	if (is_shared_id(id)) {
+		if (shared_copy(id, NULL, 1) == RES_STATE_INVALID)
+			set_fallback(err, "Invalid argument");
 		return;
 	}
-	g_free_buff[g_free_count] = id;
-	g_free_count++;
-	g_res_buff[id].state = RES_STATE_INVALID;
-	pthread_mutex_unlock(&g_mutex);
+#endif
+	res_pool_t *pool = res_get_pool(id);
+	if (!pool || !res_invalidate(pool, id)) {
+		set_fallback(err, "Invalid argument");
+		return;
+	}
+	res_free_index(pool, res_id_index(id));
 }
 
-/** Prints the error information stored in the result object.
- * \param id The id of the result object.
+/** Deletes count result objects. Each of them is invalidated like in
+ * res_generic_del, then the indices freed in a row from the same word of
+ * the free bitmap of a pool are marked free with a single atomic operation,
+ * so deleting ids created by res_generic_ok_n takes one per 64. The fallback id
+ * may appear any number of times, e.g. after a partially failed
+ * res_generic_ok_n, and clears the fallback.
+ * \param ids The ids of the result objects.
+ * \param count The number of result objects.
  * \param err_info The error information to be used on failure. */
-void res_generic_print_err(size_t id, res_err_info_t err_info) {
+void res_generic_del_n(const size_t *ids, size_t count, const res_err_info_t *err_info) {
 	err_t err = {.err_info = err_info};
-	pthread_mutex_lock(&g_mutex);
+	res_pool_t *run = NULL;
+	size_t word = 0, n = 0;
+	uint64_t mask = 0;
+	for (size_t i = 0; i < count; i++) {
+		size_t id = ids[i];
+		if (id == g_res_fallback_id) {
+			g_res_fallback.state = RES_STATE_INVALID;
+			continue;
+		}
+#ifdef RES_THREAD_LOCAL
+		if (is_shared_id(id)) {
+			if (shared_copy(id, NULL, 1) == RES_STATE_INVALID)
+				set_fallback(err, "Invalid argument");
+			continue;
+		}
+#endif
+		res_pool_t *pool = res_get_pool(id);
+		if (!pool || !res_invalidate(pool, id)) {
+			set_fallback(err, "Invalid argument");
+			continue;
+		}
+		size_t index = res_id_index(id);
+		if (pool != run || res_word_start(index) != word) {
+			if (n) res_free_bits(run, word, mask, n);
+			run = pool;
+			word = res_word_start(index);
+			mask = 0;
+			n = 0;
+		}
+		mask |= res_free_bit(index);
+		n++;
+	}
+	if (n) res_free_bits(run, word, mask, n);
+}
 
-	if (id >= RES_BUFF_SIZE || g_res_buff[id].state != RES_STATE_ERR) {
-		err.msg = "Invalid argument";
-		g_res_fallback.state = RES_STATE_ERR;
-		g_res_fallback.err = err;
+/** Creates a new result object with OK state without taking error
+ * information. The fallback gets the return address instead on failure.
+ * \param value Pointer to the OK value.
+ * \param alignment The alignment of the data to be stored. It must be a power of 2.
+ * \param size The size of the data to be stored.
+ * \return The id of the result object or g_res_fallback_id on failure. */
+size_t res_generic_lazy_ok(const void *value, size_t alignment, size_t size) {
+	size_t id = res_generic_ok(value, alignment, size, NULL);
+	if (id == g_res_fallback_id) {
+		set_fallback_caller(__builtin_return_address(0));
+		return id;
+	}
+#ifdef RES_TRACK
+	res_site_of(&g_res_pools[res_id_pool(id)], res_id_index(id))->caller = __builtin_return_address(0);
+#endif
+	return id;
+}
+
+/** Checks the state of the result object without taking error information.
+ * \param id The id of the result object.
+ * \param value A pointer to the variable to copy the OK value into. Can take NULL.
+ * \param size The size of the OK value.
+ * \return 0 if the result is OK, 1 if it isn't, 2 if any of the arguments are invalid. */
+int res_generic_lazy_get_ok(size_t id, void *value, size_t size) {
+	int ret = res_generic_get_ok(id, value, size, NULL);
+	if (ret) set_fallback_caller(__builtin_return_address(0));
+	return ret;
+}
+
+/** Deletes the result object without taking error information.
+ * \param id The id of the result object. */
+void res_generic_lazy_del(size_t id) {
+	res_generic_del(id, NULL);
+	set_fallback_caller(__builtin_return_address(0));
+}
+
+/** Guards the consumer side of g_res_queue. */
+static pthread_mutex_t g_sink_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** Counts the reports published for the background writer thread. */
+static sem_t g_sink_sem;
+/** Guards the start of the background writer thread. */
+static pthread_once_t g_sink_once = PTHREAD_ONCE_INIT;
+/** Whether the background writer thread is running. If it couldn't be
+ * started, the reports are written by the thread publishing them. */
+static int g_is_sink_async;
+
+/** Summarizes the suppressed errors and writes the queued reports to the
+ * sink. Only one thread drains the queue at a time, the others wait for it.
+ * \param force Whether to summarize the sites whose window is still open.
+ * Summaries that don't fit the queue are retried after draining it. */
+static void flush_reports(int force) {
+	pthread_mutex_lock(&g_sink_mutex);
+	do {
+		summarize_suppressed(monotonic_ns(), force);
+	} while (
+		drain_reports(&g_res_queue, g_res_config.sink) && force &&
+		atomic_load_explicit(&g_res_limit_pending, memory_order_relaxed));
+	pthread_mutex_unlock(&g_sink_mutex);
+}
+
+/** Writes the queued reports to the sink and summarizes every site with
+ * suppressed errors. */
+void res_flush_reports(void) {
+	flush_reports(1);
+}
+
+/** Waits for the next report. While errors are suppressed, the wait times
+ * out after a window, so the summary of a site that fell silent is still
+ * written. */
+static void wait_report() {
+	if (!atomic_load_explicit(&g_res_limit_pending, memory_order_relaxed)) {
+		while (sem_wait(&g_sink_sem) && errno == EINTR);
+		return;
+	}
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	uint64_t ns = (uint64_t)deadline.tv_nsec + g_res_config.report_window * 1000000u;
+	deadline.tv_sec += (time_t)(ns / 1000000000u);
+	deadline.tv_nsec = (long)(ns % 1000000000u);
+	while (sem_timedwait(&g_sink_sem, &deadline) && errno == EINTR);
+}
+
+/** Writes the reports in batches as they are published. Every wakeup
+ * drains the whole queue, so the remaining posts only cause empty drains.
+ * \param arg Unused. */
+static void *sink_writer(void *arg) {
+	(void)arg;
+	for (;;) {
+		wait_report();
+		flush_reports(0);
+	}
+	return NULL;
+}
+
+/** Flushes the reports at exit. */
+static void flush_reports_at_exit() {
+	res_flush_reports();
+}
+
+/** Keeps the background writer thread out of the sink while forking. */
+static void lock_sink() {
+	pthread_mutex_lock(&g_sink_mutex);
+}
+
+/** Lets the background writer thread continue after forking. */
+static void unlock_sink() {
+	pthread_mutex_unlock(&g_sink_mutex);
+}
+
+/** The child of a fork has no background writer thread, so it writes its
+ * reports itself. */
+static void unlock_sink_in_child() {
+	g_is_sink_async = 0;
+	pthread_mutex_unlock(&g_sink_mutex);
+}
+
+/** Starts the background writer thread with all signals blocked, so the
+ * signal handlers of the program never run on it. */
+static void start_sink() {
+	atexit(flush_reports_at_exit);
+	pthread_atfork(lock_sink, unlock_sink, unlock_sink_in_child);
+	if (sem_init(&g_sink_sem, 0, 0)) return;
+	pthread_attr_t attr;
+	if (pthread_attr_init(&attr)) return;
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	pthread_t thread;
+	g_is_sink_async = !pthread_create(&thread, &attr, sink_writer, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	pthread_attr_destroy(&attr);
+}
+
+/** Claims a slot of the report queue, counting the report as dropped if
+ * the queue is full.
+ * \param wait Whether to flush the queue and retry instead of dropping.
+ * \return The slot or NULL if the report is dropped. */
+__attribute__((unused))
+static res_report_t *claim_report_slot(int wait) {
+	pthread_once(&g_sink_once, start_sink);
+	res_report_t *r = claim_report(&g_res_queue);
+	if (!r && wait) {
+		res_flush_reports();
+		r = claim_report(&g_res_queue);
+	}
+	if (!r) atomic_fetch_add_explicit(&g_res_queue.dropped, 1, memory_order_relaxed);
+	return r;
+}
+
+/** Publishes a report and wakes the background writer thread.
+ * \param r The slot claimed for the report. */
+__attribute__((unused))
+static void submit_report(res_report_t *r) {
+	publish_report(r);
+	if (g_is_sink_async) sem_post(&g_sink_sem);
+	else res_flush_reports();
+}
+
+/** Opens a binary log. The file is created with the header, the tables,
+ * the string area and the ring of records, and stays mapped until closed.
+ * \param path The path of the file. It is truncated if it exists.
+ * \param capacity The number of records of the ring, 0 for the default.
+ * \return 0 on success, 1 if capacity is too big, 2 if the file couldn't
+ * be created or mapped. */
+int res_log_open(const char *path, size_t capacity) {
+	if (!capacity) capacity = RES_LOG_CAPACITY;
+	if (capacity > RES_LOG_MAX_CAPACITY) return 1;
+	res_log_header_t header = {
+		.magic = RES_LOG_MAGIC,
+		.version = RES_LOG_VERSION,
+		.record_size = sizeof(res_log_record_t),
+		.site_count = RES_SITE_COUNT,
+		.msg_count = RES_LOG_MSG_COUNT,
+		.capacity = capacity,
+		.strings_size = RES_LOG_STRINGS_SIZE,
+		.sites_offset = sizeof(res_log_header_t)
+	};
+	header.msgs_offset = header.sites_offset + RES_SITE_COUNT * sizeof(res_log_site_t);
+	header.strings_offset = header.msgs_offset + RES_LOG_MSG_COUNT * sizeof(uint32_t);
+	header.records_offset = res_round_to_line(header.strings_offset + RES_LOG_STRINGS_SIZE);
+	size_t size = header.records_offset + capacity * sizeof(res_log_record_t);
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) return 2;
+	void *map = MAP_FAILED;
+	if (!ftruncate(fd, (off_t)size))
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return 2;
+	memcpy(map, &header, sizeof(header));
+	res_log_close();
+	g_res_log = res_log_parts(map, size);
+	return 0;
+}
+
+/** Closes the binary log, leaving the written records in the file. */
+void res_log_close(void) {
+	if (!g_res_log.header) return;
+	munmap(g_res_log.header, g_res_log.size);
+	g_res_log = (res_log_t){0};
+	for (size_t i = 0; i < RES_LOG_MSG_COUNT; i++)
+		atomic_store_explicit(&g_res_log_msgs[i], NULL, memory_order_relaxed);
+}
+
+#ifndef TEST
+/** Prints the error, resolving its caller if it has no error information.
+ * The error passes the rate limiter of its site or caller first, whether it
+ * goes to the binary log or to the report queue.
+ * \param err The error. */
+static void print_resolved(err_t err) {
+	const res_err_info_t *limit_site;
+	res_limit_t *limit = limit_of(&err, &limit_site);
+	uint64_t suppressed;
+	int pending = atomic_load_explicit(&g_res_limit_pending, memory_order_relaxed);
+	if (!limit_report(limit, monotonic_ns(), &suppressed)) {
+		// Let the writer thread start timing out for the summary.
+		if (!pending && g_is_sink_async) sem_post(&g_sink_sem);
+		return;
+	}
+	if (suppressed) queue_summary(limit, limit_site, suppressed);
+	if (g_res_log.header && (err.err_info || !err.caller)) {
+		log_err(&g_res_log, err);
+		return;
+	}
+	char func[RES_SYMBOL_SIZE];
+	res_err_info_t site;
+	if (!err.err_info && err.caller) {
+		site = resolve_caller(err.caller, func);
+		err.err_info = &site;
 	}
+	res_report_t *r = claim_report_slot(0);
+	if (!r) return;
+	r->size = res_format_err(err, g_res_sites, r->text, RES_REPORT_SIZE);
+	submit_report(r);
+}
+#endif
+
+/** Prints the error information stored in the result object. The fallback
+ * result object is only printed for the fallback id or an invalid id.
+ * \param id The id of the result object.
+ * \param err_info The error information to be used on failure. */
+void res_generic_print_err(size_t id, const res_err_info_t *err_info) {
+	err_t err = {.err_info = err_info};
+	res_t res = {.state = RES_STATE_INVALID};
 
-	if (id == g_fallback_id || g_res_fallback.state == RES_STATE_ERR) {
+	if (is_fallback_set(id)) {
+		res = g_res_fallback;
+	} else
+#ifdef RES_THREAD_LOCAL
+	if (is_shared_id(id)) {
+		shared_copy(id, &res, 0);
+	} else
+#endif
+	if (get_state(id) == RES_STATE_ERR) {
+		res.err = *get_err(id);
+#ifdef TEST
+		if (g_res_copied_hook) g_res_copied_hook(id);
+#endif
+		// The error is only printed if it didn't change while it was copied
+		if (res_is_unchanged(id, RES_STATE_ERR)) res.state = RES_STATE_ERR;
+	}
+	if (id == g_res_fallback_id || res.state != RES_STATE_ERR) {
+		if (res.state != RES_STATE_ERR) set_fallback(err, "Invalid argument");
 #ifdef TEST
 		g_is_fallback_error_printed = 1;
 #else
-		print_err(g_res_fallback.err);
+		print_resolved(g_res_fallback.err);
 #endif
-		pthread_mutex_unlock(&g_mutex);
 		return;
 	}
 
 #ifdef TEST
 	g_is_error_printed = 1;
 #else
-	print_err(g_res_buff[id].err);
+	print_resolved(res.err);
 #endif
+}
 
+/** Reads the runtime statistics of the result pools. The pool figures are
+ * derived from the pools themselves: the count of a pool only grows until
+ * its region ends, so the high-water mark is the count or the peak the
+ * region left behind, and the live result objects are the ones not marked
+ * free.
+ * \param stats The struct to write the statistics into.
+ * \return 0 on success, 1 if stats is NULL or the library is built with
+ * RES_NO_STATS. */
+int res_stats(res_stats_t *stats) {
+	if (!stats) return 1;
+	*stats = (res_stats_t){0};
+	for (size_t p = 0; p < RES_POOL_COUNT; p++) {
+		size_t count = RES_LOAD(&g_res_pools[p].count, memory_order_relaxed);
+		size_t free_count = RES_LOAD(&g_res_pools[p].free_count, memory_order_relaxed);
+		size_t peak = RES_LOAD(&g_res_pools[p].peak, memory_order_relaxed);
+		if (free_count > count) free_count = count;
+		stats->high_water += count > peak ? count : peak;
+		stats->free += free_count;
+		stats->live += count - free_count;
+	}
+	stats->reports_dropped = atomic_load_explicit(&g_res_queue.dropped, memory_order_relaxed);
+#ifdef RES_NO_STATS
+	return 1;
+#else
+	stats->fallbacks = atomic_load_explicit(&g_res_counters.fallbacks, memory_order_relaxed);
+	stats->errors_created =
+		atomic_load_explicit(&g_res_counters.errors_created, memory_order_relaxed);
+	stats->errors_propagated =
+		atomic_load_explicit(&g_res_counters.errors_propagated, memory_order_relaxed);
+	stats->mutex_contentions =
+		atomic_load_explicit(&g_res_counters.mutex_contentions, memory_order_relaxed);
+	stats->reports_suppressed =
+		atomic_load_explicit(&g_res_counters.reports_suppressed, memory_order_relaxed);
+	return 0;
+#endif
+}
+
+#ifdef RES_TRACK
+/** Checks if two creation sites are the same. The file and function names
+ * are compared by content since the same literal may live at different
+ * addresses in different translation units.
+ * \param a The first site.
+ * \param b The second site. */
+static inline int is_same_site(res_err_info_t a, res_err_info_t b) {
+	if (a.line != b.line) return 0;
+	if (a.file != b.file && (!a.file || !b.file || strcmp(a.file, b.file))) return 0;
+	return a.func == b.func || (a.func && b.func && !strcmp(a.func, b.func));
+}
+
+/** Compares leaks by count for qsort, the bigger count first. */
+static int compare_leaks(const void *a, const void *b) {
+	size_t x = ((const res_leak_t *)a)->count;
+	size_t y = ((const res_leak_t *)b)->count;
+	return (x < y) - (x > y);
+}
+
+/** Counts a live result object at its creation site.
+ * \param leaks The malloc-ed array of the sites.
+ * \param n The number of sites.
+ * \param capacity The number of elements of the array.
+ * \param site The creation site.
+ * \return 0 on success, 1 if the array couldn't be grown. */
+static int add_leak(res_leak_t **leaks, size_t *n, size_t *capacity, res_site_ref_t site) {
+	res_err_info_t info = site.info ? *site.info : (res_err_info_t){0};
+	for (size_t i = 0; i < *n; i++) {
+		if (is_same_site((*leaks)[i].site, info) && (*leaks)[i].caller == site.caller) {
+			(*leaks)[i].count++;
+			return 0;
+		}
+	}
+	if (*n == *capacity) {
+		size_t grown_capacity = *capacity ? *capacity * 2 : 16;
+		res_leak_t *grown = realloc(*leaks, grown_capacity * sizeof(res_leak_t));
+		if (!grown) return 1;
+		*leaks = grown;
+		*capacity = grown_capacity;
+	}
+	(*leaks)[(*n)++] = (res_leak_t){.site = info, .caller = site.caller, .count = 1};
+	return 0;
+}
+
+/** Groups the live result objects of the calling thread's pools by their
+ * creation site. The result objects are read while other threads may
+ * create and delete them, so the report is only exact for a quiet pool.
+ * \param leaks Set to a malloc-ed array of the sites, the site with the most
+ * live result objects first. Must be freed by the caller.
+ * \return The number of sites. */
+static size_t collect_leaks(res_leak_t **leaks) {
+	size_t n = 0;
+	size_t capacity = 0;
+	int is_full = 0;
+	*leaks = NULL;
+	for (size_t p = 0; p < RES_POOL_COUNT && !is_full; p++) {
+		res_pool_t *pool = &g_res_pools[p];
+		size_t count = RES_LOAD(&pool->count, memory_order_acquire);
+		for (size_t index = 0; index < count && !is_full; index++) {
+			uint32_t tag = RES_LOAD(res_tag_of(pool, index), memory_order_acquire);
+			if ((tag & RES_STATE_MASK) == RES_STATE_INVALID) continue;
+			is_full = add_leak(leaks, &n, &capacity, *res_site_of(pool, index));
+		}
+	}
+	if (n) qsort(*leaks, n, sizeof(res_leak_t), compare_leaks);
+	return n;
+}
+#endif
+
+/** Lists the live result objects grouped by their creation site.
+ * \param leaks The array to write the sites into, the site with the most
+ * live result objects first. Can take NULL if size is 0.
+ * \param size The number of elements of leaks.
+ * \return The number of sites, which may be bigger than size. */
+size_t res_leaks(res_leak_t *leaks, size_t size) {
+#ifdef RES_TRACK
+	res_leak_t *all;
+	size_t n = collect_leaks(&all);
+	if (leaks) memcpy(leaks, all, (n < size ? n : size) * sizeof(res_leak_t));
+	free(all);
+	return n;
+#else
+	(void)leaks;
+	(void)size;
+	return 0;
+#endif
+}
+
+/** Prints the live result objects grouped by their creation site.
+ * \return The number of live result objects. */
+size_t res_print_leaks(void) {
+#ifdef RES_TRACK
+	res_leak_t *leaks;
+	size_t n = collect_leaks(&leaks);
+	size_t total = 0;
+	for (size_t i = 0; i < n; i++) {
+		total += leaks[i].count;
+		char func[RES_SYMBOL_SIZE];
+		res_err_info_t site = leaks[i].site.file ?
+			leaks[i].site : resolve_caller(leaks[i].caller, func);
+		res_report_t *r = claim_report_slot(1);
+		if (!r) continue;
+		r->size = append_report(r->text, RES_REPORT_SIZE, 0,
+			"[LEAK]:\n\tCount: %zu\n\tFile: %s\n\tFunction: %s\n\tLine: %d\n",
+			leaks[i].count, site.file, site.func, site.line);
+		submit_report(r);
+	}
+	free(leaks);
+	res_flush_reports();
+	return total;
+#else
+	return 0;
+#endif
+}
+
+#if defined(RES_TRACK) && !defined(TEST)
+/** Prints the leaks at exit. */
+static void print_leaks_at_exit() {
+	res_print_leaks();
+}
+
+/** Registers the leak report at exit when the library is loaded. */
+__attribute__((constructor))
+static void register_leak_report() {
+	atexit(print_leaks_at_exit);
+}
+#endif
+
+/** Registers the site descriptors of a module unless they are already
+ * registered. Modules beyond RES_MODULE_COUNT are not listed by res_sites.
+ * \param start The first descriptor of the module.
+ * \param stop The end of the descriptors of the module. */
+void res_register_sites(const res_err_info_t *start, const res_err_info_t *stop) {
+	lock_mutex();
+	size_t i = 0;
+	while (i < g_res_module_count && g_res_modules[i].start != start) i++;
+	if (i == g_res_module_count && i < RES_MODULE_COUNT)
+		g_res_modules[g_res_module_count++] = (res_module_t){start, stop};
+	pthread_mutex_unlock(&g_mutex);
+}
+
+/** Lists the site descriptors of all registered modules.
+ * \param sites The array to write the descriptors into. Can take NULL if size is 0.
+ * \param size The number of elements of sites.
+ * \return The number of sites, which may be bigger than size. */
+size_t res_list_sites(const res_err_info_t **sites, size_t size) {
+	size_t n = 0;
+	lock_mutex();
+	for (size_t i = 0; i < g_res_module_count; i++) {
+		for (const res_err_info_t *site = g_res_modules[i].start; site < g_res_modules[i].stop; site++) {
+			if (n < size) sites[n] = site;
+			n++;
+		}
+	}
+	pthread_mutex_unlock(&g_mutex);
+	return n;
+}
+
+/** Begins a region on the calling thread. The region slot is claimed with
+ * a CAS on the mask of the used slots.
+ * \param region The handle to write the region into.
+ * \return 0 on success, 1 if region is NULL, 2 if all regions are in use. */
+int res_region_begin(res_region_t *region) {
+	if (!region) return 1;
+	size_t all = RES_REGION_COUNT < sizeof(size_t) * 8 ?
+		((size_t)1 << RES_REGION_COUNT) - 1 : ~(size_t)0;
+	size_t used = RES_LOAD(&g_res_regions_used, memory_order_relaxed);
+	size_t slot;
+	do {
+		size_t free = all & ~used & ~(size_t)1;
+		if (!free) return 2;
+		slot = (size_t)__builtin_ctzl(free);
+	} while (!RES_CAS(
+		&g_res_regions_used, &used, used | ((size_t)1 << slot),
+		memory_order_acquire, memory_order_relaxed));
+	*region = (res_region_t){slot, g_res_region};
+	g_res_region = slot;
+	return 0;
+}
+
+/** Invalidates every result object of a pool of a region slot whose epoch
+ * wraps, bumping the slot part of its generation. An id of an epoch from
+ * before the wrap, whose object is still in its tag or was published again
+ * at the same slot generation, would validate again once the epoch comes
+ * around. After the bump it only does if its slot was reused a multiple of
+ * 2^RES_SLOT_GEN_BITS times, like any generation that wraps.
+ * \param pool The pool. */
+static void invalidate_pool(res_pool_t *pool) {
+	for (size_t k = 0; k < RES_MAX_CHUNKS; k++) {
+		unsigned char *chunk = RES_LOAD(&pool->chunks[k], memory_order_relaxed);
+		if (!chunk) continue;
+		RES_ATOMIC(uint32_t) *tags = (RES_ATOMIC(uint32_t) *)(void *)chunk;
+		for (size_t i = 0; i < res_chunk_slots(k); i++) {
+			size_t gen = res_tag_gen(RES_LOAD(&tags[i], memory_order_relaxed));
+			RES_STORE(&tags[i], res_make_tag(
+				(gen & ~RES_SLOT_GEN_MASK) | ((gen + 1) & RES_SLOT_GEN_MASK), RES_STATE_INVALID
+			), memory_order_relaxed);
+		}
+	}
+}
+
+/** Ends the innermost region of the calling thread. Bumping the epoch of
+ * the region turns the ids of all of its result objects stale at once, so
+ * its pools are simply emptied, keeping their chunks. Only the free bitmaps
+ * are cleared, one bit per result object. Once every 2^RES_EPOCH_BITS ends
+ * the epoch wraps, and the tags of the pools are invalidated as well.
+ * \param region The handle of the region.
+ * \return 0 on success, 1 if region is not the innermost region of the thread. */
+int res_region_end(res_region_t region) {
+	if (!region.slot || region.slot != g_res_region) return 1;
+	size_t epoch = RES_LOAD(&g_res_region_epochs[region.slot], memory_order_relaxed) + 1;
+	RES_STORE(&g_res_region_epochs[region.slot], epoch, memory_order_release);
+	int wraps = !(epoch & ((1LU << RES_EPOCH_BITS) - 1));
+	for (size_t c = 0; c < RES_CLASS_COUNT; c++) {
+		res_pool_t *pool = &g_res_pools[region.slot * RES_CLASS_COUNT + c];
+		if (wraps) invalidate_pool(pool);
+		size_t count = RES_LOAD(&pool->count, memory_order_acquire);
+		for (size_t k = 0; count && k <= res_chunk_of(count - 1); k++) {
+			memset(RES_LOAD(&pool->chunks[k], memory_order_relaxed) + res_chunk_bitmap_offset(k),
+				0, res_chunk_words(k) * sizeof(uint64_t));
+		}
+		if (count > RES_LOAD(&pool->peak, memory_order_relaxed))
+			RES_STORE(&pool->peak, count, memory_order_relaxed);
+		RES_STORE(&pool->free_count, 0, memory_order_relaxed);
+		RES_STORE(&pool->count, 0, memory_order_relaxed);
+	}
+	g_res_region = region.prev;
+	size_t used = RES_LOAD(&g_res_regions_used, memory_order_relaxed);
+	while (!RES_CAS(
+		&g_res_regions_used, &used, used & ~((size_t)1 << region.slot),
+		memory_order_release, memory_order_relaxed));
+	return 0;
+}
+
+/** Hands the result object over to another thread. Without RES_THREAD_LOCAL
+ * all threads share one pool and the id is returned as is. With
+ * RES_THREAD_LOCAL the result object is moved from the pool of the calling
+ * thread into the shared pool which is guarded by g_mutex. The source id
+ * must not be used after the call.
+ * \param id The id of the result object.
+ * \param err_info The error information to be used on failure.
+ * \return The id that is valid on any thread. */
+size_t res_generic_share(size_t id, const res_err_info_t *err_info) {
+	err_t err = {.err_info = err_info};
+	if (is_fallback_set(id)) {
+		// The fallback belongs to the calling thread, so its error is moved
+		// into a pool first
+		id = res_generic_err_from(id, err_info);
+		if (id == g_res_fallback_id) return id;
+		g_res_fallback.state = RES_STATE_INVALID;
+	}
+#ifdef RES_THREAD_LOCAL
+	if (is_shared_id(id)) return id;
+#endif
+	res_state_t state = get_state(id);
+	if (state == RES_STATE_INVALID) {
+		set_fallback(err, "Invalid argument");
+		return g_res_fallback_id;
+	}
+#ifdef RES_THREAD_LOCAL
+	size_t shared_id = g_res_fallback_id;
+	lock_mutex();
+	size_t index = shared_claim();
+	if (index != g_res_fallback_id) {
+		res_t *shared = shared_res(index);
+		memcpy(shared->ok, res_get_data(id), RES_CLASS_SIZE(res_id_class(id)));
+		shared->state = state;
+		shared_id = index | RES_SHARED_BIT;
+	}
 	pthread_mutex_unlock(&g_mutex);
+	res_generic_del(id, err_info);
+	if (shared_id == g_res_fallback_id) set_fallback(err, "Not enough memory");
+	return shared_id;
+#else
+	return id;
+#endif
 }
@@ -0,0 +1,152 @@
+/*
+MIT License
+Copyright (c) 2025 András Broskó
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+/**
+ * \file src/result_decode.c
+ * \brief Formatting and decoding of errors.
+ * \details This file contains the functions shared by the result library
+ * and the decoder of binary logs, res-decode.
+ * */
+
+#include "result_decode.h"
+
+/** Formats the error information into a report. A truncated report still
+ * ends in a newline.
+ * \param e The error struct whose content is to be formatted.
+ * \param sites The site table the frames of the error refer to.
+ * \param buf The buffer to format the report into.
+ * \param size The size of buf, at least 2.
+ * \return The length of the report. */
+size_t res_format_err(err_t e, res_site_t *sites, char *buf, size_t size) {
+	res_err_info_t info = e.err_info ? *e.err_info : (res_err_info_t){"<unknown>", "<unknown>", 0};
+	size_t len = append_report(buf, size, 0,
+		"[ERROR]:\n\tMessage: %s\n\tFile: %s\n\tFunction: %s\n\tLine: %d\n",
+		e.msg, info.file, info.func, info.line);
+	if (e.depth) {
+		len = append_report(buf, size, len, "\tPropagated through:\n");
+		uint32_t first = e.depth > RES_FRAME_COUNT ? e.depth - RES_FRAME_COUNT : 0;
+		if (first) len = append_report(buf, size, len, "\t\t... %u frames omitted\n", first);
+		for (uint32_t i = first; i < e.depth; i++) {
+			const res_err_info_t *site = atomic_load_explicit(
+				&sites[e.frames[i % RES_FRAME_COUNT]], memory_order_relaxed);
+			len = site ?
+				append_report(buf, size, len, "\t\t#%u %s (%s:%d)\n",
+					i + 1, site->func, site->file, site->line) :
+				append_report(buf, size, len, "\t\t#%u <unknown>\n", i + 1);
+		}
+	}
+	if (len == size - 1) buf[len - 1] = '\n';
+	return len;
+}
+
+/** Returns the parts of a binary log from its mapping.
+ * \param map The mapping, starting with the header.
+ * \param size The size of the mapping.
+ * \return The parts or a zeroed struct if the header doesn't describe a
+ * valid log of this size. */
+res_log_t res_log_parts(void *map, size_t size) {
+	res_log_header_t *h = map;
+	if (
+		size < sizeof(res_log_header_t) || memcmp(h->magic, RES_LOG_MAGIC, 8) ||
+		h->version != RES_LOG_VERSION || h->record_size != sizeof(res_log_record_t) ||
+		h->site_count != RES_SITE_COUNT || h->msg_count != RES_LOG_MSG_COUNT ||
+		!h->capacity || h->capacity > RES_LOG_MAX_CAPACITY ||
+		h->strings_size > UINT32_MAX || h->sites_offset > size ||
+		size - h->sites_offset < RES_SITE_COUNT * sizeof(res_log_site_t) ||
+		h->msgs_offset > size || size - h->msgs_offset < RES_LOG_MSG_COUNT * sizeof(uint32_t) ||
+		h->strings_offset > size || size - h->strings_offset < h->strings_size ||
+		h->records_offset > size ||
+		(size - h->records_offset) / sizeof(res_log_record_t) < h->capacity
+	) return (res_log_t){0};
+	unsigned char *base = map;
+	return (res_log_t){
+		.header = h,
+		.sites = (res_log_site_t *)(base + h->sites_offset),
+		.msgs = (_Atomic uint32_t *)(base + h->msgs_offset),
+		.strings = (char *)(base + h->strings_offset),
+		.records = (res_log_record_t *)(base + h->records_offset),
+		.size = size
+	};
+}
+
+/** Returns a string of the string area of a binary log.
+ * \param log The binary log.
+ * \param off The offset of the string plus one.
+ * \return The string or "<unknown>" if the offset is 0 or invalid. */
+const char *res_log_get_string(const res_log_t *log, uint32_t off) {
+	if (!off || off > log->header->strings_size) return "<unknown>";
+	const char *str = log->strings + off - 1;
+	return memchr(str, 0, log->header->strings_size - off + 1) ? str : "<unknown>";
+}
+
+/** Decodes the records of a binary log into the text format of printed
+ * errors, the oldest first. Records being written are skipped.
+ * \param map The mapping of the binary log.
+ * \param size The size of the mapping.
+ * \param out The stream to write the errors to.
+ * \param verbose Whether to write the time and the thread of each error.
+ * \return The number of decoded records or -1 if the log is invalid. */
+long res_decode_log(void *map, size_t size, FILE *out, int verbose) {
+	res_log_t log = res_log_parts(map, size);
+	if (!log.header) return -1;
+	res_err_info_t *infos = calloc(RES_SITE_COUNT, sizeof(res_err_info_t));
+	res_site_t *sites = calloc(RES_SITE_COUNT, sizeof(res_site_t));
+	if (!infos || !sites) {
+		free(infos);
+		free(sites);
+		return -1;
+	}
+	for (size_t id = 1; id < RES_SITE_COUNT; id++) {
+		res_log_site_t *entry = &log.sites[id];
+		if (atomic_load_explicit(&entry->state, memory_order_acquire) != 2) continue;
+		infos[id] = (res_err_info_t){
+			res_log_get_string(&log, entry->file), res_log_get_string(&log, entry->func), entry->line};
+		sites[id] = &infos[id];
+	}
+	uint64_t head = atomic_load_explicit(&log.header->head, memory_order_acquire);
+	uint64_t capacity = log.header->capacity;
+	long n = 0;
+	for (uint64_t t = head > capacity ? head - capacity : 0; t < head; t++) {
+		res_log_record_t *r = &log.records[t % capacity];
+		if (atomic_load_explicit(&r->seq, memory_order_acquire) != t + 1) continue;
+		err_t err = {.msg = "<unknown>", .depth = r->depth};
+		if (r->msg < RES_LOG_MSG_COUNT)
+			err.msg = res_log_get_string(&log,
+				atomic_load_explicit(&log.msgs[r->msg], memory_order_acquire));
+		if (r->site < RES_SITE_COUNT)
+			err.err_info = atomic_load_explicit(&sites[r->site], memory_order_relaxed);
+		for (size_t i = 0; i < RES_FRAME_COUNT; i++)
+			err.frames[i] = r->frames[i] < RES_SITE_COUNT ? r->frames[i] : 0;
+		char buf[RES_REPORT_SIZE];
+		if (verbose) {
+			time_t sec = (time_t)(r->time / 1000000000u);
+			struct tm tm;
+			char date[32];
+			strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", gmtime_r(&sec, &tm));
+			fprintf(out, "[%s.%09luZ] [thread %u]\n", date,
+				(unsigned long)(r->time % 1000000000u), r->thread);
+		}
+		fwrite(buf, 1, res_format_err(err, sites, buf, sizeof(buf)), out);
+		n++;
+	}
+	free(infos);
+	free(sites);
+	return n;
+}
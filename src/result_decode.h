@@ -0,0 +1,42 @@
+/*
+MIT License
+Copyright (c) 2025 András Broskó
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+/**
+ * \file src/result_decode.h
+ * \brief Private interface for formatting and decoding errors
+ * \details This file contains declarations of the functions shared by the
+ * result library and the decoder of binary logs, res-decode.
+ * */
+
+#ifndef RESULT_DECODE_H
+#define RESULT_DECODE_H
+
+#include "result_utils.h"
+
+/** Formats the error information into a report. */
+size_t res_format_err(err_t e, res_site_t *sites, char *buf, size_t size);
+/** Returns the parts of a binary log from its mapping. */
+res_log_t res_log_parts(void *map, size_t size);
+/** Returns a string of the string area of a binary log. */
+const char *res_log_get_string(const res_log_t *log, uint32_t off);
+/** Decodes the records of a binary log into the text format of printed errors. */
+long res_decode_log(void *map, size_t size, FILE *out, int verbose);
+
+#endif
@@ -29,95 +29,888 @@ SOFTWARE.
 #define RESULT_UTILS_H
 
 #include "result.h"
+#include "result_fast.h"
 #include <pthread.h>
+#include <sys/mman.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/syscall.h>
 
 /** Size of the buffer to store the OK data in. */
 #define OK_BUFF_SIZE 1024LU
-/** Size of the buffer to store the result instances in. */
+/** Default initial capacity of the pool of each size class. */
 #define RES_BUFF_SIZE 32LU
-/** Size of the buffer to store the id's of result objects
- * ready to be reused. */
-#define FREE_BUFF_SIZE RES_BUFF_SIZE
+/** Default hard cap on the capacity of the pool of each size class. */
+#define RES_MAX_CAPACITY 65536LU
 
-/** Result states enum */
-typedef enum res_state {
-	RES_STATE_INVALID,
-	RES_STATE_ERR,
-	RES_STATE_OK
-} res_state_t;
+_Static_assert(RES_CLASS_SIZE(RES_CLASS_COUNT - 1) == OK_BUFF_SIZE,
+	"The biggest size class must hold OK_BUFF_SIZE bytes");
+_Static_assert(RES_CHUNK_SIZE == 1LU << RES_CHUNK_SHIFT, "RES_CHUNK_SHIFT is wrong");
+_Static_assert(RES_MAX_CAPACITY <= RES_INDEX_MASK + 1, "RES_MAX_CAPACITY is too big");
+_Static_assert(RES_INDEX_BITS + RES_CLASS_BITS < 32, "Bit 31 of an id must stay free");
+_Static_assert(RES_POOL_COUNT <= 1LU << RES_CLASS_BITS, "The pool must fit the class part of an id");
+_Static_assert(RES_REGION_COUNT <= sizeof(size_t) * 8, "The used regions must fit a mask");
+_Static_assert(RES_GEN_BITS + RES_STATE_BITS <= 32, "A tag must fit 32 bits");
+_Static_assert(sizeof(size_t) * 8 >= RES_OWNER_SHIFT + RES_OWNER_BITS, "size_t is too small");
+
+#ifdef RES_THREAD_LOCAL
+/** Bit marking the id-s of result objects in the shared pool. */
+#define RES_SHARED_BIT ((size_t)1 << 31)
+#endif
+
+#ifdef RES_NO_STATS
+#define RES_STAT_INC(counter) ((void)0)
+#else
+/** Increments a counter of the runtime statistics. The counters are only
+ * ever read together, so relaxed ordering is enough.
+ * \param counter The name of the counter in res_counters_t. */
+#define RES_STAT_INC(counter)\
+	((void)atomic_fetch_add_explicit(&g_res_counters.counter, 1, memory_order_relaxed))
+#endif
+
+/** The number of bits of an interned site id. */
+#define RES_SITE_BITS 12
+/** The capacity of the site table. Site id 0 stands for an unknown site. */
+#define RES_SITE_COUNT ((size_t)1 << RES_SITE_BITS)
+/** The number of propagation frames an error keeps. Fills the error up to
+ * the size of its size class. */
+#define RES_FRAME_COUNT 18
+
+/** Id of an interned site, the index of the site in g_res_sites. */
+typedef uint16_t res_site_id_t;
+
+/** Entry of the site table, the static descriptor of the site or NULL. */
+typedef _Atomic(const res_err_info_t *) res_site_t;
+
+/** Range of static site descriptors in the res_sites section of a module. */
+typedef struct res_module {
+	const res_err_info_t *start;
+	const res_err_info_t *stop;
+} res_module_t;
+
+/** The size of the buffer a resolved caller is formatted into. */
+#define RES_SYMBOL_SIZE 256
+/** The maximum number of modules whose sites can be registered. */
+#define RES_MODULE_COUNT 64
+
+/** The size of a formatted report. Longer reports are truncated. */
+#define RES_REPORT_SIZE 2048LU
+/** The number of reports the report queue holds. */
+#define RES_QUEUE_SIZE 32LU
+/** The maximum number of reports handed to the sink at once. */
+#define RES_BATCH_SIZE 16LU
+
+/** Slot of the report queue. */
+typedef struct res_report {
+	/** Twice the round of the queue the slot is free for, plus one once the
+	 * report of that round is published. Ticket t belongs to the slot
+	 * t % RES_QUEUE_SIZE in the round t / RES_QUEUE_SIZE, so a zeroed queue
+	 * is empty. */
+	alignas(RES_CACHE_LINE) _Atomic size_t seq;
+	/** The length of the report. */
+	size_t size;
+	/** The formatted report. */
+	char text[RES_REPORT_SIZE];
+} res_report_t;
+
+/** Bounded multi-producer single-consumer queue of formatted reports.
+ * Producers claim slots with a CAS on the tail and never block; when the
+ * queue is full the report is dropped and counted instead. The consumer is
+ * whoever holds the sink mutex: the background writer thread or a flush. */
+typedef struct res_queue {
+	/** The next ticket to be claimed by a producer. */
+	alignas(RES_CACHE_LINE) _Atomic size_t tail;
+	/** The number of reports dropped because the queue was full. */
+	alignas(RES_CACHE_LINE) _Atomic size_t dropped;
+	/** The next ticket to be consumed. Only touched by the consumer. */
+	alignas(RES_CACHE_LINE) size_t head;
+	/** The number of dropped reports the consumer has already reported. */
+	size_t reported;
+	res_report_t reports[RES_QUEUE_SIZE];
+} res_queue_t;
+
+/** Default number of errors of the same site reported per window. */
+#define RES_REPORT_BURST 8LU
+/** Default length of the rate limiting window in milliseconds. */
+#define RES_REPORT_WINDOW 1000LU
+
+/** The capacity of the table of the rate limiters of callers. Limiter 0
+ * is shared by the errors without a caller and by every caller once the
+ * table is full. */
+#define RES_CALLER_COUNT 1024LU
+
+/** Rate limiter of the reports of a site, indexed by the site id, or of
+ * the failed calls made without error information at a caller. */
+typedef struct res_limit {
+	/** The start of the current window in monotonic nanoseconds. Aligned so
+	 * threads reporting errors of different sites don't share a line. */
+	alignas(RES_CACHE_LINE) _Atomic uint64_t window;
+	/** The number of errors of the site in the current window. */
+	_Atomic uint64_t count;
+	/** The number of errors suppressed since the last summary. */
+	_Atomic uint64_t suppressed;
+	/** The return address of the failed calls the limiter belongs to, NULL
+	 * for the limiters of sites. */
+	_Atomic(const void *) caller;
+} res_limit_t;
+
+/** Magic number at the start of a binary log. */
+#define RES_LOG_MAGIC "RESLOG\0\0"
+/** Version of the binary log format. */
+#define RES_LOG_VERSION 1U
+/** Default number of records of a binary log. */
+#define RES_LOG_CAPACITY 65536LU
+/** Maximum number of records of a binary log. */
+#define RES_LOG_MAX_CAPACITY (1LU << 32)
+/** The size of the string area of a binary log. */
+#define RES_LOG_STRINGS_SIZE (1LU << 20)
+/** The number of distinct messages a binary log interns. Message id 0
+ * stands for an unknown message. */
+#define RES_LOG_MSG_COUNT 4096LU
+
+/** Header of a binary log. The parts of the log follow at the offsets
+ * in the header, so the decoder needs no knowledge of the layout. */
+typedef struct res_log_header {
+	char magic[8];
+	uint32_t version;
+	/** The size of res_log_record_t. */
+	uint32_t record_size;
+	/** The number of entries of the site table, RES_SITE_COUNT. */
+	uint32_t site_count;
+	/** The number of entries of the message table, RES_LOG_MSG_COUNT. */
+	uint32_t msg_count;
+	/** The number of records of the ring. */
+	uint64_t capacity;
+	/** The size of the string area. */
+	uint64_t strings_size;
+	uint64_t sites_offset;
+	uint64_t msgs_offset;
+	uint64_t strings_offset;
+	uint64_t records_offset;
+	/** The next ticket to be written. Ticket t goes to record t % capacity. */
+	alignas(RES_CACHE_LINE) _Atomic uint64_t head;
+	/** The number of bytes claimed in the string area, which may exceed its size. */
+	alignas(RES_CACHE_LINE) _Atomic uint64_t strings_used;
+} res_log_header_t;
+
+/** Entry of the site table of a binary log, indexed by the site id. The
+ * strings are offsets into the string area plus one, 0 if unknown. */
+typedef struct res_log_site {
+	uint32_t file;
+	uint32_t func;
+	int32_t line;
+	/** 0 if the entry is empty, 1 while it is being written, 2 once written. */
+	_Atomic uint32_t state;
+} res_log_site_t;
+
+/** Record of a printed error in a binary log. */
+typedef struct res_log_record {
+	/** The ticket of the record plus one once the record is written, 0 while
+	 * it is being written. */
+	_Atomic uint64_t seq;
+	/** Nanoseconds since the Epoch. */
+	uint64_t time;
+	/** The id of the printing thread. */
+	uint32_t thread;
+	/** The id of the message in the message table. */
+	uint32_t msg;
+	/** The number of times the error was propagated, with the remainder
+	 * modulo RES_FRAME_COUNT kept if it doesn't fit. */
+	uint16_t depth;
+	/** The id of the site the error was created at. */
+	res_site_id_t site;
+	res_site_id_t frames[RES_FRAME_COUNT];
+} res_log_record_t;
+
+_Static_assert(sizeof(res_log_record_t) == RES_CACHE_LINE, "A log record must fill a cache line");
+
+/** The parts of a mapped binary log. */
+typedef struct res_log {
+	res_log_header_t *header;
+	res_log_site_t *sites;
+	/** The message table, offsets into the string area plus one, 0 if unknown. */
+	_Atomic uint32_t *msgs;
+	char *strings;
+	res_log_record_t *records;
+	/** The size of the mapping. */
+	size_t size;
+} res_log_t;
 
 /** Error struct for storing all the error information. */
 typedef struct err {
 	const char *msg;
-	res_err_info_t err_info;
+	const res_err_info_t *err_info;
+	/** The return address of the failed call if it was made without
+	 * error information, resolved only when the error is printed. */
+	const void *caller;
+	/** The number of times the error was propagated. */
+	uint32_t depth;
+	/** The sites the error was propagated through. A ring that keeps the
+	 * last RES_FRAME_COUNT frames, frame i is at i % RES_FRAME_COUNT. */
+	res_site_id_t frames[RES_FRAME_COUNT];
 } err_t;
 
-/** Generic result struct. */
+_Static_assert(sizeof(err_t) <= RES_CLASS_MIN_SIZE << 2,
+	"err_t has to fit into the second size class");
+
+/** Generic result struct. Only used where a single result object of any
+ * size has to be stored, such as the fallback. The state comes first, so
+ * checking it touches the cache line of the start of the value. */
 typedef struct res {
+	RES_ATOMIC(res_state_t) state;
 	union {
 		alignas(max_align_t) unsigned char ok[OK_BUFF_SIZE];
 		err_t err;
 	};
-	res_state_t state;
 } res_t;
 
-/** Buffer to store the generic result structs in. */
-extern res_t g_res_buff[RES_BUFF_SIZE];
-/** The number of currently active result objects. */
-extern size_t g_res_count;
-/** Buffer to store the id-s of result objects ready to be reused. */
-extern size_t g_free_buff[FREE_BUFF_SIZE];
-/** The number of currently active result objects ready to be reused. */
-extern size_t g_free_count;
-/** Fallback result object to be used when g_res_buff is full and g_free_count is 0. */
-extern res_t g_res_fallback;
-/** The id for the fallback result object. */
-extern const size_t g_fallback_id;
-/** Mutex object. */
+#ifndef RES_NO_STATS
+/** Counters of the runtime statistics. Each counter has its own cache line
+ * so threads bumping different counters don't slow each other down. */
+typedef struct res_counters {
+	alignas(RES_CACHE_LINE) _Atomic size_t fallbacks;
+	alignas(RES_CACHE_LINE) _Atomic size_t errors_created;
+	alignas(RES_CACHE_LINE) _Atomic size_t errors_propagated;
+	alignas(RES_CACHE_LINE) _Atomic size_t mutex_contentions;
+	alignas(RES_CACHE_LINE) _Atomic size_t reports_suppressed;
+} res_counters_t;
+#endif
+
+/** Mask of the region slots in use. Bit 0 stands for the pools outside of
+ * any region and is never set. */
+extern alignas(RES_CACHE_LINE) RES_TLS RES_ATOMIC(size_t) g_res_regions_used;
+/** The configuration of the pools. */
+extern res_config_t g_res_config;
+/** The interned sites of propagation frames. Shared by all threads. */
+extern res_site_t g_res_sites[RES_SITE_COUNT];
+/** The modules whose site descriptors are registered. */
+extern res_module_t g_res_modules[RES_MODULE_COUNT];
+/** The number of registered modules. */
+extern size_t g_res_module_count;
+/** Set once a chunk is allocated on demand, after which the configuration
+ * can no longer be changed. */
+extern _Atomic int g_res_config_locked;
+/** Fallback result object of the calling thread. Holds the error of the
+ * last failed call on the thread until it is deleted. */
+extern _Thread_local res_t g_res_fallback;
+/** Mutex object. Guards g_res_modules and, if RES_THREAD_LOCAL is defined,
+ * the shared pool and g_res_owners. */
 extern pthread_mutex_t g_mutex;
+#ifdef RES_THREAD_LOCAL
+/** The chunks of the shared pool, which holds the result structs handed
+ * over between threads. Chunk k holds res_chunk_slots(k) structs like the
+ * chunks of a result pool, so a struct never moves. */
+extern res_t *g_shared_chunks[RES_MAX_CHUNKS];
+/** The number of structs of the shared pool ever used. */
+extern size_t g_shared_count;
+/** The first free struct of the shared pool or g_res_fallback_id if there
+ * is none. A free struct keeps the index of the next one in its OK value. */
+extern size_t g_shared_free;
+/** The owners taken by the threads alive, one bit each. */
+extern uint64_t g_res_owners[RES_OWNER_COUNT / 64];
+#endif
+#ifndef RES_NO_STATS
+/** Counters of the runtime statistics. */
+extern res_counters_t g_res_counters;
+#endif
+/** The queue of the reports waiting for the background writer thread. */
+extern res_queue_t g_res_queue;
+/** The rate limiters of the reports of each site. Limiter 0 is shared by
+ * the sites that didn't fit the site table. */
+extern res_limit_t g_res_limits[RES_SITE_COUNT];
+/** The rate limiters of the reports of failed calls made without error
+ * information, keyed by their return address. */
+extern res_limit_t g_res_caller_limits[RES_CALLER_COUNT];
+/** Set when a site has suppressed errors that are not summarized yet. */
+extern _Atomic int g_res_limit_pending;
+/** The binary log errors are printed into, its header is NULL if closed. */
+extern res_log_t g_res_log;
+/** The messages interned into the binary log, indexed by the message id. */
+extern _Atomic(const char *) g_res_log_msgs[RES_LOG_MSG_COUNT];
+/** The id of the result object taken last by the calling thread, whose
+ * memory is released by the next take, or g_res_fallback_id. */
+extern _Thread_local size_t g_res_taken;
 #ifdef TEST
 /** Flag for testing functions that print fallback error. */
 extern int g_is_fallback_error_printed;
 /** Flag for testing functions that print normal error. */
 extern int g_is_error_printed;
+/** Called after a result object is copied and before the copy is
+ * validated, to change it meanwhile. Can be NULL. */
+extern void (*g_res_copied_hook)(size_t id);
 #endif
 
+/** The size class of error results. */
+#define RES_ERR_CLASS res_size_class(sizeof(err_t))
+
+/** Returns the size of the chunk in bytes.
+ * \param c The size class of the pool.
+ * \param k The chunk. */
+static inline size_t chunk_bytes(size_t c, size_t k) {
+	return res_chunk_data_offset(k) + res_chunk_slots(k) * RES_CLASS_SIZE(c);
+}
+
+/** Allocates the chunk holding the index unless it already exists. Racing
+ * callers allocate their own chunk, the loser of the CAS frees it.
+ * \param pool The pool.
+ * \param index The index of the result object.
+ * \return 0 on success, 1 if the allocation failed. */
+static inline int reserve_chunk(res_pool_t *pool, size_t index) {
+	size_t k = res_chunk_of(index);
+	if (RES_LOAD(&pool->chunks[k], memory_order_acquire)) return 0;
+	size_t c = (size_t)(pool - g_res_pools) % RES_CLASS_COUNT;
+	size_t bytes = chunk_bytes(c, k);
+	unsigned char *chunk = g_res_config.alloc(bytes);
+	if (!chunk) return 1;
+	memset(chunk, 0, bytes);
+	unsigned char *expected = NULL;
+	if (!RES_CAS(
+		&pool->chunks[k], &expected, chunk, memory_order_acq_rel, memory_order_acquire)
+	) g_res_config.free(chunk, bytes);
+	return 0;
+}
+
+/** Frees the chunks of all pools of the calling thread, including the
+ * pools of its regions, and resets the pools. */
+static inline void free_pools() {
+	for (size_t p = 0; p < RES_POOL_COUNT; p++) {
+		for (size_t k = 0; k < RES_MAX_CHUNKS; k++) {
+			unsigned char *chunk = RES_LOAD(&g_res_pools[p].chunks[k], memory_order_relaxed);
+			if (chunk) g_res_config.free(chunk, chunk_bytes(p % RES_CLASS_COUNT, k));
+		}
+	}
+	memset(g_res_pools, 0, sizeof(g_res_pools));
+}
+
+/** Allocates the chunks of all pools of the calling thread needed
+ * to hold the initial capacity. The pools of regions grow on demand.
+ * \return 0 on success, 1 if an allocation failed. */
+static inline int reserve_pools() {
+	size_t capacity = g_res_config.initial_capacity;
+	for (size_t c = 0; c < RES_CLASS_COUNT; c++) {
+		for (size_t k = 0; capacity && k <= res_chunk_of(capacity - 1); k++) {
+			if (reserve_chunk(&g_res_pools[c], res_chunk_start(k))) return 1;
+		}
+	}
+	return 0;
+}
+
+/** Allocates memory with mmap.
+ * \param size The size of the memory.
+ * \return Pointer to the memory or NULL on failure. */
+static inline void *mmap_alloc(size_t size) {
+	void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+/** Frees memory allocated with mmap_alloc.
+ * \param ptr Pointer to the memory.
+ * \param size The size of the memory. */
+static inline void mmap_free(void *ptr, size_t size) {
+	munmap(ptr, size);
+}
+
+/** Writes a batch of reports to stderr with a single writev, resuming
+ * after partial writes and interrupts. The default sink.
+ * \param reports The reports.
+ * \param count The number of reports, at most RES_BATCH_SIZE + 1. */
+static inline void writev_sink(const struct iovec *reports, size_t count) {
+	struct iovec iov[RES_BATCH_SIZE + 1];
+	if (count > RES_BATCH_SIZE + 1) count = RES_BATCH_SIZE + 1;
+	memcpy(iov, reports, count * sizeof(struct iovec));
+	size_t i = 0;
+	while (i < count) {
+		ssize_t n = writev(STDERR_FILENO, iov + i, (int)(count - i));
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+		size_t done = (size_t)n;
+		while (i < count && done >= iov[i].iov_len) done -= iov[i++].iov_len;
+		if (i < count) {
+			iov[i].iov_base = (char *)iov[i].iov_base + done;
+			iov[i].iov_len -= done;
+		}
+	}
+}
+
 /** Resets global variables to their default states. */
 static inline void reset_globals() {
-	memset(g_res_buff, 0, RES_BUFF_SIZE * sizeof(res_t));
-	memset(g_free_buff, 0, FREE_BUFF_SIZE * sizeof(size_t));
+	free_pools();
+#ifdef RES_THREAD_LOCAL
+	for (size_t k = 0; k < RES_MAX_CHUNKS; k++) {
+		if (g_shared_chunks[k]) g_res_config.free(g_shared_chunks[k], res_chunk_slots(k) * sizeof(res_t));
+	}
+	memset(g_shared_chunks, 0, sizeof(g_shared_chunks));
+	g_shared_count = 0;
+	g_shared_free = g_res_fallback_id;
+#endif
+	g_res_config = (res_config_t){
+		.initial_capacity = RES_BUFF_SIZE,
+		.max_capacity = RES_MAX_CAPACITY,
+		.alloc = mmap_alloc,
+		.free = mmap_free,
+		.sink = writev_sink,
+		.report_burst = RES_REPORT_BURST,
+		.report_window = RES_REPORT_WINDOW
+	};
+	g_res_config_locked = 0;
+	if (reserve_pools()) abort();
 	memset(&g_res_fallback, 0, sizeof(res_t));
-	g_res_count = 0;
-	g_free_count = 0;
+	g_res_taken = g_res_fallback_id;
 	g_res_fallback.state = RES_STATE_INVALID;
+	memset(g_res_region_epochs, 0, sizeof(g_res_region_epochs));
+	g_res_regions_used = 0;
+	g_res_region = 0;
+	memset(g_res_sites, 0, sizeof(g_res_sites));
+	memset(&g_res_queue, 0, sizeof(g_res_queue));
+	memset(g_res_limits, 0, sizeof(g_res_limits));
+	memset(g_res_caller_limits, 0, sizeof(g_res_caller_limits));
+	g_res_limit_pending = 0;
+	res_log_close();
+#ifndef RES_NO_STATS
+	memset(&g_res_counters, 0, sizeof(g_res_counters));
+#endif
 #ifdef TEST
 	g_is_fallback_error_printed = 0;
 	g_is_error_printed = 0;
+	g_res_copied_hook = NULL;
 #endif
 }
 
-/** Creates a new result id and either increments g_res_count or 
- * decrements g_free_count by one.
- * \return The new result id.*/
-static inline size_t set_id() {
-	size_t id = g_fallback_id;
-	if (g_free_count) {
-		id = g_free_buff[g_free_count - 1];
-		g_free_count--;
+/** Returns the error struct of the result object. The id has to be in range.
+ * \param id The id of the result object.
+ * \return Pointer to the error struct. */
+static inline err_t *get_err(size_t id) {
+	return (err_t *)(void *)res_get_data(id);
+}
+
+/** Returns the state of the result object.
+ * \param id The id of the result object.
+ * \return The state or RES_STATE_INVALID if the id is out of range
+ * or stale. */
+static inline res_state_t get_state(size_t id) {
+	res_pool_t *pool = res_get_pool(id);
+	if (!pool) return RES_STATE_INVALID;
+	uint32_t tag = RES_LOAD(res_tag_of(pool, res_id_index(id)), memory_order_acquire);
+	if (res_tag_gen(tag) != res_id_gen(id)) return RES_STATE_INVALID;
+	return (res_state_t)(tag & RES_STATE_MASK);
+}
+
+/** Creates up to n new indices in the pool by reusing free ones
+ * first and then by incrementing the count of the pool, with a single CAS
+ * each. The chunks holding new indices are allocated before the count is
+ * incremented with release order, so every index below a count loaded with
+ * acquire order is backed by memory.
+ * \param pool The pool.
+ * \param n The number of indices to create.
+ * \param indices Set to the new indices.
+ * \return The number of indices created. It is less than n only if the pool is full. */
+static inline size_t set_ids(res_pool_t *pool, size_t n, size_t *indices) {
+	size_t taken = res_claim_free_ids(pool, n, indices);
+	size_t count = RES_LOAD(&pool->count, memory_order_relaxed);
+	while (taken < n && count < g_res_config.max_capacity) {
+		size_t end = count + (n - taken);
+		if (end > g_res_config.max_capacity) end = g_res_config.max_capacity;
+		for (size_t index = count; index < end; index = res_chunk_start(res_chunk_of(index) + 1)) {
+			if (res_get_chunk(pool, index)) continue;
+			if (!g_res_config_locked) g_res_config_locked = 1;
+			if (reserve_chunk(pool, index)) {
+				end = index;
+				break;
+			}
+		}
+		if (end == count) break;
+		if (RES_CAS(
+			&pool->count, &count, end, memory_order_release, memory_order_relaxed)
+		) {
+			while (count < end) indices[taken++] = count++;
+			break;
+		}
+	}
+	return taken + res_claim_free_ids(pool, n - taken, indices + taken);
+}
+
+/** Creates a new index in the pool.
+ * \param pool The pool.
+ * \return The new index or g_res_fallback_id if the pool is full. */
+static inline size_t set_id(res_pool_t *pool) {
+	size_t index = res_claim_free_id(pool);
+	if (index != g_res_fallback_id) return index;
+	return set_ids(pool, 1, &index) ? index : g_res_fallback_id;
+}
+
+/** Locks g_mutex and counts the contention if it is already locked. */
+static inline void lock_mutex() {
+	if (!pthread_mutex_trylock(&g_mutex)) return;
+	RES_STAT_INC(mutex_contentions);
+	pthread_mutex_lock(&g_mutex);
+}
+
+/** Stores the error in the fallback of the calling thread. The fallback
+ * is never touched by another thread, so no synchronization is needed.
+ * \param err The error to be stored.
+ * \param msg The error message. */
+static inline void set_fallback(err_t err, const char *msg) {
+	err.msg = msg;
+	RES_STAT_INC(fallbacks);
+	g_res_fallback.err = err;
+	g_res_fallback.state = RES_STATE_ERR;
+}
+
+/** Checks if the id refers to the fallback of the calling thread
+ * while it holds an error.
+ * \param id The id of the result object. */
+static inline int is_fallback_set(size_t id) {
+	return id == g_res_fallback_id && g_res_fallback.state == RES_STATE_ERR;
+}
+
+/** Appends formatted text to a report, truncating it if it doesn't fit.
+ * \param buf The report.
+ * \param size The size of buf.
+ * \param len The current length of the report.
+ * \param fmt The printf format of the text.
+ * \return The new length of the report. */
+__attribute__((format(printf, 4, 5)))
+static inline size_t append_report(char *buf, size_t size, size_t len, const char *fmt, ...) {
+	if (len + 1 >= size) return len;
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(buf + len, size - len, fmt, args);
+	va_end(args);
+	if (n < 0) return len;
+	return len + (size_t)n < size ? len + (size_t)n : size - 1;
+}
+
+/** Returns the round of the report queue a ticket belongs to, doubled.
+ * \param ticket The ticket. */
+static inline size_t report_round(size_t ticket) {
+	return ticket / RES_QUEUE_SIZE * 2;
+}
+
+/** Claims a slot of the report queue. Lock-free.
+ * \param q The report queue.
+ * \return The slot or NULL if the queue is full. */
+static inline res_report_t *claim_report(res_queue_t *q) {
+	size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	for (;;) {
+		res_report_t *r = &q->reports[tail % RES_QUEUE_SIZE];
+		size_t seq = atomic_load_explicit(&r->seq, memory_order_acquire);
+		size_t round = report_round(tail);
+		if (seq == round) {
+			if (atomic_compare_exchange_weak_explicit(
+				&q->tail, &tail, tail + 1, memory_order_relaxed, memory_order_relaxed)
+			) return r;
+		} else if (seq < round) {
+			return NULL;
+		} else {
+			tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+		}
+	}
+}
+
+/** Publishes a report written into a claimed slot to the consumer.
+ * \param r The slot. */
+static inline void publish_report(res_report_t *r) {
+	atomic_store_explicit(&r->seq,
+		atomic_load_explicit(&r->seq, memory_order_relaxed) + 1, memory_order_release);
+}
+
+/** Hands the published reports to the sink in batches and frees their
+ * slots. Reports dropped since the last drain are reported after the batch
+ * they were dropped next to. Only one thread may drain at a time.
+ * \param q The report queue.
+ * \param sink The sink.
+ * \return The number of reports drained. */
+static inline size_t drain_reports(res_queue_t *q, void (*sink)(const struct iovec *, size_t)) {
+	size_t total = 0;
+	for (;;) {
+		struct iovec iov[RES_BATCH_SIZE + 1];
+		char notice[64];
+		size_t n = 0;
+		while (n < RES_BATCH_SIZE) {
+			res_report_t *r = &q->reports[(q->head + n) % RES_QUEUE_SIZE];
+			if (atomic_load_explicit(&r->seq, memory_order_acquire) != report_round(q->head + n) + 1)
+				break;
+			iov[n++] = (struct iovec){r->text, r->size};
+		}
+		size_t count = n;
+		size_t dropped = atomic_load_explicit(&q->dropped, memory_order_relaxed);
+		if (dropped != q->reported) {
+			int len = snprintf(notice, sizeof(notice),
+				"[DROPPED]:\n\tReports: %zu\n", dropped - q->reported);
+			iov[count++] = (struct iovec){notice, (size_t)len};
+			q->reported = dropped;
+		}
+		if (!count) return total;
+		sink(iov, count);
+		for (size_t i = 0; i < n; i++, q->head++)
+			atomic_store_explicit(&q->reports[q->head % RES_QUEUE_SIZE].seq,
+				report_round(q->head) + 2, memory_order_release);
+		total += n;
+		if (n < RES_BATCH_SIZE) return total;
+	}
+}
+
+/** Returns the monotonic time in nanoseconds. */
+static inline uint64_t monotonic_ns() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/** Decides whether an error of a site is reported. Lock-free: the window
+ * is restarted by a CAS and the errors are counted with a fetch-add, so the
+ * cost stays constant during an error flood. The suppressed errors are
+ * handed to exactly one caller by an exchange, so none of them is lost.
+ * \param limit The rate limiter of the site.
+ * \param now The monotonic time in nanoseconds.
+ * \param suppressed Set to the number of errors suppressed since the last
+ * summary if the error is reported.
+ * \return 1 if the error is reported, 0 if it is suppressed. */
+static inline int limit_report(res_limit_t *limit, uint64_t now, uint64_t *suppressed) {
+	uint64_t window = atomic_load_explicit(&limit->window, memory_order_relaxed);
+	if (
+		now - window >= g_res_config.report_window * 1000000u &&
+		atomic_compare_exchange_strong_explicit(
+			&limit->window, &window, now, memory_order_relaxed, memory_order_relaxed)
+	) atomic_store_explicit(&limit->count, 0, memory_order_relaxed);
+	if (atomic_fetch_add_explicit(&limit->count, 1, memory_order_relaxed) < g_res_config.report_burst) {
+		*suppressed = atomic_exchange_explicit(&limit->suppressed, 0, memory_order_relaxed);
+		return 1;
+	}
+	atomic_fetch_add_explicit(&limit->suppressed, 1, memory_order_relaxed);
+	RES_STAT_INC(reports_suppressed);
+	if (!atomic_load_explicit(&g_res_limit_pending, memory_order_relaxed))
+		atomic_store_explicit(&g_res_limit_pending, 1, memory_order_relaxed);
+	return 0;
+}
+
+/** Queues the summary of the errors suppressed by a rate limiter. If the
+ * queue is full, the errors are given back to the limiter to be summarized
+ * later.
+ * \param limit The rate limiter.
+ * \param site The descriptor of the site of the limiter, NULL for the
+ * limiters of callers and the shared limiter of sites.
+ * \param count The number of suppressed errors.
+ * \return 0 on success, 1 if the queue is full. */
+static inline int queue_summary(res_limit_t *limit, const res_err_info_t *site, uint64_t count) {
+	res_report_t *r = claim_report(&g_res_queue);
+	if (!r) {
+		atomic_fetch_add_explicit(&limit->suppressed, count, memory_order_relaxed);
+		atomic_store_explicit(&g_res_limit_pending, 1, memory_order_relaxed);
+		return 1;
+	}
+	const void *caller = atomic_load_explicit(&limit->caller, memory_order_relaxed);
+	if (!site && caller) {
+		r->size = append_report(r->text, RES_REPORT_SIZE, 0,
+			"[SUPPRESSED]:\n\tSimilar errors: %lu\n\tCaller: %p\n",
+			(unsigned long)count, caller);
 	} else {
-		id = g_res_count;
-		g_res_count++;
+		res_err_info_t info = site ? *site : (res_err_info_t){"<unknown>", "<unknown>", 0};
+		r->size = append_report(r->text, RES_REPORT_SIZE, 0,
+			"[SUPPRESSED]:\n\tSimilar errors: %lu\n\tFile: %s\n\tFunction: %s\n\tLine: %d\n",
+			(unsigned long)count, info.file, info.func, info.line);
 	}
-	return id;
+	publish_report(r);
+	return 0;
 }
 
-/** Prints the error information.
- * \param e The error struct whose content is to be printed. */
-static inline void print_err(err_t e) {
-	fprintf(stderr, "[ERROR]:\n\tMessage: %s\n\tFile: %s\n\tFunction: %s\n\tLine: %d\n", 
-			e.msg, e.err_info.file, e.err_info.func, e.err_info.line);
+/** Queues the summary of a rate limiter whose suppressed errors are not
+ * summarized yet.
+ * \param limit The rate limiter.
+ * \param site The descriptor of the site of the limiter or NULL.
+ * \param now The monotonic time in nanoseconds.
+ * \param force Whether to summarize the limiter if its window is still open.
+ * \return 0 on success, 1 if the queue is full. */
+static inline int summarize_limit(res_limit_t *limit, const res_err_info_t *site, uint64_t now, int force) {
+	if (!atomic_load_explicit(&limit->suppressed, memory_order_relaxed)) return 0;
+	uint64_t window = atomic_load_explicit(&limit->window, memory_order_relaxed);
+	if (!force && now - window < g_res_config.report_window * 1000000u) {
+		atomic_store_explicit(&g_res_limit_pending, 1, memory_order_relaxed);
+		return 0;
+	}
+	uint64_t count = atomic_exchange_explicit(&limit->suppressed, 0, memory_order_relaxed);
+	return count && queue_summary(limit, site, count);
+}
+
+/** Queues the summaries of the sites and callers whose suppressed errors
+ * are not summarized yet. The limiters are only scanned if any of them is
+ * pending.
+ * \param now The monotonic time in nanoseconds.
+ * \param force Whether to summarize the limiters whose window is still open. */
+static inline void summarize_suppressed(uint64_t now, int force) {
+	if (!atomic_exchange_explicit(&g_res_limit_pending, 0, memory_order_relaxed)) return;
+	for (size_t id = 0; id < RES_SITE_COUNT; id++) {
+		const res_err_info_t *site = atomic_load_explicit(&g_res_sites[id], memory_order_relaxed);
+		if (summarize_limit(&g_res_limits[id], site, now, force)) return;
+	}
+	for (size_t i = 0; i < RES_CALLER_COUNT; i++)
+		if (summarize_limit(&g_res_caller_limits[i], NULL, now, force)) return;
+}
+
+/** Returns the hash of a pointer. Every site has its own static descriptor
+ * and every message its own literal, so their address identifies them.
+ * \param ptr The pointer. */
+static inline size_t hash_ptr(const void *ptr) {
+	size_t hash = (size_t)(uintptr_t)ptr * (size_t)0x9e3779b97f4a7c15u;
+	return hash ^ (hash >> 29);
+}
+
+/** Interns a site into the site table. Lock-free: an empty entry is
+ * claimed by a CAS of the descriptor pointer, so a site is looked up with
+ * a single relaxed load per probe.
+ * \param info The descriptor of the site.
+ * \return The id of the site or 0 if the table is full or info is NULL. */
+static inline res_site_id_t intern_site(const res_err_info_t *info) {
+	if (!info) return 0;
+	size_t hash = hash_ptr(info);
+	for (size_t i = 0; i < RES_SITE_COUNT - 1; i++) {
+		size_t id = 1 + (hash + i) % (RES_SITE_COUNT - 1);
+		const res_err_info_t *site = atomic_load_explicit(&g_res_sites[id], memory_order_relaxed);
+		if (!site && atomic_compare_exchange_strong_explicit(
+			&g_res_sites[id], &site, info, memory_order_relaxed, memory_order_relaxed)
+		) return (res_site_id_t)id;
+		if (site == info) return (res_site_id_t)id;
+	}
+	return 0;
+}
+
+/** Returns the rate limiter of the failed calls made without error
+ * information at a caller. Lock-free like intern_site: an empty limiter is
+ * claimed by a CAS of the caller.
+ * \param caller The return address of the failed call.
+ * \return The limiter, or the shared limiter 0 if caller is NULL or the
+ * table is full. */
+static inline res_limit_t *caller_limit(const void *caller) {
+	if (!caller) return &g_res_caller_limits[0];
+	size_t hash = hash_ptr(caller);
+	for (size_t i = 0; i < RES_CALLER_COUNT - 1; i++) {
+		res_limit_t *limit = &g_res_caller_limits[1 + (hash + i) % (RES_CALLER_COUNT - 1)];
+		const void *key = atomic_load_explicit(&limit->caller, memory_order_relaxed);
+		if (!key && atomic_compare_exchange_strong_explicit(
+			&limit->caller, &key, caller, memory_order_relaxed, memory_order_relaxed)
+		) return limit;
+		if (key == caller) return limit;
+	}
+	return &g_res_caller_limits[0];
+}
+
+/** Returns the rate limiter of an error: the limiter of its site if it has
+ * error information, otherwise the limiter of its caller, so unrelated
+ * call sites never throttle each other.
+ * \param err The error.
+ * \param site Set to the descriptor of the site of the limiter or NULL.
+ * \return The limiter. */
+static inline res_limit_t *limit_of(const err_t *err, const res_err_info_t **site) {
+	*site = NULL;
+	if (!err->err_info) return caller_limit(err->caller);
+	res_site_id_t id = intern_site(err->err_info);
+	if (id) *site = err->err_info;
+	return &g_res_limits[id];
+}
+
+/** Appends a propagation frame to the error.
+ * \param err The error.
+ * \param err_info The site the error is propagated through. */
+static inline void append_frame(err_t *err, const res_err_info_t *err_info) {
+	err->frames[err->depth % RES_FRAME_COUNT] = intern_site(err_info);
+	err->depth++;
+}
+
+/** Copies a string into the string area of a binary log. Lock-free.
+ * \param log The binary log.
+ * \param str The string.
+ * \return The offset of the string plus one or 0 if the area is full. */
+static inline uint32_t log_string(res_log_t *log, const char *str) {
+	size_t len = strlen(str) + 1;
+	uint64_t off = atomic_fetch_add_explicit(&log->header->strings_used, len, memory_order_relaxed);
+	if (off + len > log->header->strings_size) return 0;
+	memcpy(log->strings + off, str, len);
+	return (uint32_t)off + 1;
+}
+
+/** Writes a site into the site table of a binary log unless it is already
+ * there. The first thread to claim the entry writes it, the others go on.
+ * \param log The binary log.
+ * \param id The id of the site. */
+static inline void log_site(res_log_t *log, res_site_id_t id) {
+	res_log_site_t *entry = &log->sites[id];
+	uint32_t state = 0;
+	if (!id || atomic_load_explicit(&entry->state, memory_order_relaxed)) return;
+	if (!atomic_compare_exchange_strong_explicit(
+		&entry->state, &state, 1, memory_order_relaxed, memory_order_relaxed)
+	) return;
+	const res_err_info_t *info = atomic_load_explicit(&g_res_sites[id], memory_order_relaxed);
+	if (info) {
+		entry->file = log_string(log, info->file);
+		entry->func = log_string(log, info->func);
+		entry->line = info->line;
+	}
+	atomic_store_explicit(&entry->state, 2, memory_order_release);
+}
+
+/** Interns a message into the message table of a binary log. Lock-free:
+ * the first thread to claim the entry of the message copies it into the
+ * string area, so a message is copied once.
+ * \param log The binary log.
+ * \param msg The message.
+ * \return The id of the message or 0 if the table is full or msg is NULL. */
+static inline uint32_t log_msg(res_log_t *log, const char *msg) {
+	if (!msg) return 0;
+	size_t hash = hash_ptr(msg);
+	for (size_t i = 0; i < RES_LOG_MSG_COUNT - 1; i++) {
+		size_t id = 1 + (hash + i) % (RES_LOG_MSG_COUNT - 1);
+		const char *key = atomic_load_explicit(&g_res_log_msgs[id], memory_order_relaxed);
+		if (!key && atomic_compare_exchange_strong_explicit(
+			&g_res_log_msgs[id], &key, msg, memory_order_relaxed, memory_order_relaxed)
+		) {
+			atomic_store_explicit(&log->msgs[id], log_string(log, msg), memory_order_release);
+			return (uint32_t)id;
+		}
+		if (key == msg) return (uint32_t)id;
+	}
+	return 0;
+}
+
+/** Returns the id of the calling thread. */
+static inline uint32_t thread_id() {
+	static _Thread_local uint32_t tid;
+	if (!tid) tid = (uint32_t)syscall(SYS_gettid);
+	return tid;
+}
+
+/** Writes an error as a record into a binary log. Nothing is formatted:
+ * the sites and the message are written once and referred to by id.
+ * \param log The binary log.
+ * \param err The error. */
+static inline void log_err(res_log_t *log, err_t err) {
+	uint64_t ticket = atomic_fetch_add_explicit(&log->header->head, 1, memory_order_relaxed);
+	res_log_record_t *r = &log->records[ticket % log->header->capacity];
+	atomic_store_explicit(&r->seq, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	r->time = (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+	r->thread = thread_id();
+	r->msg = log_msg(log, err.msg);
+	r->site = intern_site(err.err_info);
+	log_site(log, r->site);
+	uint32_t depth = err.depth;
+	if (depth > UINT16_MAX)
+		depth = UINT16_MAX - (UINT16_MAX - depth % RES_FRAME_COUNT) % RES_FRAME_COUNT;
+	r->depth = (uint16_t)depth;
+	for (size_t i = 0; i < RES_FRAME_COUNT; i++) {
+		r->frames[i] = i < err.depth ? err.frames[i] : 0;
+		log_site(log, r->frames[i]);
+	}
+	atomic_store_explicit(&r->seq, ticket + 1, memory_order_release);
 }
 
 #endif
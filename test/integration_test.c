@@ -15,6 +15,20 @@ RES(void) call_divide(int dividend, int divisor) {
 	return OK_VOID();
 }
 
+/** Number of times next_divide was called. */
+static int g_divide_calls;
+
+RES(float) next_divide(int dividend, int divisor) {
+	g_divide_calls++;
+	return divide(dividend, divisor);
+}
+
+RES(void) call_next_divide(int dividend, int divisor) {
+	float quotient = 0;
+	TRY(float, next_divide(dividend, divisor), &quotient, void);
+	return OK_VOID();
+}
+
 void integration_test() {
 	reset_globals();
 	g_is_exit_called = 0;
@@ -37,4 +51,18 @@ void integration_test() {
 	quotient = 0.0f;
 	UNW(float,  divide(10, 0), &quotient);
 	ASSERT(g_is_exit_called);
+
+	reset_globals();
+	g_divide_calls = 0;
+	res_void_t res = call_next_divide(10, 0);
+	ASSERT(g_divide_calls == 1);
+	ASSERT(get_state(res.id) == RES_STATE_ERR);
+	ASSERT(g_res_pools[RES_ERR_CLASS].count - g_res_pools[RES_ERR_CLASS].free_count == 1);
+	res_void_del(res, ERRINFO);
+
+	reset_globals();
+	g_divide_calls = 0;
+	ASSERT(call_next_divide(10, 5).id == RES_INLINE_ID);
+	ASSERT(g_divide_calls == 1);
+	reset_globals();
 }
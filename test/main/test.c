@@ -9,6 +9,7 @@ int main(void) {
 	test_typedef();
 	test_void();
 	integration_test();
+	test_stress();
 
 	print_results();
 	return 0;
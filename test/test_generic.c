@@ -1,42 +1,238 @@
 #include "test_utils.h"
+#include <fcntl.h>
+#include <sys/stat.h>
 
 void test_reset_globals() {
-	g_res_buff[RES_BUFF_SIZE / 2].state = RES_STATE_OK;
-	g_res_count = RES_BUFF_SIZE;
-	g_free_buff[FREE_BUFF_SIZE / 2] = 4;
-	g_free_count = FREE_BUFF_SIZE;
+	reset_globals();
+	*res_tag_of(&g_res_pools[1], RES_BUFF_SIZE / 2) = RES_STATE_OK;
+	g_res_pools[1].count = RES_BUFF_SIZE;
+	*res_free_word_of(&g_res_pools[1], RES_BUFF_SIZE / 2) = 4;
+	g_res_pools[1].free_count = RES_BUFF_SIZE;
+	g_res_pools[1].free_hint = 5;
+	res_get_data(res_make_id(RES_CLASS_COUNT - 1, RES_BUFF_SIZE - 1, 0))[OK_BUFF_SIZE - 1] = 1;
+	g_res_config.max_capacity = 1;
+	g_res_config_locked = 1;
 	g_res_fallback.err.msg = "msg";
 	g_res_fallback.err.err_info = ERRINFO;
 	g_res_fallback.state = RES_STATE_ERR;
 	g_is_fallback_error_printed = 1;
 	g_is_error_printed = 1;
 	reset_globals();
-	ASSERT(!g_res_buff[RES_BUFF_SIZE / 2].state);
-	ASSERT(!g_free_buff[RES_BUFF_SIZE / 2]);
+	ASSERT(!*res_tag_of(&g_res_pools[1], RES_BUFF_SIZE / 2));
+	ASSERT(!*res_free_word_of(&g_res_pools[1], RES_BUFF_SIZE / 2));
+	ASSERT(!res_get_data(res_make_id(RES_CLASS_COUNT - 1, RES_BUFF_SIZE - 1, 0))[OK_BUFF_SIZE - 1]);
+	ASSERT(g_res_config.initial_capacity == RES_BUFF_SIZE);
+	ASSERT(g_res_config.max_capacity == RES_MAX_CAPACITY);
+	ASSERT(!g_res_config_locked);
 	ASSERT(!g_res_fallback.err.msg);
-	ASSERT(!g_res_fallback.err.err_info.file);
-	ASSERT(!g_res_fallback.err.err_info.func);
-	ASSERT(!g_res_fallback.err.err_info.line);
-	ASSERT(!g_res_count);
-	ASSERT(!g_free_count);
+	ASSERT(!g_res_fallback.err.err_info);
+	ASSERT(!g_res_pools[1].count);
+	ASSERT(!g_res_pools[1].free_count);
+	ASSERT(!g_res_pools[1].free_hint);
 	ASSERT(g_res_fallback.state == RES_STATE_INVALID);
 	ASSERT(!g_is_fallback_error_printed);
 	ASSERT(!g_is_error_printed);
 	reset_globals();
 }
 
+void test_size_class() {
+	ASSERT(res_size_class(1) == 0);
+	ASSERT(res_size_class(16) == 0);
+	ASSERT(res_size_class(17) == 1);
+	ASSERT(res_size_class(64) == 1);
+	ASSERT(res_size_class(256) == 2);
+	ASSERT(res_size_class(OK_BUFF_SIZE) == RES_CLASS_COUNT - 1);
+	ASSERT(res_size_class(OK_BUFF_SIZE + 1) == RES_CLASS_COUNT);
+	ASSERT(RES_CLASS_SIZE(RES_ERR_CLASS) >= sizeof(err_t));
+}
+
+void test_chunks() {
+	ASSERT(res_chunk_of(0) == 0);
+	ASSERT(res_chunk_of(RES_CHUNK_SIZE - 1) == 0);
+	ASSERT(res_chunk_of(RES_CHUNK_SIZE) == 1);
+	ASSERT(res_chunk_of(RES_CHUNK_SIZE * 2 - 1) == 1);
+	ASSERT(res_chunk_of(RES_CHUNK_SIZE * 2) == 2);
+	ASSERT(res_chunk_of(RES_INDEX_MASK) == RES_MAX_CHUNKS - 1);
+	for (size_t k = 0; k < RES_MAX_CHUNKS; k++) {
+		ASSERT(res_chunk_of(res_chunk_start(k)) == k);
+		ASSERT(res_chunk_of(res_chunk_start(k) + res_chunk_slots(k) - 1) == k);
+	}
+	ASSERT(res_chunk_start(RES_MAX_CHUNKS - 1) + res_chunk_slots(RES_MAX_CHUNKS - 1) == RES_INDEX_MASK + 1);
+	ASSERT(!(res_chunk_data_offset(1) % RES_CACHE_LINE));
+	reset_globals();
+	// The data of consecutive result objects is adjacent within a chunk
+	ASSERT(res_get_data(res_make_id(1, 0, 0)) + RES_CLASS_SIZE(1) == res_get_data(res_make_id(1, 1, 0)));
+	ASSERT(!((uintptr_t)res_get_data(res_make_id(3, 0, 0)) % alignof(max_align_t)));
+	reset_globals();
+	// The hot fields of neighbouring pools and sites never share a cache line
+	ASSERT(offsetof(res_pool_t, free_count) >= offsetof(res_pool_t, count) + sizeof(size_t));
+	ASSERT(!(offsetof(res_pool_t, free_count) % RES_CACHE_LINE));
+	ASSERT(!(sizeof(res_pool_t) % RES_CACHE_LINE));
+	ASSERT(!((uintptr_t)&g_res_pools[1] % RES_CACHE_LINE));
+	ASSERT(sizeof(res_limit_t) == RES_CACHE_LINE);
+	ASSERT(!offsetof(res_t, state));
+}
+
+void test_growth() {
+	reset_globals();
+	{ // Ids and values stay valid while the pool grows
+		size_t ids[RES_BUFF_SIZE * 4];
+		for (size_t i = 0; i < RES_BUFF_SIZE * 4; i++) {
+			ids[i] = res_generic_ok(&i, alignof(size_t), sizeof(size_t), ERRINFO);
+			ASSERT(ids[i] == res_make_id(0, i, 0));
+		}
+		ASSERT(g_res_pools[0].count == RES_BUFF_SIZE * 4);
+		ASSERT(g_res_config_locked);
+		for (size_t i = 0; i < RES_BUFF_SIZE * 4; i++) {
+			size_t value = 0;
+			ASSERT(!res_generic_get_ok(ids[i], &value, sizeof(size_t), ERRINFO));
+			ASSERT(value == i);
+		}
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+	{ // Hard cap
+		g_res_config.max_capacity = RES_BUFF_SIZE + 1;
+		for (size_t i = 0; i <= RES_BUFF_SIZE; i++)
+			res_generic_err("msg", ERRINFO);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		ASSERT(res_generic_err("msg", ERRINFO) == g_res_fallback_id);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Not enough memory"));
+		ASSERT(g_res_pools[RES_ERR_CLASS].count == RES_BUFF_SIZE + 1);
+		reset_globals();
+	}
+}
+
+static size_t g_allocated;
+
+static void *test_alloc(size_t size) {
+	g_allocated += size;
+	return malloc(size);
+}
+
+static void test_free(void *ptr, size_t size) {
+	g_allocated -= size;
+	free(ptr);
+}
+
+void test_res_init() {
+	reset_globals();
+	{ // Custom allocator and capacities
+		res_config_t config = {
+			.initial_capacity = RES_CHUNK_SIZE * 2,
+			.max_capacity = RES_CHUNK_SIZE * 2,
+			.alloc = test_alloc,
+			.free = test_free
+		};
+		ASSERT(!res_init(&config));
+		size_t preallocated = 0;
+		for (size_t c = 0; c < RES_CLASS_COUNT; c++)
+			preallocated += chunk_bytes(c, 0) + chunk_bytes(c, 1);
+		ASSERT(g_allocated == preallocated);
+		for (size_t i = 0; i < RES_CHUNK_SIZE * 2; i++) {
+			ASSERT(res_generic_err("msg", ERRINFO) != g_res_fallback_id);
+		}
+		ASSERT(g_allocated == preallocated);
+		ASSERT(!g_res_config_locked);
+		ASSERT(res_generic_err("msg", ERRINFO) == g_res_fallback_id);
+		reset_globals();
+		ASSERT(!g_allocated);
+	}
+	{ // Defaults
+		ASSERT(!res_init(NULL));
+		ASSERT(g_res_config.initial_capacity == RES_BUFF_SIZE);
+		ASSERT(g_res_config.max_capacity == RES_MAX_CAPACITY);
+		ASSERT(g_res_config.alloc && g_res_config.free);
+		ASSERT(g_res_config.sink);
+		ASSERT(g_res_config.report_burst == RES_REPORT_BURST);
+		ASSERT(g_res_config.report_window == RES_REPORT_WINDOW);
+		reset_globals();
+	}
+	{ // Invalid configuration
+		ASSERT(res_init(&(res_config_t){.initial_capacity = 2, .max_capacity = 1}) == 1);
+		ASSERT(res_init(&(res_config_t){.max_capacity = RES_INDEX_MASK + 2}) == 1);
+		ASSERT(res_init(&(res_config_t){.alloc = test_alloc}) == 1);
+		ASSERT(res_init(&(res_config_t){.free = test_free}) == 1);
+		ASSERT(g_res_config.max_capacity == RES_MAX_CAPACITY);
+		reset_globals();
+	}
+	{ // Result objects already created
+		res_generic_err("msg", ERRINFO);
+		ASSERT(res_init(NULL) == 2);
+		reset_globals();
+		g_res_config_locked = 1;
+		ASSERT(res_init(NULL) == 2);
+		reset_globals();
+	}
+}
+
 void test_set_id() {
 	reset_globals();
-	size_t id = set_id();
-	ASSERT(id == 0);
-	ASSERT(g_res_count == 1);
-	ASSERT(g_free_count == 0);
+	res_pool_t *pool = &g_res_pools[0];
+	size_t index = set_id(pool);
+	ASSERT(index == 0);
+	ASSERT(pool->count == 1);
+	ASSERT(pool->free_count == 0);
+	reset_globals();
+	pool->count = 4;
+	res_free_index(pool, 3);
+	res_free_index(pool, 1);
+	ASSERT(pool->free_count == 2);
+	index = set_id(pool);
+	ASSERT(index == 1);
+	ASSERT(pool->free_count == 1);
+	index = set_id(pool);
+	ASSERT(index == 3);
+	ASSERT(pool->free_count == 0);
+	ASSERT(!*res_free_word_of(pool, 0));
 	reset_globals();
-	g_free_count = 2;
-	g_free_buff[1] = 1;
-	id = set_id();
-	ASSERT(id == 1);
-	ASSERT(g_free_count == 1);
+	g_res_config.max_capacity = RES_BUFF_SIZE;
+	pool->count = RES_BUFF_SIZE;
+	index = set_id(pool);
+	ASSERT(index == g_res_fallback_id);
+	ASSERT(pool->count == RES_BUFF_SIZE);
+	ASSERT(!g_res_pools[1].count);
+	reset_globals();
+}
+
+void test_free_bitmap() {
+	reset_globals();
+	ASSERT(res_word_start(5) == 0 && res_next_word(5) == 32);
+	ASSERT(res_word_start(40) == 32 && res_next_word(40) == 64);
+	ASSERT(res_word_start(70) == 64 && res_next_word(70) == 128);
+	res_pool_t *pool = &g_res_pools[0];
+	ASSERT(!reserve_chunk(pool, 99));
+	ASSERT(!reserve_chunk(pool, 40));
+	pool->count = 100;
+	ASSERT(res_claim_free_id(pool) == g_res_fallback_id);
+	res_free_index(pool, 2);
+	res_free_index(pool, 40);
+	res_free_index(pool, 70);
+	ASSERT(*res_free_word_of(pool, 40) == res_free_bit(40));
+	ASSERT(res_free_bit(40) == (uint64_t)1 << 8);
+	ASSERT(pool->free_count == 3);
+	size_t indices[10];
+	ASSERT(res_claim_free_ids(pool, 3, indices) == 3);
+	ASSERT(indices[0] == 70 && indices[1] == 2 && indices[2] == 40);
+	ASSERT(!pool->free_count);
+	ASSERT(!*res_free_word_of(pool, 2) && !*res_free_word_of(pool, 40) && !*res_free_word_of(pool, 70));
+	uint64_t mask = ((uint64_t)1 << 36) - 1;
+	res_free_bits(pool, 64, mask, 36);
+	ASSERT(res_claim_free_ids(pool, 10, indices) == 10);
+	ASSERT(indices[0] == 64 && indices[9] == 73);
+	ASSERT(*res_free_word_of(pool, 64) == (mask & ~(uint64_t)0x3ff));
+	ASSERT(pool->free_count == 26);
+	ASSERT(res_claim_free_ids(pool, 10, indices) == 10);
+	ASSERT(indices[0] == 74);
+	reset_globals();
+	ASSERT(!reserve_chunk(pool, 99));
+	pool->count = 100;
+	res_free_index(pool, 2);
+	res_free_index(pool, 70);
+	ASSERT(res_claim_free_id(pool) == 70);
+	ASSERT(res_claim_free_id(pool) == 2);
+	ASSERT(res_claim_free_id(pool) == g_res_fallback_id);
+	ASSERT(!pool->free_count);
 	reset_globals();
 }
 
@@ -45,68 +241,90 @@ void test_generic_ok() {
 	{ // Happy path
 		int value = 5;
 		size_t id = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
-		ASSERT(id == g_res_count - 1);
-		ASSERT((int)*g_res_buff[id].ok == value);
-		ASSERT(g_res_buff[id].state == RES_STATE_OK);
+		ASSERT(id == res_make_id(0, g_res_pools[0].count - 1, 0));
+		ASSERT(*(int *)(void *)res_get_data(id) == value);
+		ASSERT(get_state(id) == RES_STATE_OK);
 		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
 		reset_globals();
 	}
+	{ // Size classes
+		unsigned char value[OK_BUFF_SIZE] = {0};
+		value[OK_BUFF_SIZE - 1] = 7;
+		size_t id = res_generic_ok(value, 1, 17, ERRINFO);
+		ASSERT(id == res_make_id(1, 0, 0));
+		id = res_generic_ok(value, 1, 256, ERRINFO);
+		ASSERT(id == res_make_id(2, 0, 0));
+		id = res_generic_ok(value, 1, OK_BUFF_SIZE, ERRINFO);
+		ASSERT(id == res_make_id(3, 0, 0));
+		ASSERT(res_get_data(id)[OK_BUFF_SIZE - 1] == 7);
+		ASSERT(!g_res_pools[0].count);
+		reset_globals();
+	}
 	{ // No alignment
 		size_t id = res_generic_ok(NULL, 0, sizeof(int), ERRINFO);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(id == g_fallback_id);
-		ASSERT(g_res_count == 0);
+		ASSERT(id == g_res_fallback_id);
+		ASSERT(g_res_pools[0].count == 0);
 		ASSERT(strcmp(g_res_fallback.err.msg, "Invalid argument") == 0);
 		reset_globals();
 	}
 	{ // No size
 		size_t id = res_generic_ok(NULL, alignof(int), 0, ERRINFO);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(id == g_fallback_id);
-		ASSERT(g_res_count == 0);
+		ASSERT(id == g_res_fallback_id);
+		ASSERT(g_res_pools[0].count == 0);
 		ASSERT(strcmp(g_res_fallback.err.msg, "Invalid argument") == 0);
 		reset_globals();
 	}
 	{ // Alignment not power of 2
 		size_t id = res_generic_ok(NULL, 3, sizeof(int), ERRINFO);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(id == g_fallback_id);
-		ASSERT(g_res_count == 0);
+		ASSERT(id == g_res_fallback_id);
+		ASSERT(g_res_pools[0].count == 0);
 		ASSERT(strcmp(g_res_fallback.err.msg, "Invalid argument") == 0);
 		reset_globals();
 	}
 	{ // Alignment too big
 		size_t id = res_generic_ok(NULL, alignof(max_align_t) * 2, sizeof(int), ERRINFO);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(id == g_fallback_id);
-		ASSERT(g_res_count == 0);
+		ASSERT(id == g_res_fallback_id);
+		ASSERT(g_res_pools[0].count == 0);
 		ASSERT(strcmp(g_res_fallback.err.msg, "Invalid argument") == 0);
 		reset_globals();
 	}
 	{ // size too big
 		size_t id = res_generic_ok(NULL, alignof(int), OK_BUFF_SIZE + 1, ERRINFO);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(id == g_fallback_id);
-		ASSERT(g_res_count == 0);
+		ASSERT(id == g_res_fallback_id);
+		ASSERT(g_res_pools[RES_CLASS_COUNT - 1].count == 0);
 		ASSERT(strcmp(g_res_fallback.err.msg, "Not enough memory") == 0);
 		reset_globals();
 	}
 	{ // Not enough memory
-		g_res_count = RES_BUFF_SIZE;
+		g_res_config.max_capacity = RES_BUFF_SIZE;
+		g_res_pools[0].count = RES_BUFF_SIZE;
 		size_t id = res_generic_ok(NULL, alignof(int), sizeof(int), ERRINFO);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(id == g_fallback_id);
+		ASSERT(id == g_res_fallback_id);
 		ASSERT(strcmp(g_res_fallback.err.msg, "Not enough memory") == 0);
 		reset_globals();
 	}
-	{ // Allocate in free list
-		g_res_count = RES_BUFF_SIZE;
-		g_free_count = 1;
-		size_t free_id = 13;
-		g_free_buff[g_free_count - 1] = free_id;
+	{ // Other classes are not affected by a full pool
+		g_res_config.max_capacity = RES_BUFF_SIZE;
+		g_res_pools[0].count = RES_BUFF_SIZE;
+		size_t id = res_generic_ok(NULL, 1, 32, ERRINFO);
+		ASSERT(id == res_make_id(1, 0, 0));
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+	{ // Allocate a freed result object
+		g_res_config.max_capacity = RES_BUFF_SIZE;
+		g_res_pools[0].count = RES_BUFF_SIZE;
+		size_t index = 13;
+		res_free_index(&g_res_pools[0], index);
 		size_t id = res_generic_ok(NULL, alignof(int), sizeof(int), ERRINFO);
-		ASSERT(id = free_id);
-		ASSERT(g_free_count == 0);
+		ASSERT(id == res_make_id(0, index, 0));
+		ASSERT(g_res_pools[0].free_count == 0);
 		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
 		reset_globals();
 	}
@@ -117,30 +335,38 @@ void test_generic_err() {
 	{ // Happy path
 		size_t id = res_generic_err("msg", ERRINFO);
 		int line = __LINE__ - 1;
-		ASSERT(id == g_res_count - 1);
-		ASSERT(g_res_buff[id].state == RES_STATE_ERR);
-		ASSERT(strcmp(g_res_buff[id].err.msg, "msg") == 0);
-		ASSERT(strcmp(g_res_buff[id].err.err_info.file, __FILE__) == 0);
-		ASSERT(strcmp(g_res_buff[id].err.err_info.func, __func__) == 0);
-		ASSERT(g_res_buff[id].err.err_info.line == line);
+		ASSERT(id == res_make_id(RES_ERR_CLASS, g_res_pools[RES_ERR_CLASS].count - 1, 0));
+		ASSERT(get_state(id) == RES_STATE_ERR);
+		ASSERT(strcmp(get_err(id)->msg, "msg") == 0);
+		ASSERT(strcmp(get_err(id)->err_info->file, __FILE__) == 0);
+		ASSERT(strcmp(get_err(id)->err_info->func, __func__) == 0);
+		ASSERT(get_err(id)->err_info->line == line);
 		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
 		reset_globals();
 	}
 	{ // Not enough memory
-		g_res_count = RES_BUFF_SIZE;
-		g_free_count = 0;
+		g_res_config.max_capacity = RES_BUFF_SIZE;
+		g_res_pools[RES_ERR_CLASS].count = RES_BUFF_SIZE;
 		size_t id = res_generic_err("msg", ERRINFO);
 		int line = __LINE__ - 1;
-		ASSERT(id == g_fallback_id);
+		ASSERT(id == g_res_fallback_id);
 		ASSERT(strcmp(g_res_fallback.err.msg, "Not enough memory") == 0);
-		ASSERT(strcmp(g_res_fallback.err.err_info.file, __FILE__) == 0);
-		ASSERT(strcmp(g_res_fallback.err.err_info.func, __func__) == 0);
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(strcmp(g_res_fallback.err.err_info->file, __FILE__) == 0);
+		ASSERT(strcmp(g_res_fallback.err.err_info->func, __func__) == 0);
+		ASSERT(g_res_fallback.err.err_info->line == line);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		reset_globals();
 	}
 }
 
+/** Deletes the result object that was just copied and reuses its slot. */
+static void recycle_copied(size_t id) {
+	int value = 9;
+	res_generic_del(id, NULL);
+	ASSERT(res_id_index(res_generic_ok(&value, alignof(int), sizeof(int), NULL)) == res_id_index(id));
+	ASSERT(res_id_index(res_generic_err("other", NULL)) == res_id_index(id));
+}
+
 void test_generic_get_ok() {
 	reset_globals();
 	{ // Happy path
@@ -153,97 +379,431 @@ void test_generic_get_ok() {
 		reset_globals();
 	}
 	{ // id too big
-		ASSERT(res_generic_get_ok(g_res_count + 1, NULL, sizeof(int), ERRINFO) == 2);
+		ASSERT(res_generic_get_ok(g_res_pools[0].count + 1, NULL, sizeof(int), ERRINFO) == 2);
 		int line = __LINE__ - 1;
-		ASSERT(strcmp(g_res_fallback.err.err_info.file, __FILE__) == 0);
-		ASSERT(strcmp(g_res_fallback.err.err_info.func, __func__) == 0);
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(strcmp(g_res_fallback.err.err_info->file, __FILE__) == 0);
+		ASSERT(strcmp(g_res_fallback.err.err_info->func, __func__) == 0);
+		ASSERT(g_res_fallback.err.err_info->line == line);
 		ASSERT(strcmp(g_res_fallback.err.msg, "Invalid argument") == 0);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		reset_globals();
 	}
 	{ // Size too big
-		g_res_count = 1;
-		ASSERT(res_generic_get_ok(0, NULL, OK_BUFF_SIZE + 1, ERRINFO) == 2);
+		g_res_pools[RES_CLASS_COUNT - 1].count = 1;
+		ASSERT(res_generic_get_ok(
+			res_make_id(RES_CLASS_COUNT - 1, 0, 0), NULL, OK_BUFF_SIZE + 1, ERRINFO) == 2);
 		int line = __LINE__ - 1;
-		ASSERT(strcmp(g_res_fallback.err.err_info.file, __FILE__) == 0);
-		ASSERT(strcmp(g_res_fallback.err.err_info.func, __func__) == 0);
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(strcmp(g_res_fallback.err.err_info->file, __FILE__) == 0);
+		ASSERT(strcmp(g_res_fallback.err.err_info->func, __func__) == 0);
+		ASSERT(g_res_fallback.err.err_info->line == line);
 		ASSERT(strcmp(g_res_fallback.err.msg, "Invalid argument") == 0);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		reset_globals();
 	}
+	{ // Size bigger than the size class
+		g_res_pools[0].count = 1;
+		*res_tag_of(&g_res_pools[0], 0) = RES_STATE_OK;
+		ASSERT(res_generic_get_ok(0, NULL, RES_CLASS_MIN_SIZE + 1, ERRINFO) == 2);
+		ASSERT(strcmp(g_res_fallback.err.msg, "Invalid argument") == 0);
+		reset_globals();
+	}
 	{ // No sise
-		g_res_count = 1;
+		g_res_pools[0].count = 1;
 		ASSERT(res_generic_get_ok(0, NULL, 0, ERRINFO) == 2);
 		int line = __LINE__ - 1;
-		ASSERT(strcmp(g_res_fallback.err.err_info.file, __FILE__) == 0);
-		ASSERT(strcmp(g_res_fallback.err.err_info.func, __func__) == 0);
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(strcmp(g_res_fallback.err.err_info->file, __FILE__) == 0);
+		ASSERT(strcmp(g_res_fallback.err.err_info->func, __func__) == 0);
+		ASSERT(g_res_fallback.err.err_info->line == line);
 		ASSERT(strcmp(g_res_fallback.err.msg, "Invalid argument") == 0);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		reset_globals();
 	}
+	{ // A value that changes while it is copied is not copied out
+		int value = 5, out = 0;
+		size_t id = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		g_res_copied_hook = recycle_copied;
+		ASSERT(res_generic_get_ok(id, &out, sizeof(int), ERRINFO) == 2);
+		ASSERT(!out);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
+		reset_globals();
+	}
+	{ // The same for a batch
+		int value = 5, out = 0;
+		unsigned char ok = 1;
+		size_t id = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		g_res_copied_hook = recycle_copied;
+		ASSERT(!res_generic_get_ok_n(&id, 1, &out, sizeof(int), &ok, ERRINFO));
+		ASSERT(!ok && !out);
+		reset_globals();
+	}
 	{ // State is not RES_STATE_OK
-		g_res_count = 1;
-		g_res_buff[0].state = RES_STATE_ERR;
-		ASSERT(res_generic_get_ok(0, NULL, 4, ERRINFO) == 1);
+		g_res_pools[0].count = 1;
+		*res_tag_of(&g_res_pools[0], 0) = RES_STATE_ERR;
+		ASSERT(res_generic_get_ok(res_make_id(0, 0, 0), NULL, 4, ERRINFO) == 1);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		reset_globals();
 	}
 }
 
+void test_generic_peek() {
+	reset_globals();
+	{ // Happy path
+		unsigned char value[OK_BUFF_SIZE] = {1, 2, 3};
+		size_t id = res_generic_ok(value, 1, OK_BUFF_SIZE, ERRINFO);
+		const unsigned char *ptr = res_generic_peek(id, OK_BUFF_SIZE, ERRINFO);
+		ASSERT(ptr == res_get_data(id));
+		ASSERT(ptr[2] == 3);
+		ASSERT(get_state(id) == RES_STATE_OK);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+	{ // Invalid id
+		ASSERT(!res_generic_peek(13, 1, ERRINFO));
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
+		reset_globals();
+	}
+	{ // Size bigger than the size class
+		size_t id = res_generic_ok(NULL, 1, 1, ERRINFO);
+		ASSERT(!res_generic_peek(id, RES_CLASS_MIN_SIZE + 1, ERRINFO));
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
+		reset_globals();
+	}
+	{ // State is not RES_STATE_OK
+		size_t id = res_generic_err("msg", ERRINFO);
+		ASSERT(!res_generic_peek(id, 1, ERRINFO));
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Result state is not RES_STATE_OK"));
+		reset_globals();
+	}
+}
+
+void test_generic_take() {
+	reset_globals();
+	{ // The memory is released by the next take
+		size_t a = res_generic_ok(&(size_t){1}, alignof(size_t), sizeof(size_t), ERRINFO);
+		size_t b = res_generic_ok(&(size_t){2}, alignof(size_t), sizeof(size_t), ERRINFO);
+		const size_t *ptr = res_generic_take(a, sizeof(size_t), ERRINFO);
+		ASSERT(ptr && *ptr == 1);
+		ASSERT(get_state(a) == RES_STATE_INVALID);
+		ASSERT(g_res_taken == a);
+		ASSERT(!g_res_pools[0].free_count);
+		ASSERT(res_generic_ok(NULL, 1, 1, ERRINFO) == res_make_id(0, 2, 0));
+		ASSERT(*ptr == 1);
+		ptr = res_generic_take(b, sizeof(size_t), ERRINFO);
+		ASSERT(ptr && *ptr == 2);
+		ASSERT(g_res_taken == b);
+		ASSERT(g_res_pools[0].free_count == 1);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+	{ // A taken id can't be used again
+		size_t id = res_generic_ok(NULL, 1, 1, ERRINFO);
+		ASSERT(res_generic_take(id, 1, ERRINFO));
+		ASSERT(!res_generic_take(id, 1, ERRINFO));
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
+		g_res_fallback.state = RES_STATE_INVALID;
+		res_generic_del(id, ERRINFO);
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		reset_globals();
+	}
+	{ // State is not RES_STATE_OK
+		size_t id = res_generic_err("msg", ERRINFO);
+		ASSERT(!res_generic_take(id, 1, ERRINFO));
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Result state is not RES_STATE_OK"));
+		ASSERT(get_state(id) == RES_STATE_ERR);
+		reset_globals();
+	}
+}
+
+void test_generic_reserve() {
+	reset_globals();
+	{ // Constructed in place and committed
+		size_t id = 0;
+		size_t *ptr = res_generic_reserve(alignof(size_t), sizeof(size_t), &id, ERRINFO);
+		ASSERT(ptr == (void *)res_get_data(id));
+		ASSERT(get_state(id) == RES_STATE_RESERVED);
+		size_t value = 0;
+		ASSERT(res_generic_get_ok(id, &value, sizeof(size_t), ERRINFO) == 1);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Result state is not RES_STATE_OK"));
+		g_res_fallback.state = RES_STATE_INVALID;
+		*ptr = 7;
+		ASSERT(res_generic_commit(id, ERRINFO) == id);
+		ASSERT(get_state(id) == RES_STATE_OK);
+		ASSERT(!res_generic_get_ok(id, &value, sizeof(size_t), ERRINFO));
+		ASSERT(value == 7);
+		ASSERT(res_generic_commit(id, ERRINFO) == g_res_fallback_id);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
+		reset_globals();
+	}
+	{ // Error stored in place
+		size_t id = 0;
+		ASSERT(res_generic_reserve(1, sizeof(err_t), &id, ERRINFO));
+		ASSERT(res_generic_commit_err(id, "msg", ERRINFO) == id);
+		ASSERT(get_state(id) == RES_STATE_ERR);
+		ASSERT(!strcmp(get_err(id)->msg, "msg"));
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+	{ // Error in a size class too small for it
+		size_t id = 0;
+		ASSERT(res_generic_reserve(1, 1, &id, ERRINFO));
+		size_t err_id = res_generic_commit_err(id, "msg", ERRINFO);
+		ASSERT(res_id_class(err_id) == RES_ERR_CLASS);
+		ASSERT(get_state(err_id) == RES_STATE_ERR);
+		ASSERT(get_state(id) == RES_STATE_INVALID);
+		ASSERT(g_res_pools[0].free_count == 1);
+		reset_globals();
+	}
+	{ // A reservation can be abandoned
+		size_t id = 0;
+		ASSERT(res_generic_reserve(1, 1, &id, ERRINFO));
+		res_generic_del(id, ERRINFO);
+		ASSERT(get_state(id) == RES_STATE_INVALID);
+		ASSERT(res_generic_commit(id, ERRINFO) == g_res_fallback_id);
+		reset_globals();
+	}
+	{ // A failed reservation passes through commit
+		size_t id = 0;
+		ASSERT(!res_generic_reserve(1, OK_BUFF_SIZE + 1, &id, ERRINFO));
+		ASSERT(id == g_res_fallback_id);
+		ASSERT(res_generic_commit(id, ERRINFO) == g_res_fallback_id);
+		ASSERT(res_generic_commit_err(id, "msg", ERRINFO) == g_res_fallback_id);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Not enough memory"));
+		reset_globals();
+	}
+	{ // Only reservations can be committed
+		size_t id = res_generic_ok(NULL, 1, sizeof(err_t), ERRINFO);
+		ASSERT(res_generic_commit_err(id, "msg", ERRINFO) == g_res_fallback_id);
+		ASSERT(get_state(id) == RES_STATE_OK);
+		reset_globals();
+	}
+}
+
+void test_generic_unwrap() {
+	reset_globals();
+	{ // OK value is copied out and the result object is deleted
+		size_t id = res_generic_ok(&(size_t){7}, alignof(size_t), sizeof(size_t), ERRINFO);
+		size_t value = 0;
+		size_t err_id = 0;
+		ASSERT(!res_generic_unwrap(id, &value, sizeof(size_t), &err_id, ERRINFO));
+		ASSERT(value == 7);
+		ASSERT(get_state(id) == RES_STATE_INVALID);
+		ASSERT(g_res_pools[0].free_count == 1);
+		ASSERT(res_generic_unwrap(id, &value, sizeof(size_t), &err_id, ERRINFO) == 2);
+		ASSERT(err_id == g_res_fallback_id);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
+		reset_globals();
+	}
+	{ // The error result object is moved in place
+		size_t id = res_generic_err("msg", ERRINFO);
+		size_t err_id = 0;
+		ASSERT(res_generic_unwrap(id, NULL, 1, &err_id, ERRINFO) == 1);
+		int line = __LINE__ - 1;
+		ASSERT(err_id == res_make_id(RES_ERR_CLASS, res_id_index(id), res_id_gen(id) + 1));
+		ASSERT(get_state(id) == RES_STATE_INVALID);
+		ASSERT(get_state(err_id) == RES_STATE_ERR);
+		ASSERT(get_err(err_id)->depth == 1);
+		ASSERT(g_res_sites[get_err(err_id)->frames[0]]->line == line);
+		ASSERT(g_res_pools[RES_ERR_CLASS].count - g_res_pools[RES_ERR_CLASS].free_count == 1);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+	{ // The fallback is handed over
+		size_t err_id = 0;
+		res_generic_ok(NULL, 0, 1, ERRINFO);
+		ASSERT(res_generic_unwrap(g_res_fallback_id, NULL, 1, &err_id, ERRINFO) == 1);
+		ASSERT(err_id == g_res_fallback_id);
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		ASSERT(g_res_fallback.err.depth == 1);
+		reset_globals();
+	}
+	{ // Reserved result objects aren't consumed
+		size_t id = 0;
+		size_t err_id = 0;
+		res_generic_reserve(1, 1, &id, ERRINFO);
+		ASSERT(res_generic_unwrap(id, NULL, 1, &err_id, ERRINFO) == 1);
+		ASSERT(err_id == g_res_fallback_id);
+		ASSERT(get_state(id) == RES_STATE_RESERVED);
+		reset_globals();
+	}
+}
+
+RES_SITE(g_file_site, "file scope");
+/** A site taken at file scope. */
+static const res_err_info_t *g_file_info = &g_file_site;
+
+void test_sites() {
+	reset_globals();
+	{ // A site is interned once
+		const res_err_info_t *a = ERRINFO;
+		const res_err_info_t *b = ERRINFO;
+		res_site_id_t id = intern_site(a);
+		ASSERT(id && id == intern_site(a));
+		ASSERT(intern_site(b) && intern_site(b) != id);
+		ASSERT(g_res_sites[id] == a);
+		ASSERT(!intern_site(NULL));
+		reset_globals();
+	}
+	{ // Full table
+		static res_err_info_t infos[RES_SITE_COUNT];
+		size_t interned = 0;
+		for (size_t i = 0; i < RES_SITE_COUNT - 1; i++) interned += intern_site(&infos[i]) != 0;
+		ASSERT(interned == RES_SITE_COUNT - 1);
+		ASSERT(!intern_site(&infos[RES_SITE_COUNT - 1]));
+		ASSERT(intern_site(&infos[7]));
+		reset_globals();
+	}
+	{ // Frames beyond the ring overwrite the oldest ones
+		static res_err_info_t infos[RES_FRAME_COUNT + 2];
+		err_t err = {0};
+		for (size_t i = 0; i < RES_FRAME_COUNT + 2; i++) append_frame(&err, &infos[i]);
+		ASSERT(err.depth == RES_FRAME_COUNT + 2);
+		ASSERT(g_res_sites[err.frames[0]] == &infos[RES_FRAME_COUNT]);
+		ASSERT(g_res_sites[err.frames[1]] == &infos[RES_FRAME_COUNT + 1]);
+		ASSERT(g_res_sites[err.frames[2]] == &infos[2]);
+		reset_globals();
+	}
+	{ // The site descriptors of the module are listed
+		const res_err_info_t *site = ERRINFO;
+		int line = __LINE__ - 1;
+		size_t n = res_list_sites(NULL, 0);
+		ASSERT(n);
+		const res_err_info_t **sites = malloc(n * sizeof(*sites));
+		ASSERT(res_list_sites(sites, n) == n);
+		int is_found = 0;
+		int is_file_found = 0;
+		int is_valid = 1;
+		for (size_t i = 0; i < n; i++) {
+			is_found |= sites[i] == site;
+			is_file_found |= sites[i] == g_file_info;
+			is_valid &= sites[i]->line > 0 && sites[i]->file && sites[i]->func;
+		}
+		ASSERT(is_found);
+		ASSERT(is_file_found);
+		ASSERT(is_valid);
+		ASSERT(site->line == line);
+		ASSERT(!strcmp(g_file_info->func, "file scope"));
+		ASSERT(!strcmp(site->func, __func__));
+		free(sites);
+		ASSERT(g_res_module_count == 1);
+		res_register_sites(__start_res_sites, __stop_res_sites);
+		ASSERT(g_res_module_count == 1);
+	}
+}
+
+void test_generic_lazy() {
+	reset_globals();
+	{ // Happy path
+		size_t id = res_generic_lazy_ok(&(int){5}, alignof(int), sizeof(int));
+		int value = 0;
+		ASSERT(!res_generic_lazy_get_ok(id, &value, sizeof(int)));
+		ASSERT(value == 5);
+		res_generic_lazy_del(id);
+		ASSERT(get_state(id) == RES_STATE_INVALID);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+#ifdef RES_TRACK
+		ASSERT(!res_site_of(&g_res_pools[0], res_id_index(id))->info);
+		ASSERT(res_site_of(&g_res_pools[0], res_id_index(id))->caller);
+#endif
+		reset_globals();
+	}
+	{ // The caller stands in for the error information
+		ASSERT(res_generic_lazy_ok(NULL, 0, 1) == g_res_fallback_id);
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		ASSERT(!g_res_fallback.err.err_info);
+		ASSERT(g_res_fallback.err.caller);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
+		const void *caller = g_res_fallback.err.caller;
+		res_generic_lazy_del(13);
+		ASSERT(g_res_fallback.err.caller && g_res_fallback.err.caller != caller);
+		reset_globals();
+	}
+	{ // The error of an earlier call is kept
+		res_generic_ok(NULL, 0, 1, ERRINFO);
+		ASSERT(res_generic_lazy_get_ok(g_res_fallback_id, NULL, 1) == 1);
+		ASSERT(g_res_fallback.err.err_info);
+		ASSERT(!g_res_fallback.err.caller);
+		reset_globals();
+	}
+}
+
 void test_generic_err_from() {
 	reset_globals();
 	{ // Happy path
 		size_t src = res_generic_err("msg", ERRINFO);
 		size_t dst = res_generic_err_from(src, ERRINFO);
-		ASSERT(g_res_buff[dst].state == RES_STATE_ERR);
-		ASSERT(memcmp(&g_res_buff[dst].err, &g_res_buff[src], sizeof(err_t)) == 0);
-		ASSERT(g_res_count == 2);
+		int line = __LINE__ - 1;
+		ASSERT(dst == res_make_id(RES_ERR_CLASS, res_id_index(src), res_id_gen(src) + 1));
+		ASSERT(get_state(dst) == RES_STATE_ERR);
+		ASSERT(get_state(src) == RES_STATE_INVALID);
+		ASSERT(!strcmp(get_err(dst)->msg, "msg"));
+		ASSERT(get_err(dst)->depth == 1);
+		ASSERT(g_res_sites[get_err(dst)->frames[0]]->line == line);
+		ASSERT(g_res_pools[RES_ERR_CLASS].count == 1);
 		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
 		reset_globals();
 	}
+	{ // Deep propagation reuses the slot
+		size_t id = res_generic_err("msg", ERRINFO);
+		for (size_t i = 0; i < 30; i++) id = res_generic_err_from(id, ERRINFO);
+		ASSERT(get_state(id) == RES_STATE_ERR);
+		ASSERT(get_err(id)->depth == 30);
+		for (size_t i = 0; i < RES_FRAME_COUNT; i++) {
+			ASSERT(get_err(id)->frames[i] == get_err(id)->frames[0]);
+		}
+		ASSERT(g_res_pools[RES_ERR_CLASS].count == 1);
+		ASSERT(!g_res_pools[RES_ERR_CLASS].free_count);
+		reset_globals();
+	}
+	{ // The source is consumed
+		size_t src = res_generic_err("msg", ERRINFO);
+		res_generic_err_from(src, ERRINFO);
+		ASSERT(res_generic_err_from(src, ERRINFO) == g_res_fallback_id);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
+		reset_globals();
+	}
+	{ // The fallback is copied into a new result object
+		res_generic_ok(NULL, 0, 1, ERRINFO);
+		size_t dst = res_generic_err_from(g_res_fallback_id, ERRINFO);
+		ASSERT(dst != g_res_fallback_id);
+		ASSERT(!strcmp(get_err(dst)->msg, "Invalid argument"));
+		ASSERT(get_err(dst)->depth == 1);
+		reset_globals();
+	}
 	{ // src id invalid
 		size_t dst = res_generic_err_from(13, ERRINFO);
 		int line = __LINE__ - 1;
-		ASSERT(dst == g_fallback_id);
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
+		ASSERT(dst == g_res_fallback_id);
+		ASSERT(!strcmp(g_res_fallback.err.err_info->file, __FILE__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->func, __func__));
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
-		ASSERT(g_res_fallback.err.err_info.line == line);
-		ASSERT(g_res_count == 0);
+		ASSERT(g_res_fallback.err.err_info->line == line);
+		ASSERT(g_res_pools[RES_ERR_CLASS].count == 0);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		reset_globals();
 	}
 	{ // src state isn't RES_STATE_ERR
 		size_t src = res_generic_ok(NULL, 2, 2, ERRINFO);
-		ASSERT(g_res_buff[src].state == RES_STATE_OK);
+		ASSERT(get_state(src) == RES_STATE_OK);
 		size_t dst = res_generic_err_from(src, ERRINFO);
 		int line = __LINE__ - 1;
-		ASSERT(dst == g_fallback_id);
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
+		ASSERT(dst == g_res_fallback_id);
+		ASSERT(!strcmp(g_res_fallback.err.err_info->file, __FILE__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->func, __func__));
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(g_res_fallback.err.err_info->line == line);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		reset_globals();
 	}
-	{ // Not enough memory
-		g_res_count = RES_BUFF_SIZE - 1;
-		size_t src = res_generic_ok(NULL, 2, 2, ERRINFO);
-		ASSERT(g_res_buff[src].state == RES_STATE_OK);
-		ASSERT(g_res_count == RES_BUFF_SIZE);
-		ASSERT(g_res_buff[src].state == RES_STATE_OK);
-		g_res_buff[src].state = RES_STATE_ERR;
+	{ // Not enough memory is no problem for a moved error
+		g_res_config.max_capacity = RES_BUFF_SIZE;
+		g_res_pools[RES_ERR_CLASS].count = RES_BUFF_SIZE - 1;
+		size_t src = res_generic_err("msg", ERRINFO);
+		ASSERT(get_state(src) == RES_STATE_ERR);
+		ASSERT(g_res_pools[RES_ERR_CLASS].count == RES_BUFF_SIZE);
 		size_t dst = res_generic_err_from(src, ERRINFO);
-		int line = __LINE__ - 1;
-		ASSERT(dst == g_fallback_id);
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
-		ASSERT(!strcmp(g_res_fallback.err.msg, "Not enough memory"));
-		ASSERT(g_res_fallback.err.err_info.line == line);
-		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		ASSERT(dst != g_res_fallback_id);
+		ASSERT(get_state(dst) == RES_STATE_ERR);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
 		reset_globals();
 	}
 }
@@ -252,48 +812,213 @@ void test_generic_del() {
 	reset_globals();
 	{ // Happy path
 		size_t id = res_generic_ok(NULL, 2, 2, ERRINFO);
-		ASSERT(id == 0);
-		ASSERT(g_res_count == 1);
-		ASSERT(g_free_count == 0);
+		ASSERT(id == res_make_id(0, 0, 0));
+		ASSERT(g_res_pools[0].count == 1);
+		ASSERT(g_res_pools[0].free_count == 0);
 		res_generic_del(id, ERRINFO);
-		ASSERT(g_res_count == 1);
-		ASSERT(g_free_count == 1);
+		ASSERT(g_res_pools[0].count == 1);
+		ASSERT(g_res_pools[0].free_count == 1);
+		ASSERT(get_state(id) == RES_STATE_INVALID);
 		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
 		reset_globals();
 	}
 	{ // Invalid id
-		g_free_count = FREE_BUFF_SIZE;
 		res_generic_del(RES_BUFF_SIZE + 1, ERRINFO);
 		int line = __LINE__ - 1;
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(!strcmp(g_res_fallback.err.err_info->file, __FILE__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->func, __func__));
+		ASSERT(g_res_fallback.err.err_info->line == line);
+		reset_globals();
+	}
+	{ // Invalid size class
+		res_generic_del(res_make_id(RES_CLASS_COUNT, 0, 0), ERRINFO);
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
 		reset_globals();
 	}
-	{ // Free buff full
+	{ // Double delete
 		size_t id = res_generic_ok(NULL, 2, 2, ERRINFO);
-		g_free_count = FREE_BUFF_SIZE;
+		res_generic_del(id, ERRINFO);
 		res_generic_del(id, ERRINFO);
 		int line = __LINE__ - 1;
+		ASSERT(g_res_pools[0].free_count == 1);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(!strcmp(g_res_fallback.err.msg, "Not enough memory"));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
+		ASSERT(g_res_fallback.err.err_info->line == line);
 		reset_globals();
 	}
 	{ // Res invalid
 		size_t id = 0;
-		g_res_buff[id].state = RES_STATE_INVALID;
+		g_res_pools[0].count = 1;
+		*res_tag_of(&g_res_pools[0], id) = RES_STATE_INVALID;
 		res_generic_del(id, ERRINFO);
 		int line = __LINE__ - 1;
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(!strcmp(g_res_fallback.err.err_info->file, __FILE__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->func, __func__));
+		ASSERT(g_res_fallback.err.err_info->line == line);
+		reset_globals();
+	}
+}
+
+void test_generic_batch() {
+	reset_globals();
+	{ // Happy path
+		size_t values[40], ids[40], copies[40] = {0};
+		unsigned char oks[40] = {0};
+		for (size_t i = 0; i < 40; i++) values[i] = i * 3;
+		ASSERT(res_generic_ok_n(values, alignof(size_t), sizeof(size_t), 40, ids, ERRINFO) == 40);
+		ASSERT(g_res_pools[0].count == 40);
+		for (size_t i = 0; i < 40; i++) {
+			ASSERT(res_id_index(ids[i]) == i);
+			ASSERT(get_state(ids[i]) == RES_STATE_OK);
+		}
+		ASSERT(res_generic_get_ok_n(ids, 40, copies, sizeof(size_t), oks, ERRINFO) == 40);
+		for (size_t i = 0; i < 40; i++) {
+			ASSERT(oks[i] == 1);
+			ASSERT(copies[i] == values[i]);
+		}
+		res_generic_del_n(ids, 40, ERRINFO);
+		ASSERT(g_res_pools[0].free_count == 40);
+		for (size_t i = 0; i < 40; i++) {
+			ASSERT(get_state(ids[i]) == RES_STATE_INVALID);
+		}
+		size_t again[40];
+		unsigned char seen[40] = {0};
+		ASSERT(res_generic_ok_n(NULL, 1, 1, 40, again, ERRINFO) == 40);
+		ASSERT(g_res_pools[0].count == 40);
+		ASSERT(g_res_pools[0].free_count == 0);
+		for (size_t i = 0; i < 40; i++) {
+			ASSERT(res_id_index(again[i]) < 40);
+			ASSERT(!seen[res_id_index(again[i])]++);
+			ASSERT(res_id_gen(again[i]) == 1);
+		}
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+	{ // Reused and new indices
+		size_t ids[3], more[3];
+		ASSERT(res_generic_ok_n(NULL, 1, 1, 3, ids, ERRINFO) == 3);
+		res_generic_del(ids[1], ERRINFO);
+		ASSERT(res_generic_ok_n(NULL, 1, 1, 3, more, ERRINFO) == 3);
+		ASSERT(res_id_index(more[0]) == 1);
+		ASSERT(res_id_index(more[1]) == 3);
+		ASSERT(res_id_index(more[2]) == 4);
+		ASSERT(g_res_pools[0].count == 5);
+		reset_globals();
+	}
+	{ // Pool full
+		g_res_config.max_capacity = RES_BUFF_SIZE;
+		size_t ids[RES_BUFF_SIZE + 8];
+		ASSERT(res_generic_ok_n(NULL, 1, 1, RES_BUFF_SIZE + 8, ids, ERRINFO) == RES_BUFF_SIZE);
+		ASSERT(ids[RES_BUFF_SIZE - 1] != g_res_fallback_id);
+		for (size_t i = RES_BUFF_SIZE; i < RES_BUFF_SIZE + 8; i++) {
+			ASSERT(ids[i] == g_res_fallback_id);
+		}
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Not enough memory"));
+		res_generic_del_n(ids, RES_BUFF_SIZE + 8, ERRINFO);
+		ASSERT(g_res_pools[0].free_count == RES_BUFF_SIZE);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+	{ // Invalid arguments
+		size_t ids[2] = {0};
+		ASSERT(!res_generic_ok_n(NULL, 3, 1, 2, ids, ERRINFO));
+		ASSERT(ids[0] == g_res_fallback_id && ids[1] == g_res_fallback_id);
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
+		g_res_fallback.state = RES_STATE_INVALID;
+		ASSERT(!res_generic_ok_n(NULL, 1, 1, 0, NULL, ERRINFO));
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		ASSERT(!res_generic_ok_n(NULL, 1, 1, 2, NULL, ERRINFO));
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		reset_globals();
+	}
+	{ // Mixed states
+		int value = 5;
+		size_t ids[4] = {
+			res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO),
+			res_generic_err("msg", ERRINFO),
+			g_res_fallback_id,
+			res_make_id(0, 7, 0),
+		};
+		int values[4] = {0};
+		unsigned char oks[4] = {0};
+		ASSERT(res_generic_get_ok_n(ids, 2, NULL, sizeof(int), NULL, ERRINFO) == 1);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		ASSERT(res_generic_get_ok_n(ids, 4, values, sizeof(int), oks, ERRINFO) == 1);
+		ASSERT(oks[0] == 1 && !oks[1] && !oks[2] && !oks[3]);
+		ASSERT(values[0] == 5 && !values[1]);
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
+		g_res_fallback.state = RES_STATE_INVALID;
+		ASSERT(!res_generic_get_ok_n(ids, 1, values, RES_CLASS_MIN_SIZE + 1, NULL, ERRINFO));
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		res_generic_del_n(ids, 4, ERRINFO);
+		ASSERT(get_state(ids[0]) == RES_STATE_INVALID);
+		ASSERT(get_state(ids[1]) == RES_STATE_INVALID);
+		ASSERT(g_res_pools[0].free_count == 1);
+		ASSERT(g_res_pools[RES_ERR_CLASS].free_count == 1);
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
+		reset_globals();
+	}
+	{ // Double delete in one batch
+		size_t id = res_generic_ok(NULL, 1, 1, ERRINFO);
+		size_t ids[2] = {id, id};
+		res_generic_del_n(ids, 2, ERRINFO);
+		ASSERT(g_res_pools[0].free_count == 1);
+		ASSERT(res_claim_free_id(&g_res_pools[0]) == 0);
+		ASSERT(res_claim_free_id(&g_res_pools[0]) == g_res_fallback_id);
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		reset_globals();
+	}
+}
+
+void test_generation() {
+	reset_globals();
+	{ // A stale id doesn't match the result object reusing its memory
+		int value = 5;
+		size_t stale = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		res_generic_del(stale, ERRINFO);
+		value = 6;
+		size_t id = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		ASSERT(res_id_index(id) == res_id_index(stale));
+		ASSERT(res_id_gen(id) == res_id_gen(stale) + 1);
+		ASSERT(id == res_make_id(0, res_id_index(stale), 1));
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		ASSERT(get_state(stale) == RES_STATE_INVALID);
+		ASSERT(res_generic_get_ok(stale, &value, sizeof(int), ERRINFO) == 2);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
+		g_res_fallback.state = RES_STATE_INVALID;
+		res_generic_del(stale, ERRINFO);
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		g_res_fallback.state = RES_STATE_INVALID;
+		ASSERT(!res_generic_get_ok(id, &value, sizeof(int), ERRINFO));
+		ASSERT(value == 6);
+		reset_globals();
+	}
+	{ // A stale error id can't be propagated
+		size_t stale = res_generic_err("old", ERRINFO);
+		res_generic_del(stale, ERRINFO);
+		size_t id = res_generic_err("new", ERRINFO);
+		ASSERT(res_generic_err_from(stale, ERRINFO) == g_res_fallback_id);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
+		ASSERT(get_state(id) == RES_STATE_ERR);
+		reset_globals();
+	}
+	{ // The generation wraps around
+		*res_tag_of(&g_res_pools[0], 0) = res_make_tag(RES_GEN_MASK, RES_STATE_INVALID);
+		size_t id = res_generic_ok(NULL, 1, 1, ERRINFO);
+		ASSERT(res_id_gen(id) == RES_GEN_MASK);
+		res_generic_del(id, ERRINFO);
+		id = res_generic_ok(NULL, 1, 1, ERRINFO);
+		ASSERT(id == res_make_id(0, 0, 0));
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
 		reset_globals();
 	}
 }
@@ -310,6 +1035,14 @@ void test_generic_print_err() {
 		ASSERT(!g_is_fallback_error_printed);
 		reset_globals();
 	}
+	{ // An error that changes while it is copied is not printed
+		size_t id = res_generic_err("msg", ERRINFO);
+		g_res_copied_hook = recycle_copied;
+		res_generic_print_err(id, ERRINFO);
+		ASSERT(!g_is_error_printed);
+		ASSERT(g_is_fallback_error_printed);
+		reset_globals();
+	}
 	{ // Invalid id
 		res_generic_print_err(0, ERRINFO);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
@@ -318,37 +1051,630 @@ void test_generic_print_err() {
 		reset_globals();
 	}
 	{ // State not RES_STATE_ERR
-		g_res_buff[0].state = RES_STATE_OK;
+		g_res_pools[0].count = 1;
+		*res_tag_of(&g_res_pools[0], 0) = RES_STATE_OK;
 		res_generic_print_err(0, ERRINFO);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		ASSERT(!g_is_error_printed);
 		ASSERT(g_is_fallback_error_printed);
 		reset_globals();
 	}
-	{ // Id is g_fallback_id
-		res_generic_print_err(g_fallback_id, ERRINFO);
+	{ // Id is g_res_fallback_id
+		res_generic_print_err(g_res_fallback_id, ERRINFO);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		ASSERT(!g_is_error_printed);
 		ASSERT(g_is_fallback_error_printed);
 		reset_globals();
 	}
-	{ // Fallback state is RES_STATE_ERR
+	{ // A set fallback doesn't shadow a valid error
 		g_res_fallback.state = RES_STATE_ERR;
 		size_t id = res_generic_err("msg", ERRINFO);
 		res_generic_print_err(id, ERRINFO);
-		ASSERT(!g_is_error_printed);
+		ASSERT(g_is_error_printed);
+		ASSERT(!g_is_fallback_error_printed);
+		reset_globals();
+	}
+}
+
+static void *fallback_worker(void *arg) {
+	(void)arg;
+	res_generic_ok(NULL, 0, 1, ERRINFO);
+	return NULL;
+}
+
+void test_fallback() {
+	reset_globals();
+	{ // The fallback behaves like an error result until it is deleted
+		g_res_config.max_capacity = RES_BUFF_SIZE;
+		g_res_pools[RES_ERR_CLASS].count = RES_BUFF_SIZE;
+		size_t id = res_generic_err("msg", ERRINFO);
+		int line = __LINE__ - 1;
+		ASSERT(id == g_res_fallback_id);
+		ASSERT(res_generic_get_ok(id, NULL, 1, ERRINFO) == 1);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Not enough memory"));
+		ASSERT(g_res_fallback.err.err_info->line == line);
+		res_generic_print_err(id, ERRINFO);
 		ASSERT(g_is_fallback_error_printed);
+		ASSERT(g_res_fallback.err.err_info->line == line);
+		res_generic_del(id, ERRINFO);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		res_generic_del(id, ERRINFO);
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
 		reset_globals();
 	}
+	{ // Propagating the fallback keeps its error
+		g_res_fallback.err.msg = "msg";
+		g_res_fallback.state = RES_STATE_ERR;
+		size_t id = res_generic_err_from(g_res_fallback_id, ERRINFO);
+		ASSERT(id != g_res_fallback_id);
+		ASSERT(!strcmp(get_err(id)->msg, "msg"));
+		g_res_config.max_capacity = RES_BUFF_SIZE;
+		g_res_pools[RES_ERR_CLASS].count = RES_BUFF_SIZE;
+		ASSERT(res_generic_err_from(g_res_fallback_id, ERRINFO) == g_res_fallback_id);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "msg"));
+		reset_globals();
+	}
+	{ // Sharing the fallback moves its error into a pool
+		g_res_fallback.err.msg = "msg";
+		g_res_fallback.state = RES_STATE_ERR;
+		size_t id = res_generic_share(g_res_fallback_id, ERRINFO);
+		ASSERT(id != g_res_fallback_id);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		ASSERT(res_generic_get_ok(id, NULL, 1, ERRINFO) == 1);
+		g_res_fallback.state = RES_STATE_INVALID;
+		res_generic_print_err(id, ERRINFO);
+		ASSERT(g_is_error_printed);
+		reset_globals();
+	}
+	{ // Another thread's failure doesn't touch the fallback
+		pthread_t thread;
+		pthread_create(&thread, NULL, fallback_worker, NULL);
+		pthread_join(thread, NULL);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+}
+
+void test_stats() {
+	reset_globals();
+	res_stats_t stats;
+	{ // Empty pools
+		ASSERT(res_stats(NULL) == 1);
+#ifdef RES_NO_STATS
+		ASSERT(res_stats(&stats) == 1);
+#else
+		ASSERT(!res_stats(&stats));
+#endif
+		ASSERT(!stats.live);
+		ASSERT(!stats.high_water);
+		ASSERT(!stats.free);
+		ASSERT(!stats.fallbacks);
+		reset_globals();
+	}
+	{ // Pool figures
+		size_t ids[3];
+		for (size_t i = 0; i < 3; i++) ids[i] = res_generic_ok(&i, 1, 1, ERRINFO);
+		size_t err = res_generic_err("msg", ERRINFO);
+		res_generic_del(ids[0], ERRINFO);
+		res_generic_del(ids[1], ERRINFO);
+		res_stats(&stats);
+		ASSERT(stats.live == 2);
+		ASSERT(stats.high_water == 4);
+		ASSERT(stats.free == 2);
+		res_generic_del(err, ERRINFO);
+		res_stats(&stats);
+		ASSERT(stats.live == 1);
+		ASSERT(stats.high_water == 4);
+		reset_globals();
+	}
+#ifndef RES_NO_STATS
+	{ // Counters
+		size_t src = res_generic_err("msg", ERRINFO);
+		size_t dst = res_generic_err_from(src, ERRINFO);
+		res_generic_err_from(dst, ERRINFO);
+		res_generic_ok(NULL, 0, 1, ERRINFO);
+		res_generic_del(g_res_fallback_id, ERRINFO);
+		res_stats(&stats);
+		ASSERT(stats.errors_created == 1);
+		ASSERT(stats.errors_propagated == 2);
+		ASSERT(stats.fallbacks == 1);
+		ASSERT(!stats.mutex_contentions);
+		reset_globals();
+		res_stats(&stats);
+		ASSERT(!stats.errors_created);
+		ASSERT(!stats.fallbacks);
+		reset_globals();
+	}
+	{ // No contention on a free mutex
+		lock_mutex();
+		ASSERT(!g_res_counters.mutex_contentions);
+		pthread_mutex_unlock(&g_mutex);
+		reset_globals();
+	}
+#endif
+}
+
+void test_leaks() {
+	reset_globals();
+	res_leak_t leaks[2] = {0};
+#ifdef RES_TRACK
+	{ // Grouped by site
+		int line = __LINE__ + 2;
+		for (size_t i = 0; i < 3; i++)
+			res_generic_ok(&i, alignof(size_t), sizeof(size_t), ERRINFO);
+		size_t err = res_generic_err("msg", ERRINFO);
+		size_t deleted = res_generic_err("msg", ERRINFO);
+		res_generic_del(deleted, ERRINFO);
+		ASSERT(res_leaks(leaks, 2) == 2);
+		ASSERT(leaks[0].count == 3);
+		ASSERT(leaks[0].site.line == line);
+		ASSERT(!strcmp(leaks[0].site.file, __FILE__));
+		ASSERT(!strcmp(leaks[0].site.func, __func__));
+		ASSERT(leaks[1].count == 1);
+		ASSERT(leaks[1].site.line == get_err(err)->err_info->line);
+		ASSERT(res_leaks(NULL, 0) == 2);
+		reset_globals();
+	}
+	{ // More sites than room
+		res_generic_err("msg", ERRINFO);
+		res_generic_err("msg", ERRINFO);
+		res_generic_err("msg", ERRINFO);
+		ASSERT(res_leaks(leaks, 1) == 3);
+		ASSERT(leaks[0].count == 1);
+		reset_globals();
+	}
+#else
+	{ // Nothing is tracked
+		res_generic_err("msg", ERRINFO);
+		ASSERT(!res_leaks(leaks, 2));
+		ASSERT(!res_print_leaks());
+		reset_globals();
+	}
+#endif
+	{ // No leaks
+		ASSERT(!res_leaks(leaks, 2));
+		ASSERT(!res_print_leaks());
+		reset_globals();
+	}
+}
+
+/** Reports received by test_sink. */
+static char g_sunk[RES_QUEUE_SIZE + 1][64];
+/** The number of reports received by test_sink. */
+static size_t g_sunk_count;
+/** The number of batches received by test_sink. */
+static size_t g_batch_count;
+
+static void test_sink(const struct iovec *reports, size_t count) {
+	g_batch_count++;
+	for (size_t i = 0; i < count && g_sunk_count <= RES_QUEUE_SIZE; i++, g_sunk_count++) {
+		size_t size = reports[i].iov_len < 63 ? reports[i].iov_len : 63;
+		memcpy(g_sunk[g_sunk_count], reports[i].iov_base, size);
+		g_sunk[g_sunk_count][size] = 0;
+	}
+}
+
+/** Publishes a report with the text.
+ * \return 0 on success, 1 if the queue is full. */
+static int push_report(const char *text) {
+	res_report_t *r = claim_report(&g_res_queue);
+	if (!r) return 1;
+	r->size = strlen(text);
+	memcpy(r->text, text, r->size);
+	publish_report(r);
+	return 0;
+}
+
+void test_reports() {
+	reset_globals();
+	g_sunk_count = g_batch_count = 0;
+	{ // Format
+		char buf[RES_REPORT_SIZE];
+		err_t err = {.msg = "msg", .err_info = ERRINFO};
+		size_t len = res_format_err(err, g_res_sites, buf, sizeof(buf));
+		ASSERT(len == strlen(buf));
+		ASSERT(!strncmp(buf, "[ERROR]:\n\tMessage: msg\n", 22));
+		ASSERT(!strstr(buf, "Propagated"));
+		append_frame(&err, ERRINFO);
+		err.frames[1] = 0;
+		err.depth = 2;
+		len = res_format_err(err, g_res_sites, buf, sizeof(buf));
+		ASSERT(strstr(buf, "\tPropagated through:\n\t\t#1 test_reports ("));
+		ASSERT(strstr(buf, "\t\t#2 <unknown>\n"));
+		ASSERT(buf[len - 1] == '\n');
+		len = res_format_err(err, g_res_sites, buf, 16);
+		ASSERT(len == 15);
+		ASSERT(buf[14] == '\n');
+	}
+	{ // Empty queue
+		ASSERT(!drain_reports(&g_res_queue, test_sink));
+		ASSERT(!g_batch_count);
+	}
+	{ // Reports are drained in order
+		ASSERT(!push_report("a"));
+		ASSERT(!push_report("b"));
+		ASSERT(!push_report("c"));
+		ASSERT(drain_reports(&g_res_queue, test_sink) == 3);
+		ASSERT(g_batch_count == 1);
+		ASSERT(g_sunk_count == 3);
+		ASSERT(!strcmp(g_sunk[0], "a"));
+		ASSERT(!strcmp(g_sunk[2], "c"));
+		ASSERT(!drain_reports(&g_res_queue, test_sink));
+	}
+	{ // Full queue drops and the drop is reported
+		g_sunk_count = g_batch_count = 0;
+		for (size_t i = 0; i < RES_QUEUE_SIZE; i++) {
+			ASSERT(!push_report("x"));
+		}
+		ASSERT(push_report("x"));
+		atomic_fetch_add(&g_res_queue.dropped, 1);
+		res_stats_t stats;
+		(void)res_stats(&stats);
+		ASSERT(stats.reports_dropped == 1);
+		ASSERT(drain_reports(&g_res_queue, test_sink) == RES_QUEUE_SIZE);
+		ASSERT(g_batch_count == RES_QUEUE_SIZE / RES_BATCH_SIZE);
+		ASSERT(g_sunk_count == RES_QUEUE_SIZE + 1);
+		ASSERT(!strcmp(g_sunk[RES_BATCH_SIZE], "[DROPPED]:\n\tReports: 1\n"));
+		ASSERT(!drain_reports(&g_res_queue, test_sink));
+		ASSERT(g_sunk_count == RES_QUEUE_SIZE + 1);
+		ASSERT(!push_report("y"));
+	}
+	{ // Flush uses the configured sink
+		g_sunk_count = g_batch_count = 0;
+		g_res_config.sink = test_sink;
+		res_flush_reports();
+		ASSERT(g_sunk_count == 1);
+		ASSERT(!strcmp(g_sunk[0], "y"));
+	}
+	reset_globals();
+}
+
+/** Decodes the binary log into a string.
+ * \param text The buffer to write the string into.
+ * \param size The size of text.
+ * \return The number of decoded records. */
+static long decode_to(char *text, size_t size) {
+	FILE *out = fmemopen(text, size, "w");
+	long n = res_decode_log(g_res_log.header, g_res_log.size, out, 0);
+	fclose(out);
+	return n;
+}
+
+void test_log() {
+	reset_globals();
+	char path[] = "/tmp/res_log_XXXXXX";
+	int fd = mkstemp(path);
+	ASSERT(fd >= 0);
+	close(fd);
+	static char text[4 * RES_REPORT_SIZE];
+	static char expected[4 * RES_REPORT_SIZE];
+	err_t err = {.msg = "msg", .err_info = ERRINFO};
+	append_frame(&err, ERRINFO);
+	{ // Invalid arguments
+		ASSERT(res_log_open(path, RES_LOG_MAX_CAPACITY + 1) == 1);
+		ASSERT(res_log_open("/nonexistent/res_log", 0) == 2);
+		ASSERT(!g_res_log.header);
+	}
+	{ // Records refer to the sites and the message by id
+		ASSERT(!res_log_open(path, 2));
+		ASSERT(g_res_log.header->capacity == 2);
+		log_err(&g_res_log, err);
+		log_err(&g_res_log, err);
+		res_log_record_t *r = &g_res_log.records[0];
+		ASSERT(r->seq == 1);
+		ASSERT(r->thread == thread_id());
+		ASSERT(r->time);
+		ASSERT(r->msg && r->msg == g_res_log.records[1].msg);
+		ASSERT(!strcmp(res_log_get_string(&g_res_log, g_res_log.msgs[r->msg]), "msg"));
+		ASSERT(r->site == intern_site(err.err_info));
+		ASSERT(r->depth == 1);
+		ASSERT(r->frames[0] == err.frames[0]);
+		ASSERT(g_res_log.sites[r->site].state == 2);
+		ASSERT(g_res_log.sites[r->site].line == err.err_info->line);
+		ASSERT(!strcmp(res_log_get_string(&g_res_log, g_res_log.sites[r->frames[0]].func), "test_log"));
+		// The message and the sites are copied once
+		uint64_t used = g_res_log.header->strings_used;
+		log_err(&g_res_log, err);
+		ASSERT(g_res_log.header->strings_used == used);
+		ASSERT(g_res_log.records[0].seq == 3);
+	}
+	{ // Decoding gives the text format of the oldest records first
+		err_t other = {.msg = "other", .err_info = ERRINFO};
+		log_err(&g_res_log, other);
+		size_t len = res_format_err(err, g_res_sites, expected, sizeof(expected));
+		res_format_err(other, g_res_sites, expected + len, sizeof(expected) - len);
+		ASSERT(decode_to(text, sizeof(text)) == 2);
+		ASSERT(!strcmp(text, expected));
+	}
+	{ // A record being written is skipped
+		g_res_log.records[1].seq = 0;
+		ASSERT(decode_to(text, sizeof(text)) == 1);
+	}
+	{ // Unknown sites and messages
+		log_err(&g_res_log, (err_t){.depth = 1});
+		ASSERT(decode_to(text, sizeof(text)) == 1);
+		ASSERT(strstr(text, "Message: <unknown>\n\tFile: <unknown>"));
+		ASSERT(strstr(text, "#1 <unknown>"));
+	}
+	{ // Invalid log
+		g_res_log.header->version++;
+		ASSERT(decode_to(text, sizeof(text)) == -1);
+		g_res_log.header->version--;
+		ASSERT(res_decode_log(g_res_log.header, sizeof(res_log_header_t), stdout, 0) == -1);
+	}
+	{ // Close keeps the records in the file
+		res_log_close();
+		ASSERT(!g_res_log.header);
+		size_t msgs = 0;
+		for (size_t i = 0; i < RES_LOG_MSG_COUNT; i++)
+			msgs += !!g_res_log_msgs[i];
+		ASSERT(!msgs);
+		fd = open(path, O_RDONLY);
+		struct stat st;
+		ASSERT(!fstat(fd, &st));
+		void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		FILE *out = fmemopen(text, sizeof(text), "w");
+		ASSERT(res_decode_log(map, (size_t)st.st_size, out, 1) == 1);
+		fclose(out);
+		ASSERT(text[0] == '[' && strstr(text, "Z] [thread "));
+		munmap(map, (size_t)st.st_size);
+	}
+	unlink(path);
+	reset_globals();
+}
+
+void test_limit() {
+	reset_globals();
+	g_sunk_count = g_batch_count = 0;
+	g_res_config.report_burst = 2;
+	uint64_t window = RES_REPORT_WINDOW * 1000000u;
+	uint64_t now = window * 10;
+	res_site_id_t id = intern_site(ERRINFO);
+	res_limit_t *limit = &g_res_limits[id];
+	uint64_t suppressed = 1;
+	{ // The burst is reported, the rest is suppressed
+		ASSERT(limit_report(limit, now, &suppressed) == 1);
+		ASSERT(!suppressed);
+		ASSERT(limit_report(limit, now + 1, &suppressed) == 1);
+		ASSERT(!g_res_limit_pending);
+		ASSERT(!limit_report(limit, now + 2, &suppressed));
+		ASSERT(!limit_report(limit, now + window - 1, &suppressed));
+		ASSERT(limit->suppressed == 2);
+		ASSERT(g_res_limit_pending);
+		res_stats_t stats;
+		if (!res_stats(&stats)) {
+			ASSERT(stats.reports_suppressed == 2);
+		}
+	}
+	{ // Other sites are not limited
+		ASSERT(limit_report(&g_res_limits[intern_site(ERRINFO)], now, &suppressed) == 1);
+	}
+	{ // Open windows are only summarized when forced
+		summarize_suppressed(now + 3, 0);
+		ASSERT(!drain_reports(&g_res_queue, test_sink));
+		ASSERT(g_res_limit_pending);
+		ASSERT(limit->suppressed == 2);
+		summarize_suppressed(now + 3, 1);
+		ASSERT(!g_res_limit_pending);
+		ASSERT(!limit->suppressed);
+		ASSERT(drain_reports(&g_res_queue, test_sink) == 1);
+		ASSERT(strstr(g_sunk[0], "[SUPPRESSED]:\n\tSimilar errors: 2\n\tFile: "));
+	}
+	{ // The next window reports the suppressed errors with its first error
+		ASSERT(!limit_report(limit, now + 4, &suppressed));
+		ASSERT(limit_report(limit, now + window, &suppressed) == 1);
+		ASSERT(suppressed == 1);
+		ASSERT(!limit->suppressed);
+	}
+	{ // Expired windows are summarized without forcing
+		ASSERT(limit_report(limit, now + window + 1, &suppressed) == 1);
+		ASSERT(!limit_report(limit, now + window + 2, &suppressed));
+		summarize_suppressed(now + 2 * window, 0);
+		ASSERT(!g_res_limit_pending);
+		ASSERT(drain_reports(&g_res_queue, test_sink) == 1);
+	}
+	{ // A full queue gives the errors back
+		ASSERT(!limit_report(limit, now + 2 * window - 1, &suppressed));
+		for (size_t i = 0; i < RES_QUEUE_SIZE; i++) {
+			ASSERT(!push_report("x"));
+		}
+		summarize_suppressed(now, 1);
+		ASSERT(limit->suppressed == 1);
+		ASSERT(g_res_limit_pending);
+		g_sunk_count = 0;
+		g_res_config.sink = test_sink;
+		res_flush_reports();
+		ASSERT(!limit->suppressed);
+		ASSERT(!g_res_limit_pending);
+		ASSERT(g_sunk_count == RES_QUEUE_SIZE + 1);
+		ASSERT(strstr(g_sunk[RES_QUEUE_SIZE], "Similar errors: 1\n"));
+	}
+	reset_globals();
+	g_res_config.report_burst = 2;
+	{ // Callers without error information have limiters of their own
+		const res_err_info_t *site;
+		err_t a = {.caller = (const void *)test_limit};
+		err_t b = {.caller = (const void *)test_sink};
+		res_limit_t *caller = limit_of(&a, &site);
+		ASSERT(!site);
+		ASSERT(caller == limit_of(&a, &site));
+		ASSERT(caller != limit_of(&b, &site));
+		ASSERT(caller != &g_res_caller_limits[0] && caller->caller == a.caller);
+		ASSERT(limit_of(&(err_t){0}, &site) == &g_res_caller_limits[0]);
+		ASSERT(limit_of(&(err_t){.err_info = ERRINFO}, &site) != caller);
+		ASSERT(site);
+		ASSERT(limit_report(caller, now, &suppressed) == 1);
+		ASSERT(limit_report(caller, now, &suppressed) == 1);
+		ASSERT(!limit_report(caller, now, &suppressed));
+		ASSERT(limit_report(limit_of(&b, &site), now, &suppressed) == 1);
+		g_sunk_count = 0;
+		summarize_suppressed(now, 1);
+		ASSERT(!caller->suppressed);
+		ASSERT(drain_reports(&g_res_queue, test_sink) == 1);
+		ASSERT(strstr(g_sunk[0], "[SUPPRESSED]:\n\tSimilar errors: 1\n\tCaller: 0x"));
+	}
+	reset_globals();
+}
+
+void test_regions() {
+	reset_globals();
+	int value = 42;
+	{ // Invalid arguments
+		ASSERT(res_region_begin(NULL) == 1);
+		ASSERT(res_region_end((res_region_t){0, 0}) == 1);
+		ASSERT(res_region_end((res_region_t){1, 0}) == 1);
+	}
+	{ // Result objects of a region are released at once
+		res_region_t region;
+		ASSERT(!res_region_begin(&region));
+		ASSERT(region.slot == 1 && !region.prev);
+		ASSERT(g_res_region == 1);
+		size_t ok = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		size_t err = res_generic_err("msg", ERRINFO);
+		size_t deleted = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		ASSERT(res_id_region(ok) == 1 && res_id_class(ok) == 0);
+		ASSERT(res_id_region(err) == 1 && res_id_class(err) == RES_ERR_CLASS);
+		ASSERT(!g_res_pools[0].count);
+		res_generic_del(deleted, ERRINFO);
+		ASSERT(g_res_pools[RES_CLASS_COUNT].free_count == 1);
+		size_t moved = res_generic_err_from(err, ERRINFO);
+		ASSERT(get_state(moved) == RES_STATE_ERR);
+		ASSERT(res_id_gen(moved) >> RES_SLOT_GEN_BITS == res_id_gen(ok) >> RES_SLOT_GEN_BITS);
+		int out = 0;
+		ASSERT(!res_generic_get_ok(ok, &out, sizeof(int), ERRINFO));
+		ASSERT(out == 42);
+		ASSERT(!res_region_end(region));
+		ASSERT(!g_res_region);
+		ASSERT(get_state(ok) == RES_STATE_INVALID);
+		ASSERT(get_state(moved) == RES_STATE_INVALID);
+		ASSERT(!g_res_pools[RES_CLASS_COUNT].count);
+		ASSERT(!g_res_pools[RES_CLASS_COUNT].free_count);
+		ASSERT(!*res_free_word_of(&g_res_pools[RES_CLASS_COUNT], 0));
+		ASSERT(!g_res_regions_used);
+		res_stats_t stats;
+		(void)res_stats(&stats);
+		ASSERT(!stats.live);
+		ASSERT(stats.high_water == 3);
+		res_leak_t leaks[1];
+		ASSERT(!res_leaks(leaks, 1));
+		// The memory is reused by the next region, the stale ids stay invalid
+		ASSERT(!res_region_begin(&region));
+		ASSERT(region.slot == 1);
+		size_t reused = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		ASSERT(res_id_index(reused) == res_id_index(ok) && res_id_pool(reused) == res_id_pool(ok));
+		ASSERT(reused != ok);
+		ASSERT(get_state(ok) == RES_STATE_INVALID);
+		ASSERT(res_generic_get_ok(ok, &out, sizeof(int), ERRINFO) == 2);
+		res_generic_del(ok, ERRINFO);
+		ASSERT(get_state(reused) == RES_STATE_OK);
+		ASSERT(!res_region_end(region));
+	}
+	{ // Regions nest
+		res_region_t outer, inner;
+		ASSERT(!res_region_begin(&outer));
+		size_t a = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		ASSERT(!res_region_begin(&inner));
+		ASSERT(inner.slot == 2 && inner.prev == outer.slot);
+		size_t b = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		ASSERT(res_id_region(b) == inner.slot);
+		ASSERT(res_region_end(outer) == 1);
+		ASSERT(!res_region_end(inner));
+		ASSERT(g_res_region == outer.slot);
+		ASSERT(get_state(a) == RES_STATE_OK);
+		ASSERT(get_state(b) == RES_STATE_INVALID);
+		ASSERT(!res_region_end(outer));
+		ASSERT(get_state(a) == RES_STATE_INVALID);
+		size_t global = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		ASSERT(!res_id_region(global));
+		res_generic_del(global, ERRINFO);
+	}
+	{ // A taken result object goes back with its region
+		res_region_t region;
+		ASSERT(!res_region_begin(&region));
+		size_t id = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		ASSERT(res_generic_take(id, sizeof(int), ERRINFO) != NULL);
+		ASSERT(!res_region_end(region));
+		size_t other = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		ASSERT(res_generic_take(other, sizeof(int), ERRINFO) != NULL);
+		ASSERT(!g_res_pools[RES_CLASS_COUNT].free_count);
+		ASSERT(g_res_taken == other);
+	}
+	{ // The slot part of the generation wraps without touching the epoch
+		res_region_t region;
+		ASSERT(!res_region_begin(&region));
+		size_t id = res_generic_err("msg", ERRINFO);
+		*res_tag_of(&g_res_pools[res_id_pool(id)], res_id_index(id)) =
+			res_make_tag(res_id_gen(id) | RES_SLOT_GEN_MASK, RES_STATE_ERR);
+		id = res_make_id(res_id_pool(id), res_id_index(id), res_id_gen(id) | RES_SLOT_GEN_MASK);
+		size_t moved = res_generic_err_from(id, ERRINFO);
+		ASSERT(get_state(moved) == RES_STATE_ERR);
+		ASSERT(!(res_id_gen(moved) & RES_SLOT_GEN_MASK));
+		ASSERT(!res_region_end(region));
+	}
+	{ // An id from before the epoch wrapped stays invalid when it comes around
+		size_t epochs = 1LU << RES_EPOCH_BITS;
+		res_region_t region;
+		ASSERT(!res_region_begin(&region));
+		g_res_region_epochs[region.slot] = epochs - 1;
+		size_t stale = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		ASSERT(!res_region_end(region));
+		ASSERT(get_state(stale) == RES_STATE_INVALID);
+		ASSERT(!res_region_begin(&region));
+		g_res_region_epochs[region.slot] = 2 * epochs - 1;
+		size_t id = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		ASSERT(res_id_index(id) == res_id_index(stale));
+		ASSERT(res_id_gen(id) >> RES_SLOT_GEN_BITS == res_id_gen(stale) >> RES_SLOT_GEN_BITS);
+		ASSERT(id != stale);
+		ASSERT(get_state(stale) == RES_STATE_INVALID);
+		ASSERT(res_generic_get_ok(stale, NULL, sizeof(int), ERRINFO) == 2);
+		g_res_fallback.state = RES_STATE_INVALID;
+		ASSERT(!res_generic_get_ok(id, NULL, sizeof(int), ERRINFO));
+		ASSERT(!res_region_end(region));
+	}
+	{ // All regions in use
+		res_region_t regions[RES_REGION_COUNT];
+		for (size_t i = 1; i < RES_REGION_COUNT; i++) {
+			ASSERT(!res_region_begin(&regions[i]));
+		}
+		res_region_t region;
+		ASSERT(res_region_begin(&region) == 2);
+		for (size_t i = RES_REGION_COUNT - 1; i >= 1; i--) {
+			ASSERT(!res_region_end(regions[i]));
+		}
+		ASSERT(!g_res_region);
+	}
+	reset_globals();
 }
 
 void test_generic() {
 	test_reset_globals();
+	test_size_class();
+	test_chunks();
+	test_growth();
+	test_res_init();
 	test_set_id();
+	test_free_bitmap();
 	test_generic_ok();
 	test_generic_err();
 	test_generic_get_ok();
+	test_generic_peek();
+	test_generic_take();
+	test_generic_reserve();
+	test_generic_unwrap();
+	test_sites();
+	test_generic_lazy();
 	test_generic_err_from();
 	test_generic_del();
+	test_generic_batch();
+	test_generation();
 	test_generic_print_err();
+	test_reports();
+	test_log();
+	test_limit();
+	test_regions();
+	test_fallback();
+	test_stats();
+	test_leaks();
 }
@@ -0,0 +1,380 @@
+#include "test_utils.h"
+#include <pthread.h>
+
+#define STRESS_THREADS 8
+#define STRESS_ITERATIONS 20000
+#define STRESS_LIVE 3
+/** Size of the owner table of each size class, twice the most ids the
+ * batch workers hold at once. */
+#define STRESS_OWNERS (2 * STRESS_THREADS * STRESS_LIVE * 4)
+
+/** Owner of each id, 0 if the id is not held by any thread. */
+static RES_TLS _Atomic size_t g_owner[RES_CLASS_COUNT][STRESS_OWNERS];
+/** Number of ids handed out twice at the same time. */
+static _Atomic size_t g_duplicates;
+/** Number of results whose value didn't survive the round trip. */
+static _Atomic size_t g_corrupted;
+/** Number of results that couldn't be created. */
+static _Atomic size_t g_exhausted;
+
+/** Returns the owner of an id, NULL if its index is beyond the owner table.
+ * \param id The id. */
+static _Atomic size_t *owner_of(size_t id) {
+	return res_id_index(id) < STRESS_OWNERS ? &g_owner[res_id_class(id)][res_id_index(id)] : NULL;
+}
+
+static void *stress_worker(void *arg) {
+	size_t self = (size_t)arg + 1;
+	size_t ids[STRESS_LIVE];
+	size_t values[STRESS_LIVE];
+	for (size_t i = 0; i < STRESS_ITERATIONS; i++) {
+		for (size_t j = 0; j < STRESS_LIVE; j++) {
+			values[j] = (self << 32) | (i * STRESS_LIVE + j);
+			ids[j] = (i + j) % 2 ?
+				res_generic_ok(&values[j], alignof(size_t), sizeof(size_t), ERRINFO) :
+				res_generic_err("stress", ERRINFO);
+			if (ids[j] == g_res_fallback_id) {
+				g_exhausted++;
+				continue;
+			}
+			_Atomic size_t *owner = owner_of(ids[j]);
+			size_t expected = 0;
+			if (owner && !atomic_compare_exchange_strong(owner, &expected, self))
+				g_duplicates++;
+		}
+		for (size_t j = 0; j < STRESS_LIVE; j++) {
+			if (ids[j] == g_res_fallback_id) continue;
+			if ((i + j) % 2) {
+				size_t value = 0;
+				if (res_generic_get_ok(ids[j], &value, sizeof(size_t), ERRINFO) || value != values[j])
+					g_corrupted++;
+			} else if (get_state(ids[j]) != RES_STATE_ERR) {
+				g_corrupted++;
+			}
+			if (owner_of(ids[j])) *owner_of(ids[j]) = 0;
+			res_generic_del(ids[j], ERRINFO);
+		}
+	}
+#ifdef RES_THREAD_LOCAL
+	for (size_t c = 0; c < RES_CLASS_COUNT; c++)
+		if (g_res_pools[c].free_count != g_res_pools[c].count) g_corrupted++;
+#endif
+	return NULL;
+}
+
+static void *batch_worker(void *arg) {
+	size_t self = (size_t)arg + 1;
+	size_t ids[STRESS_LIVE * 4];
+	size_t values[STRESS_LIVE * 4];
+	size_t copies[STRESS_LIVE * 4];
+	for (size_t i = 0; i < STRESS_ITERATIONS / 4; i++) {
+		size_t n = 1 + i % (STRESS_LIVE * 4);
+		for (size_t j = 0; j < n; j++) values[j] = (self << 32) | (i * n + j);
+		if (res_generic_ok_n(values, alignof(size_t), sizeof(size_t), n, ids, ERRINFO) != n)
+			g_exhausted++;
+		for (size_t j = 0; j < n; j++) {
+			if (ids[j] == g_res_fallback_id || !owner_of(ids[j])) continue;
+			size_t expected = 0;
+			if (!atomic_compare_exchange_strong(owner_of(ids[j]), &expected, self))
+				g_duplicates++;
+		}
+		size_t oks = res_generic_get_ok_n(ids, n, copies, sizeof(size_t), NULL, ERRINFO);
+		for (size_t j = 0; j < n; j++) {
+			if (ids[j] == g_res_fallback_id) continue;
+			if (copies[j] != values[j]) g_corrupted++;
+			if (owner_of(ids[j])) *owner_of(ids[j]) = 0;
+		}
+		if (oks + (g_res_fallback.state == RES_STATE_ERR) < n) g_corrupted++;
+		res_generic_del_n(ids, n, ERRINFO);
+	}
+	return NULL;
+}
+
+static void *foreign_worker(void *arg) {
+	size_t *ids = arg;
+	int value = 7;
+	ids[1] = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+	ids[2] = (size_t)res_generic_get_ok(ids[0], &value, sizeof(int), ERRINFO);
+	g_res_fallback.state = RES_STATE_INVALID;
+	res_generic_del(ids[1], ERRINFO);
+	return NULL;
+}
+
+static void *share_worker(void *arg) {
+	size_t *ids = arg;
+	int value = 42;
+	ids[0] = res_generic_share(
+		res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO), ERRINFO);
+	ids[1] = res_generic_share(res_generic_err("msg", ERRINFO), ERRINFO);
+	return NULL;
+}
+
+void test_stress_no_lost_or_duplicated_ids() {
+	reset_globals();
+	pthread_t threads[STRESS_THREADS];
+	for (size_t i = 0; i < STRESS_THREADS; i++)
+		pthread_create(&threads[i], NULL, stress_worker, (void *)i);
+	for (size_t i = 0; i < STRESS_THREADS; i++)
+		pthread_join(threads[i], NULL);
+	ASSERT(!g_duplicates);
+	ASSERT(!g_corrupted);
+	ASSERT(!g_exhausted);
+	for (size_t c = 0; c < RES_CLASS_COUNT; c++) {
+		res_pool_t *pool = &g_res_pools[c];
+		ASSERT(pool->count <= RES_BUFF_SIZE);
+		ASSERT(pool->free_count == pool->count);
+		size_t listed = 0;
+		while (res_claim_free_id(pool) != g_res_fallback_id) listed++;
+		ASSERT(listed == pool->count);
+	}
+	reset_globals();
+}
+
+void test_stress_batch() {
+	reset_globals();
+	pthread_t threads[STRESS_THREADS];
+	for (size_t i = 0; i < STRESS_THREADS; i++)
+		pthread_create(&threads[i], NULL, batch_worker, (void *)i);
+	for (size_t i = 0; i < STRESS_THREADS; i++)
+		pthread_join(threads[i], NULL);
+	ASSERT(!g_duplicates);
+	ASSERT(!g_corrupted);
+	ASSERT(!g_exhausted);
+	res_pool_t *pool = &g_res_pools[0];
+	ASSERT(pool->count <= STRESS_OWNERS);
+	ASSERT(pool->free_count == pool->count);
+	size_t listed = 0;
+	while (res_claim_free_id(pool) != g_res_fallback_id) listed++;
+	ASSERT(listed == pool->count);
+	reset_globals();
+}
+
+void test_share() {
+	reset_globals();
+	size_t ids[2] = {0};
+	pthread_t thread;
+	pthread_create(&thread, NULL, share_worker, ids);
+	pthread_join(thread, NULL);
+	int value = 0;
+	ASSERT(ids[0] != g_res_fallback_id);
+	ASSERT(!res_generic_get_ok(ids[0], &value, sizeof(int), ERRINFO));
+	ASSERT(value == 42);
+	ASSERT(res_generic_get_ok(ids[1], &value, sizeof(int), ERRINFO) == 1);
+	g_res_fallback.state = RES_STATE_INVALID;
+	size_t id = res_generic_err_from(ids[1], ERRINFO);
+	ASSERT(id != g_res_fallback_id);
+	ASSERT(!strcmp(get_err(id)->msg, "msg"));
+	ASSERT(get_err(id)->depth == 1);
+	ASSERT(res_generic_err_from(ids[1], ERRINFO) == g_res_fallback_id);
+	g_res_fallback.state = RES_STATE_INVALID;
+	res_generic_del(ids[0], ERRINFO);
+	res_generic_del(id, ERRINFO);
+	ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+	res_generic_del(ids[0], ERRINFO);
+	ASSERT(g_res_fallback.state == RES_STATE_ERR);
+	reset_globals();
+}
+
+void test_foreign_id() {
+	reset_globals();
+	int value = 5;
+	size_t ids[3] = {res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO)};
+	pthread_t thread;
+	pthread_create(&thread, NULL, foreign_worker, ids);
+	pthread_join(thread, NULL);
+#ifdef RES_THREAD_LOCAL
+	// The ids differ only in their owner, but the slot of the other thread
+	// is not read
+	ASSERT(res_id_owner(ids[0]) != res_id_owner(ids[1]));
+	ASSERT((ids[0] ^ ids[1]) >> RES_OWNER_SHIFT);
+	ASSERT(!((ids[0] ^ ids[1]) & ((1LU << RES_OWNER_SHIFT) - 1)));
+	ASSERT(ids[2] == 2);
+#else
+	ASSERT(!ids[2]);
+#endif
+	res_generic_del(ids[0], ERRINFO);
+	ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+	reset_globals();
+}
+
+#ifdef RES_THREAD_LOCAL
+void test_shared_pool() {
+	reset_globals();
+	int value = 1;
+	size_t shared[2 * RES_CHUNK_SIZE];
+	{ // The shared pool grows by chunks up to max_capacity
+		g_res_config.max_capacity = 2 * RES_CHUNK_SIZE;
+		for (size_t i = 0; i < 2 * RES_CHUNK_SIZE; i++) {
+			shared[i] = res_generic_share(
+				res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO), ERRINFO);
+			ASSERT(shared[i] == (i | RES_SHARED_BIT));
+		}
+		ASSERT(g_shared_count == 2 * RES_CHUNK_SIZE);
+		ASSERT(g_shared_chunks[1]);
+		ASSERT(!res_generic_get_ok(shared[2 * RES_CHUNK_SIZE - 1], &value, sizeof(int), ERRINFO));
+	}
+	{ // A full shared pool fails and keeps the source deleted
+		size_t id = res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO);
+		ASSERT(res_generic_share(id, ERRINFO) == g_res_fallback_id);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Not enough memory"));
+		ASSERT(get_state(id) == RES_STATE_INVALID);
+		g_res_fallback.state = RES_STATE_INVALID;
+	}
+	{ // A deleted struct is reused first
+		res_generic_del(shared[3], ERRINFO);
+		shared[3] = res_generic_share(
+			res_generic_ok(&value, alignof(int), sizeof(int), ERRINFO), ERRINFO);
+		ASSERT(shared[3] == (3 | RES_SHARED_BIT));
+		ASSERT(g_shared_count == 2 * RES_CHUNK_SIZE);
+		res_generic_del_n(shared, 2 * RES_CHUNK_SIZE, ERRINFO);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		ASSERT(g_shared_free != g_res_fallback_id);
+	}
+	reset_globals();
+}
+#endif
+
+#ifndef RES_THREAD_LOCAL
+/** Number of words of the values read while they are recycled. */
+#define STRESS_WORDS 8
+/** The id the recycle worker created last. */
+static _Atomic size_t g_recycled_id;
+/** Set once the recycle worker is done. */
+static _Atomic int g_recycle_done;
+
+static void *recycle_worker(void *arg) {
+	(void)arg;
+	size_t words[STRESS_WORDS];
+	for (size_t i = 1; i <= STRESS_ITERATIONS; i++) {
+		for (size_t j = 0; j < STRESS_WORDS; j++) words[j] = i;
+		size_t id = res_generic_ok(words, alignof(size_t), sizeof(words), ERRINFO);
+		atomic_store(&g_recycled_id, id);
+		res_generic_del(id, ERRINFO);
+	}
+	atomic_store(&g_recycle_done, 1);
+	return NULL;
+}
+
+/** Counts the torn words of a value read while it was recycled. A failed
+ * read must leave the value untouched.
+ * \param words The value, zeroed before the read.
+ * \param ret The return value of the read. */
+static size_t count_torn(const size_t *words, int ret) {
+	size_t torn = ret && words[0];
+	for (size_t j = 1; j < STRESS_WORDS; j++) torn += words[j] != words[0];
+	return torn;
+}
+
+void test_stress_reads() {
+	reset_globals();
+	g_recycled_id = g_res_fallback_id;
+	g_recycle_done = 0;
+	pthread_t thread;
+	pthread_create(&thread, NULL, recycle_worker, NULL);
+	size_t torn = 0;
+	while (!atomic_load(&g_recycle_done)) {
+		size_t id = atomic_load(&g_recycled_id);
+		if (id == g_res_fallback_id) continue;
+		size_t words[STRESS_WORDS] = {0};
+		torn += count_torn(words, res_generic_get_ok(id, words, sizeof(words), ERRINFO));
+		g_res_fallback.state = RES_STATE_INVALID;
+		size_t batch[STRESS_WORDS] = {0};
+		unsigned char ok = 0;
+		res_generic_get_ok_n(&id, 1, batch, sizeof(batch), &ok, ERRINFO);
+		torn += count_torn(batch, !ok);
+		g_res_fallback.state = RES_STATE_INVALID;
+#ifdef RES_FAST_PATH
+		size_t fast[STRESS_WORDS] = {0};
+		torn += count_torn(fast, res_fast_get_ok(id, fast, sizeof(fast)));
+#endif
+	}
+	pthread_join(thread, NULL);
+	ASSERT(!torn);
+	reset_globals();
+}
+#endif
+
+/** Number of reports received by count_sink. */
+static size_t g_reports_sunk;
+/** Number of reports received by count_sink out of order. */
+static size_t g_reports_unordered;
+/** The last report received from each thread. */
+static size_t g_last_report[STRESS_THREADS];
+
+static void count_sink(const struct iovec *reports, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		size_t thread, n;
+		if (sscanf(reports[i].iov_base, "%zu %zu", &thread, &n) != 2) continue;
+		if (n <= g_last_report[thread]) g_reports_unordered++;
+		g_last_report[thread] = n;
+		g_reports_sunk++;
+	}
+}
+
+static void *report_worker(void *arg) {
+	size_t self = (size_t)arg;
+	for (size_t i = 1; i <= STRESS_ITERATIONS / 10; i++) {
+		res_report_t *r = claim_report(&g_res_queue);
+		if (!r) {
+			atomic_fetch_add_explicit(&g_res_queue.dropped, 1, memory_order_relaxed);
+			continue;
+		}
+		r->size = (size_t)snprintf(r->text, RES_REPORT_SIZE, "%zu %zu", self, i);
+		publish_report(r);
+		if (i % 16 == 0) res_flush_reports();
+	}
+	return NULL;
+}
+
+void test_stress_reports() {
+	reset_globals();
+	g_res_config.sink = count_sink;
+	pthread_t threads[STRESS_THREADS];
+	for (size_t i = 0; i < STRESS_THREADS; i++)
+		pthread_create(&threads[i], NULL, report_worker, (void *)i);
+	for (size_t i = 0; i < STRESS_THREADS; i++)
+		pthread_join(threads[i], NULL);
+	res_flush_reports();
+	ASSERT(!g_reports_unordered);
+	ASSERT(g_reports_sunk + g_res_queue.dropped == STRESS_THREADS * (STRESS_ITERATIONS / 10));
+	ASSERT(g_res_queue.reported == g_res_queue.dropped);
+	reset_globals();
+}
+
+/** Number of errors reported by limit_worker, including the summarized ones. */
+static _Atomic uint64_t g_limit_reported;
+
+static void *limit_worker(void *arg) {
+	res_limit_t *limit = arg;
+	for (size_t i = 0; i < STRESS_ITERATIONS; i++) {
+		uint64_t suppressed = 0;
+		if (limit_report(limit, RES_REPORT_WINDOW * 1000000u * (1 + i / 1000), &suppressed))
+			g_limit_reported += 1 + suppressed;
+	}
+	return NULL;
+}
+
+void test_stress_limit() {
+	reset_globals();
+	pthread_t threads[STRESS_THREADS];
+	for (size_t i = 0; i < STRESS_THREADS; i++)
+		pthread_create(&threads[i], NULL, limit_worker, &g_res_limits[1]);
+	for (size_t i = 0; i < STRESS_THREADS; i++)
+		pthread_join(threads[i], NULL);
+	ASSERT(g_limit_reported + g_res_limits[1].suppressed == STRESS_THREADS * STRESS_ITERATIONS);
+	reset_globals();
+}
+
+void test_stress() {
+	test_stress_no_lost_or_duplicated_ids();
+	test_stress_batch();
+	test_share();
+	test_foreign_id();
+#ifdef RES_THREAD_LOCAL
+	test_shared_pool();
+#else
+	test_stress_reads();
+#endif
+	test_stress_reports();
+	test_stress_limit();
+}
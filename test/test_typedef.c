@@ -1,51 +1,85 @@
+#define _GNU_SOURCE
 #include "test_utils.h"
+#include <dlfcn.h>
 
 typedef struct {
 	char buff[OK_BUFF_SIZE * 2];
 } obj;
 
+typedef struct {
+	double x;
+	double y;
+} point;
+
+/** Bigger than the error struct, so its OK results and its error results
+ * live in different size classes. */
+typedef struct {
+	char buff[200];
+} big;
+
 TYPEDEF_RES(int);
 TYPEDEF_RES(obj);
+TYPEDEF_RES(point);
+TYPEDEF_RES(big);
 
 void test_res_int_ok() {
 	reset_globals();
 	{ // Happy path
 		res_int_t res = res_int_ok(5, ERRINFO);
-		ASSERT(g_res_count == 1);
-		ASSERT(g_res_buff[res.id].state == RES_STATE_OK);
-		ASSERT(*g_res_buff[res.id].ok == 5);
+		ASSERT(res.id == RES_INLINE_ID);
+		ASSERT(!g_res_pools[0].count);
+		int ok = 0;
+		memcpy(&ok, RES_INLINE_OK(res), sizeof(int));
+		ASSERT(ok == 5);
 		reset_globals();
 	}
-	{ // Alloc into free list
-		g_res_count = RES_BUFF_SIZE;
-		g_free_buff[0] = 0;
-		g_free_count = 1;
+	{ // Buffer full, stored inline anyway
+		g_res_config.max_capacity = RES_BUFF_SIZE;
+		g_res_pools[0].count = RES_BUFF_SIZE;
 		res_int_t res = res_int_ok(5, ERRINFO);
-		ASSERT(g_res_count == RES_BUFF_SIZE);
-		ASSERT(g_res_buff[res.id].state == RES_STATE_OK);
-		ASSERT(*g_res_buff[res.id].ok == 5);
-		ASSERT(!g_free_count);
+		ASSERT(res.id == RES_INLINE_ID);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+	{ // Happy path, not inline
+		res_point_t res = res_point_ok((point){1.0, 2.0}, ERRINFO);
+		ASSERT(sizeof(res) == sizeof(size_t));
+		ASSERT(g_res_pools[0].count == 1);
+		ASSERT(get_state(res.id) == RES_STATE_OK);
+		ASSERT(((point *)(void *)res_get_data(res.id))->y == 2.0);
+		reset_globals();
+	}
+	{ // Alloc a freed result object
+		g_res_config.max_capacity = RES_BUFF_SIZE;
+		g_res_pools[0].count = RES_BUFF_SIZE;
+		res_free_index(&g_res_pools[0], 0);
+		res_point_t res = res_point_ok((point){1.0, 2.0}, ERRINFO);
+		ASSERT(g_res_pools[0].count == RES_BUFF_SIZE);
+		ASSERT(get_state(res.id) == RES_STATE_OK);
+		ASSERT(((point *)(void *)res_get_data(res.id))->y == 2.0);
+		ASSERT(!g_res_pools[0].free_count);
 		reset_globals();
 	}
 	{ // Out of memory
-		g_res_count = RES_BUFF_SIZE;
-		g_free_count = 0;
-		res_int_t res = res_int_ok(5, ERRINFO);
+		g_res_config.max_capacity = RES_BUFF_SIZE;
+		g_res_pools[0].count = RES_BUFF_SIZE;
+		g_res_pools[0].free_count = 0;
+		res_point_t res = res_point_ok((point){1.0, 2.0}, ERRINFO);
 		int line = __LINE__ - 1;
-		ASSERT(g_res_count == RES_BUFF_SIZE);
-		ASSERT(!g_free_count);
-		ASSERT(res.id == g_fallback_id);
+		ASSERT(g_res_pools[0].count == RES_BUFF_SIZE);
+		ASSERT(!g_res_pools[0].free_count);
+		ASSERT(res.id == g_res_fallback_id);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(g_res_fallback.err.err_info->line == line);
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Not enough memory"));
 		reset_globals();
 	}
 	{ // Type too big
 		res_obj_t res = res_obj_ok((obj){0}, ERRINFO);
 		int line = __LINE__ - 1;
-		ASSERT(res.id == g_fallback_id);
+		ASSERT(res.id == g_res_fallback_id);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(g_res_fallback.err.err_info->line == line);
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Not enough memory"));
 		reset_globals();
 	}
@@ -56,44 +90,45 @@ void test_res_int_err() {
 	{ // Happy path
 		res_int_t res = res_int_err("msg", ERRINFO);
 		int line = __LINE__ - 1;
-		ASSERT(g_res_count == 1);
-		ASSERT(!res.id);
-		ASSERT(g_res_buff[res.id].state == RES_STATE_ERR);
-		ASSERT(!strcmp(g_res_buff[res.id].err.msg, "msg"));
-		ASSERT(g_res_buff[res.id].err.err_info.line == line);
-		ASSERT(!strcmp(g_res_buff[res.id].err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_buff[res.id].err.err_info.func, __func__));
-		reset_globals();
-	}
-	{ // Allocate in free list
-		g_res_count = RES_BUFF_SIZE;
-		g_free_buff[0] = 0;
-		g_free_count = 1;
+		ASSERT(g_res_pools[RES_ERR_CLASS].count == 1);
+		ASSERT(res.id == res_make_id(RES_ERR_CLASS, 0, 0));
+		ASSERT(get_state(res.id) == RES_STATE_ERR);
+		ASSERT(!strcmp(get_err(res.id)->msg, "msg"));
+		ASSERT(get_err(res.id)->err_info->line == line);
+		ASSERT(!strcmp(get_err(res.id)->err_info->file, __FILE__));
+		ASSERT(!strcmp(get_err(res.id)->err_info->func, __func__));
+		reset_globals();
+	}
+	{ // Allocate a freed result object
+		g_res_config.max_capacity = RES_BUFF_SIZE;
+		g_res_pools[RES_ERR_CLASS].count = RES_BUFF_SIZE;
+		res_free_index(&g_res_pools[RES_ERR_CLASS], 0);
 		res_int_t res = res_int_err("msg", ERRINFO);
 		int line = __LINE__ - 1;
-		ASSERT(g_res_count == RES_BUFF_SIZE);
-		ASSERT(!g_free_count);
-		ASSERT(!res.id);
-		ASSERT(g_res_buff[res.id].state == RES_STATE_ERR);
-		ASSERT(!strcmp(g_res_buff[res.id].err.msg, "msg"));
-		ASSERT(g_res_buff[res.id].err.err_info.line == line);
-		ASSERT(!strcmp(g_res_buff[res.id].err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_buff[res.id].err.err_info.func, __func__));
+		ASSERT(g_res_pools[RES_ERR_CLASS].count == RES_BUFF_SIZE);
+		ASSERT(!g_res_pools[RES_ERR_CLASS].free_count);
+		ASSERT(res.id == res_make_id(RES_ERR_CLASS, 0, 0));
+		ASSERT(get_state(res.id) == RES_STATE_ERR);
+		ASSERT(!strcmp(get_err(res.id)->msg, "msg"));
+		ASSERT(get_err(res.id)->err_info->line == line);
+		ASSERT(!strcmp(get_err(res.id)->err_info->file, __FILE__));
+		ASSERT(!strcmp(get_err(res.id)->err_info->func, __func__));
 		reset_globals();
 	}
 	{ // Not enough memory
-		g_res_count = RES_BUFF_SIZE;
-		g_free_count = 0;
+		g_res_config.max_capacity = RES_BUFF_SIZE;
+		g_res_pools[RES_ERR_CLASS].count = RES_BUFF_SIZE;
+		g_res_pools[RES_ERR_CLASS].free_count = 0;
 		res_int_t res = res_int_err("msg", ERRINFO);
 		int line = __LINE__ - 1;
-		ASSERT(res.id == g_fallback_id);
-		ASSERT(g_res_count == RES_BUFF_SIZE);
-		ASSERT(!g_free_count);
+		ASSERT(res.id == g_res_fallback_id);
+		ASSERT(g_res_pools[RES_ERR_CLASS].count == RES_BUFF_SIZE);
+		ASSERT(!g_res_pools[RES_ERR_CLASS].free_count);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Not enough memory"));
-		ASSERT(g_res_fallback.err.err_info.line == line);
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
+		ASSERT(g_res_fallback.err.err_info->line == line);
+		ASSERT(!strcmp(g_res_fallback.err.err_info->file, __FILE__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->func, __func__));
 		reset_globals();
 	}
 }
@@ -107,17 +142,24 @@ void test_res_int_get_ok() {
 		ASSERT(ok == 5);
 		reset_globals();
 	}
+	{ // Happy path, not inline
+		res_point_t res = res_point_ok((point){1.0, 2.0}, ERRINFO);
+		point ok = {0};
+		ASSERT(!res_point_get_ok(res, &ok, ERRINFO));
+		ASSERT(ok.x == 1.0 && ok.y == 2.0);
+		reset_globals();
+	}
 	{ // Invalid id
 		res_int_t res = {.id = RES_BUFF_SIZE / 2};
 		int ok = 0;
 		ASSERT(res_int_get_ok(res, &ok, ERRINFO) == 2);
 		int line = __LINE__ - 1;
-		ASSERT(!g_res_count);
+		ASSERT(!g_res_pools[RES_ERR_CLASS].count);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(!strcmp(g_res_fallback.err.err_info->file, __FILE__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->func, __func__));
+		ASSERT(g_res_fallback.err.err_info->line == line);
 		reset_globals();
 	}
 	{ // Size too big
@@ -125,12 +167,12 @@ void test_res_int_get_ok() {
 		obj ok = {0};
 		ASSERT(res_obj_get_ok(res, &ok, ERRINFO) == 2);
 		int line = __LINE__ - 1;
-		ASSERT(!g_res_count);
+		ASSERT(!g_res_pools[RES_ERR_CLASS].count);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(!strcmp(g_res_fallback.err.err_info->file, __FILE__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->func, __func__));
+		ASSERT(g_res_fallback.err.err_info->line == line);
 		reset_globals();
 	}
 	{ // Res state not RES_STATE_OK
@@ -140,9 +182,9 @@ void test_res_int_get_ok() {
 		int line = __LINE__ - 1;
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Result state is not RES_STATE_OK"));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(!strcmp(g_res_fallback.err.err_info->file, __FILE__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->func, __func__));
+		ASSERT(g_res_fallback.err.err_info->line == line);
 		reset_globals();
 	}
 }
@@ -151,24 +193,24 @@ void test_res_int_get_err_from() {
 	reset_globals();
 	{ // Happy path
 		res_int_t res1 = res_int_err("msg", ERRINFO);
+		int line = __LINE__ - 1;
 		res_int_t res2 = res_int_err_from(res1.id, ERRINFO);
-		int line = __LINE__ - 2;
-		ASSERT(g_res_buff[res2.id].state == RES_STATE_ERR);
-		ASSERT(g_res_buff[res2.id].err.err_info.line == line);
-		ASSERT(!strcmp(g_res_buff[res2.id].err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_buff[res2.id].err.err_info.func, __func__));
-		ASSERT(!strcmp(g_res_buff[res2.id].err.msg, "msg"));
+		ASSERT(get_state(res2.id) == RES_STATE_ERR);
+		ASSERT(get_err(res2.id)->err_info->line == line);
+		ASSERT(!strcmp(get_err(res2.id)->err_info->file, __FILE__));
+		ASSERT(!strcmp(get_err(res2.id)->err_info->func, __func__));
+		ASSERT(!strcmp(get_err(res2.id)->msg, "msg"));
 		reset_globals();
 	}
 	{ // Invalid src id
 		res_int_t res1 = {.id = RES_BUFF_SIZE / 2};
 		res_int_t res2 = res_int_err_from(res1.id, ERRINFO);
 		int line = __LINE__ - 1;
-		ASSERT(res2.id == g_fallback_id);
+		ASSERT(res2.id == g_res_fallback_id);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(g_res_fallback.err.err_info.line == line);
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
+		ASSERT(g_res_fallback.err.err_info->line == line);
+		ASSERT(!strcmp(g_res_fallback.err.err_info->file, __FILE__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->func, __func__));
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
 		reset_globals();
 	}
@@ -176,43 +218,27 @@ void test_res_int_get_err_from() {
 		res_int_t res1 = res_int_ok(5, ERRINFO);
 		res_int_t res2 = res_int_err_from(res1.id, ERRINFO);
 		int line = __LINE__ - 1;
-		ASSERT(res2.id == g_fallback_id);
+		ASSERT(res2.id == g_res_fallback_id);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(g_res_fallback.err.err_info.line == line);
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
+		ASSERT(g_res_fallback.err.err_info->line == line);
+		ASSERT(!strcmp(g_res_fallback.err.err_info->file, __FILE__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->func, __func__));
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
 		reset_globals();
 	}
-	{ // Not enough memory
-		res_int_t res1 = res_int_err("msg", ERRINFO);
-		g_res_count = RES_BUFF_SIZE;
-		g_free_count = 0;
-		res_int_t res2 = res_int_err_from(res1.id, ERRINFO);
-		int line = __LINE__ - 1;
-		ASSERT(res2.id == g_fallback_id);
-		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(g_res_fallback.err.err_info.line == line);
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
-		ASSERT(!strcmp(g_res_fallback.err.msg, "Not enough memory"));
-		reset_globals();
-	}
-	{ // Allocate in free list
+	{ // The error is moved without allocating
 		res_int_t res1 = res_int_err("msg", ERRINFO);
 		int line = __LINE__ - 1;
-		g_free_count = 1;
-		g_free_buff[0] = 0;
-		g_res_count = RES_BUFF_SIZE;
+		g_res_config.max_capacity = RES_BUFF_SIZE;
+		g_res_pools[RES_ERR_CLASS].count = RES_BUFF_SIZE;
+		g_res_pools[RES_ERR_CLASS].free_count = 0;
 		res_int_t res2 = res_int_err_from(res1.id, ERRINFO);
-		ASSERT(g_res_count == RES_BUFF_SIZE);
-		ASSERT(!g_free_count);
-		ASSERT(!res2.id);
-		ASSERT(g_res_buff[res2.id].state == RES_STATE_ERR);
-		ASSERT(g_res_buff[res2.id].err.err_info.line == line);
-		ASSERT(!strcmp(g_res_buff[res2.id].err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_buff[res2.id].err.err_info.func, __func__));
-		ASSERT(!strcmp(g_res_buff[res2.id].err.msg, "msg"));
+		ASSERT(res2.id == res_make_id(RES_ERR_CLASS, res_id_index(res1.id), res_id_gen(res1.id) + 1));
+		ASSERT(get_state(res2.id) == RES_STATE_ERR);
+		ASSERT(get_state(res1.id) == RES_STATE_INVALID);
+		ASSERT(get_err(res2.id)->err_info->line == line);
+		ASSERT(!strcmp(get_err(res2.id)->msg, "msg"));
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
 		reset_globals();
 	}
 }
@@ -220,51 +246,45 @@ void test_res_int_get_err_from() {
 void test_res_int_del() {
 	reset_globals();
 	{ // Happy path
+		res_point_t res = res_point_ok((point){1.0, 2.0}, ERRINFO);
+		ASSERT(get_state(res.id) == RES_STATE_OK);
+		res_point_del(res, ERRINFO);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		ASSERT(get_state(res.id) == RES_STATE_INVALID);
+		ASSERT(g_res_pools[0].free_count == 1);
+		reset_globals();
+	}
+	{ // Inline
 		res_int_t res = res_int_ok(5, ERRINFO);
-		ASSERT(g_res_buff[res.id].state == RES_STATE_OK);
 		res_int_del(res, ERRINFO);
 		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
-		ASSERT(g_res_buff[res.id].state == RES_STATE_INVALID);
-		ASSERT(g_free_count == 1);
+		ASSERT(!g_res_pools[0].free_count);
 		reset_globals();
 	}
 	{ // Invalid id
 		res_int_del((res_int_t){.id = RES_BUFF_SIZE / 2}, ERRINFO);
 		int line = __LINE__ - 1;
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(!g_res_count);
-		ASSERT(g_res_fallback.err.err_info.line == line);
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
+		ASSERT(!g_res_pools[0].count);
+		ASSERT(g_res_fallback.err.err_info->line == line);
+		ASSERT(!strcmp(g_res_fallback.err.err_info->func, __func__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->file, __FILE__));
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
 		reset_globals();
 	}
 	{ // Res has already been deleted
-		res_int_t res = res_int_ok(5, ERRINFO);
-		res_int_del(res, ERRINFO);
-		res_int_del(res, ERRINFO);
+		res_point_t res = res_point_ok((point){1.0, 2.0}, ERRINFO);
+		res_point_del(res, ERRINFO);
+		res_point_del(res, ERRINFO);
 		int line = __LINE__ - 1;
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(g_res_count == 1);
-		ASSERT(g_res_fallback.err.err_info.line == line);
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
+		ASSERT(g_res_pools[0].count == 1);
+		ASSERT(g_res_fallback.err.err_info->line == line);
+		ASSERT(!strcmp(g_res_fallback.err.err_info->func, __func__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->file, __FILE__));
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
 		reset_globals();
 	}
-	{ // Res has already been deleted
-		res_int_t res = res_int_ok(5, ERRINFO);
-		g_free_count = FREE_BUFF_SIZE;
-		res_int_del(res, ERRINFO);
-		int line = __LINE__ - 1;
-		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(g_res_count == 1);
-		ASSERT(g_res_fallback.err.err_info.line == line);
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.msg, "Not enough memory"));
-		reset_globals();
-	}
 }
 
 void test_res_int_print_err() {
@@ -281,10 +301,10 @@ void test_res_int_print_err() {
 		int line = __LINE__ - 1;
 		ASSERT(!g_is_error_printed);
 		ASSERT(g_is_fallback_error_printed);
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(g_res_fallback.err.err_info->line == line);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->file, __FILE__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->func, __func__));
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
 		reset_globals();
 	}
@@ -294,20 +314,368 @@ void test_res_int_print_err() {
 		int line = __LINE__ - 1;
 		ASSERT(!g_is_error_printed);
 		ASSERT(g_is_fallback_error_printed);
-		ASSERT(g_res_fallback.err.err_info.line == line);
+		ASSERT(g_res_fallback.err.err_info->line == line);
 		ASSERT(g_res_fallback.state == RES_STATE_ERR);
-		ASSERT(!strcmp(g_res_fallback.err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_fallback.err.err_info.func, __func__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->file, __FILE__));
+		ASSERT(!strcmp(g_res_fallback.err.err_info->func, __func__));
 		ASSERT(!strcmp(g_res_fallback.err.msg, "Invalid argument"));
 		reset_globals();
 	}
 }
 
+void test_res_int_peek_take() {
+	reset_globals();
+	{ // Inline values are borrowed from the handle
+		res_int_t res = res_int_ok(5, ERRINFO);
+		const int *ptr = res_int_peek(&res, ERRINFO);
+		ASSERT(ptr == (const void *)RES_INLINE_OK(res));
+		ASSERT(*ptr == 5);
+		ASSERT(res_int_take(&res, ERRINFO) == ptr);
+		reset_globals();
+	}
+	{ // Pooled values are borrowed from the pool
+		res_point_t res = res_point_ok((point){1.0, 2.0}, ERRINFO);
+		const point *ptr = res_point_peek(&res, ERRINFO);
+		ASSERT(ptr == (const void *)res_get_data(res.id));
+		ASSERT(ptr->x == 1.0 && ptr->y == 2.0);
+		ASSERT(res_point_take(&res, ERRINFO) == ptr);
+		ASSERT(get_state(res.id) == RES_STATE_INVALID);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+	{ // Error
+		res_point_t res = res_point_err("msg", ERRINFO);
+		ASSERT(!res_point_peek(&res, ERRINFO));
+		ASSERT(!res_point_take(&res, ERRINFO));
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		reset_globals();
+	}
+}
+
+void test_res_big_get_ok() {
+	reset_globals();
+	{ // Happy path
+		big value = {{1}};
+		res_big_t res = res_big_ok(value, ERRINFO);
+		big ok = {{0}};
+		ASSERT(!res_big_get_ok(res, &ok, ERRINFO));
+		ASSERT(ok.buff[0] == 1);
+		ASSERT(res_big_peek(&res, ERRINFO)->buff[0] == 1);
+		res_big_del(res, ERRINFO);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+	{ // An error result is in a smaller size class than the OK value
+		res_big_t res = res_big_err("msg", ERRINFO);
+		big ok = {{0}};
+		unsigned char oks[1] = {1};
+		ASSERT(res_big_get_ok(res, &ok, ERRINFO) == 1);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Result state is not RES_STATE_OK"));
+		g_res_fallback.state = RES_STATE_INVALID;
+		ASSERT(!res_big_get_ok_n(&res.id, 1, &ok, oks, ERRINFO));
+		ASSERT(!oks[0]);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		ASSERT(!res_big_peek(&res, ERRINFO));
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Result state is not RES_STATE_OK"));
+		g_res_fallback.state = RES_STATE_INVALID;
+		ASSERT(!res_big_take(&res, ERRINFO));
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Result state is not RES_STATE_OK"));
+		ASSERT(get_state(res.id) == RES_STATE_ERR);
+		reset_globals();
+	}
+	{ // A shared error result of a type bigger than any OK value
+		res_obj_t res = res_obj_share(res_obj_err("msg", ERRINFO), ERRINFO);
+		unsigned char oks[1] = {1};
+		ASSERT(res_obj_get_ok(res, NULL, ERRINFO) == 1);
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Result state is not RES_STATE_OK"));
+		g_res_fallback.state = RES_STATE_INVALID;
+		ASSERT(!res_obj_get_ok_n(&res.id, 1, NULL, oks, ERRINFO));
+		ASSERT(!oks[0]);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		ASSERT(!res_obj_peek(&res, ERRINFO));
+		ASSERT(!strcmp(g_res_fallback.err.msg, "Result state is not RES_STATE_OK"));
+		reset_globals();
+	}
+}
+
+#ifdef RES_TRACK
+void test_res_ok_leak() {
+	reset_globals();
+	{ // Leaks of OK() are reported at the creation site
+		int line = __LINE__ + 1;
+		res_point_t res = OK(point, ((point){1.0, 2.0}));
+		res_leak_t leaks[1] = {0};
+		ASSERT(res_leaks(leaks, 1) == 1);
+		ASSERT(leaks[0].count == 1);
+		ASSERT(leaks[0].site.line == line);
+		ASSERT(!strcmp(leaks[0].site.file, __FILE__));
+		ASSERT(!strcmp(leaks[0].site.func, __func__));
+		res_point_del(res, ERRINFO);
+		ASSERT(!res_leaks(leaks, 1));
+		reset_globals();
+	}
+}
+#endif
+
+void test_res_reserve() {
+	reset_globals();
+	{ // OK
+		size_t id = 0;
+		point *ptr = res_point_reserve(&id, ERRINFO);
+		ASSERT(ptr);
+		ptr->x = 1.0;
+		ptr->y = 2.0;
+		res_point_t res = res_point_commit(id, ERRINFO);
+		point ok = {0};
+		ASSERT(!res_point_get_ok(res, &ok, ERRINFO));
+		ASSERT(ok.x == 1.0 && ok.y == 2.0);
+		reset_globals();
+	}
+	{ // Error
+		size_t id = 0;
+		ASSERT(res_point_reserve(&id, ERRINFO));
+		res_point_t res = res_point_commit_err(id, "msg", ERRINFO);
+		point ok = {0};
+		ASSERT(res_point_get_ok(res, &ok, ERRINFO) == 1);
+		ASSERT(!strcmp(get_err(res.id)->msg, "msg"));
+		reset_globals();
+	}
+	{ // Too big
+		size_t id = 0;
+		ASSERT(!res_obj_reserve(&id, ERRINFO));
+		res_obj_t res = res_obj_commit(id, ERRINFO);
+		ASSERT(res.id == g_res_fallback_id);
+		reset_globals();
+	}
+}
+
+static res_int_t try_point(res_point_t res, point *ok) {
+	TRY(point, res, ok, int);
+	return res_int_ok(1, ERRINFO);
+}
+
+static res_int_t try_big(res_big_t res, big *ok) {
+	TRY(big, res, ok, int);
+	return res_int_ok(1, ERRINFO);
+}
+
+void test_res_try() {
+	reset_globals();
+	{ // The OK result object is deleted
+		res_point_t res = res_point_ok((point){1.0, 2.0}, ERRINFO);
+		point ok = {0};
+		g_is_return_called = 0;
+		ASSERT(try_point(res, &ok).id == RES_INLINE_ID);
+		ASSERT(!g_is_return_called);
+		ASSERT(ok.x == 1.0 && ok.y == 2.0);
+		ASSERT(get_state(res.id) == RES_STATE_INVALID);
+		ASSERT(g_res_pools[0].free_count == 1);
+		reset_globals();
+	}
+	{ // The error result object is moved in place
+		res_point_t res = res_point_err("msg", ERRINFO);
+		point ok = {0};
+		g_is_return_called = 0;
+		res_int_t ret = try_point(res, &ok);
+		ASSERT(g_is_return_called);
+		ASSERT(res_id_index(ret.id) == res_id_index(res.id));
+		ASSERT(get_state(res.id) == RES_STATE_INVALID);
+		ASSERT(get_err(ret.id)->depth == 1);
+		ASSERT(g_res_pools[RES_ERR_CLASS].count == 1);
+		ASSERT(res_int_get_ok(ret, NULL, ERRINFO) == 1);
+		reset_globals();
+	}
+	{ // The error of a type bigger than the error struct is moved as well
+		res_big_t res = res_big_err("msg", ERRINFO);
+		big ok = {{0}};
+		g_is_return_called = 0;
+		res_int_t ret = try_big(res, &ok);
+		ASSERT(g_is_return_called);
+		ASSERT(res_id_index(ret.id) == res_id_index(res.id));
+		ASSERT(!strcmp(get_err(ret.id)->msg, "msg"));
+		ASSERT(get_err(ret.id)->depth == 1);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		res_int_del(ret, ERRINFO);
+		ASSERT(g_res_pools[RES_ERR_CLASS].free_count == g_res_pools[RES_ERR_CLASS].count);
+		reset_globals();
+	}
+	{ // A shared error of a type bigger than any OK value
+		res_obj_t res = res_obj_share(res_obj_err("msg", ERRINFO), ERRINFO);
+		size_t err_id;
+		ASSERT(res_obj_unwrap(res, NULL, &err_id, ERRINFO) == 1);
+		ASSERT(err_id != g_res_fallback_id);
+		ASSERT(!strcmp(get_err(err_id)->msg, "msg"));
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		ASSERT(res_obj_get_ok(res, NULL, ERRINFO) == 2);
+		res_generic_del(err_id, ERRINFO);
+		reset_globals();
+	}
+}
+
+void test_res_batch() {
+	reset_globals();
+	{ // Inline types are stored in the buffer as well
+		int values[3] = {1, 2, 3}, copies[3] = {0};
+		unsigned char oks[3] = {0};
+		size_t ids[3];
+		ASSERT(res_int_ok_n(values, 3, ids, ERRINFO) == 3);
+		ASSERT(ids[2] != RES_INLINE_ID);
+		ASSERT(g_res_pools[0].count == 3);
+		res_int_t res = {.id = ids[1]};
+		int ok = 0;
+		ASSERT(!res_int_get_ok(res, &ok, ERRINFO));
+		ASSERT(ok == 2);
+		ASSERT(res_int_get_ok_n(ids, 3, copies, oks, ERRINFO) == 3);
+		ASSERT(oks[0] && oks[1] && oks[2]);
+		ASSERT(copies[2] == 3);
+		res_int_del_n(ids, 3, ERRINFO);
+		ASSERT(g_res_pools[0].free_count == 3);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+	{ // With an error
+		int values[1] = {1}, copies[2] = {0};
+		unsigned char oks[2] = {0};
+		size_t ids[2];
+		ASSERT(res_int_ok_n(values, 1, ids, ERRINFO) == 1);
+		ids[1] = res_int_err("msg", ERRINFO).id;
+		ASSERT(res_int_get_ok_n(ids, 2, copies, oks, ERRINFO) == 1);
+		ASSERT(oks[0] && !oks[1]);
+		ASSERT(copies[0] == 1);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		res_int_del_n(ids, 2, ERRINFO);
+		ASSERT(get_state(ids[1]) == RES_STATE_INVALID);
+		ASSERT(g_res_pools[RES_ERR_CLASS].free_count == 1);
+		reset_globals();
+	}
+	{ // Not inline
+		point values[3] = {{1.0, 2.0}, {3.0, 4.0}, {5.0, 6.0}}, copies[3] = {0};
+		size_t ids[3];
+		ASSERT(res_point_ok_n(values, 3, ids, ERRINFO) == 3);
+		ASSERT(g_res_pools[0].count == 3);
+		ASSERT(res_point_get_ok_n(ids, 3, copies, NULL, ERRINFO) == 3);
+		ASSERT(copies[2].y == 6.0);
+		res_point_del_n(ids, 3, ERRINFO);
+		ASSERT(g_res_pools[0].free_count == 3);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+	{ // More than a word of the free bitmap, 67 = 64 + 3
+		point values[67], copies[67];
+		size_t ids[67];
+		for (size_t i = 0; i < 67; i++) values[i] = (point){(double)i, 0.0};
+		ASSERT(res_point_ok_n(values, 67, ids, ERRINFO) == 67);
+		ASSERT(g_res_pools[0].count == 67);
+		ASSERT(res_point_get_ok_n(ids, 67, copies, NULL, ERRINFO) == 67);
+		ASSERT(copies[66].x == 66);
+		res_point_del_n(ids, 67, ERRINFO);
+		ASSERT(g_res_pools[0].free_count == 67);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+}
+
+#ifdef RES_FAST_PATH
+void test_res_fast_path() {
+	reset_globals();
+	{ // Only a free result object is taken inline
+		point value = {1.0, 2.0};
+		size_t id = 0;
+		ASSERT(res_fast_ok(&value, alignof(point), sizeof(point), &id, ERRINFO) == 1);
+		ASSERT(!g_res_pools[0].count);
+		res_point_t res = res_point_ok(value, ERRINFO);
+		ASSERT(g_res_pools[0].count == 1);
+		res_point_del(res, ERRINFO);
+		ASSERT(g_res_pools[0].free_count == 1);
+		ASSERT(!res_fast_ok(&value, alignof(point), sizeof(point), &id, ERRINFO));
+		ASSERT(res_id_index(id) == res_id_index(res.id) && id != res.id);
+		ASSERT(get_state(id) == RES_STATE_OK);
+		ASSERT(!g_res_pools[0].free_count);
+		ASSERT(res_fast_ok(&value, 3, sizeof(point), &id, ERRINFO) == 1);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		reset_globals();
+	}
+	{ // Anything but an OK result object is left to the library
+		res_point_t err = res_point_err("msg", ERRINFO);
+		point ok = {0};
+		ASSERT(res_fast_get_ok(err.id, &ok, sizeof(point)) == 1);
+		ASSERT(res_fast_unwrap(err.id, &ok, sizeof(point)) == 1);
+		ASSERT(res_fast_get_ok(g_res_fallback_id, &ok, sizeof(point)) == 1);
+		ASSERT(get_state(err.id) == RES_STATE_ERR);
+		res_point_t res = res_point_ok((point){1.0, 2.0}, ERRINFO);
+		ASSERT(res_fast_get_ok(res.id, &ok, RES_CLASS_SIZE(res_id_class(res.id)) + 1) == 1);
+		ASSERT(!res_fast_get_ok(res.id, &ok, sizeof(point)));
+		ASSERT(ok.y == 2.0);
+		ASSERT(!res_fast_unwrap(res.id, &ok, sizeof(point)));
+		ASSERT(get_state(res.id) == RES_STATE_INVALID);
+		ASSERT(g_res_pools[0].free_count == 1);
+		ASSERT(res_fast_unwrap(res.id, &ok, sizeof(point)) == 1);
+		ASSERT(res_fast_del(res.id) == 1);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		res_point_del(res, ERRINFO);
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		reset_globals();
+	}
+}
+#endif
+
+/** Checks that the return address recorded for a lazy call resolves to the
+ * function making the call rather than the typed wrapper.
+ * \param caller The recorded return address.
+ * \param func The name of the calling function. */
+static int is_caller(const void *caller, const char *func) {
+	Dl_info info = {0};
+	return caller && dladdr(caller, &info) && info.dli_sname && !strcmp(info.dli_sname, func);
+}
+
+void test_res_lazy_caller() {
+	reset_globals();
+	{ // A failed delete records the caller of the wrapper
+		res_point_lazy_del((res_point_t){.id = 13});
+		ASSERT(g_res_fallback.state == RES_STATE_ERR);
+		ASSERT(is_caller(g_res_fallback.err.caller, __func__));
+		reset_globals();
+	}
+	{ // So does a failed check
+		point p;
+		ASSERT(res_point_lazy_get_ok((res_point_t){.id = 13}, &p));
+		ASSERT(is_caller(g_res_fallback.err.caller, __func__));
+		reset_globals();
+	}
+	{ // And the void wrappers
+		res_void_lazy_del((res_void_t){.id = 13});
+		ASSERT(is_caller(g_res_fallback.err.caller, __func__));
+		reset_globals();
+	}
+#ifdef RES_TRACK
+	{ // A tracked result records the caller of the wrapper as its site
+		res_point_t res = res_point_lazy_ok((point){1, 2});
+		res_site_ref_t *site = res_site_of(&g_res_pools[res_id_pool(res.id)], res_id_index(res.id));
+		ASSERT(!site->info);
+		ASSERT(is_caller(site->caller, __func__));
+		res_point_del(res, ERRINFO);
+		reset_globals();
+	}
+#endif
+}
+
 void test_typedef() {
 	test_res_int_ok();
 	test_res_int_err();
 	test_res_int_get_ok();
+	test_res_int_peek_take();
+	test_res_big_get_ok();
+#ifdef RES_TRACK
+	test_res_ok_leak();
+#endif
+	test_res_reserve();
+	test_res_try();
 	test_res_int_get_err_from();
 	test_res_int_del();
+	test_res_batch();
+	test_res_lazy_caller();
+#ifdef RES_FAST_PATH
+	test_res_fast_path();
+#endif
 	test_res_int_print_err();
 }
@@ -2,7 +2,7 @@
 #define TEST_UTILS_H
 
 #include "result.h"
-#include "result_utils.h"
+#include "result_decode.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -32,5 +32,6 @@ void test_generic();
 void test_typedef();
 void test_void();
 void integration_test();
+void test_stress();
 
 #endif
@@ -6,8 +6,8 @@ void test_void_ok() {
 	reset_globals();
 	{ // Happy path
 		res_void_t res = res_void_ok(ERRINFO);
-		ASSERT(res.id == g_res_count - 1);
-		ASSERT(g_res_buff[res.id].state == RES_STATE_OK);
+		ASSERT(res.id == RES_INLINE_ID);
+		ASSERT(!g_res_pools[0].count);
 		reset_globals();
 	}
 }
@@ -17,12 +17,12 @@ void test_void_err() {
 	{ // Happy path
 		res_void_t res = res_void_err("msg", ERRINFO);
 		int line = __LINE__ - 1;
-		ASSERT(res.id == g_res_count - 1);
-		ASSERT(g_res_buff[res.id].state == RES_STATE_ERR);
-		ASSERT(!strcmp(g_res_buff[res.id].err.msg, "msg"));
-		ASSERT(!strcmp(g_res_buff[res.id].err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_buff[res.id].err.err_info.func, __func__));
-		ASSERT(g_res_buff[res.id].err.err_info.line ==  line);
+		ASSERT(res.id == res_make_id(RES_ERR_CLASS, g_res_pools[RES_ERR_CLASS].count - 1, 0));
+		ASSERT(get_state(res.id) == RES_STATE_ERR);
+		ASSERT(!strcmp(get_err(res.id)->msg, "msg"));
+		ASSERT(!strcmp(get_err(res.id)->err_info->file, __FILE__));
+		ASSERT(!strcmp(get_err(res.id)->err_info->func, __func__));
+		ASSERT(get_err(res.id)->err_info->line ==  line);
 		reset_globals();
 	}
 }
@@ -42,24 +42,31 @@ void test_void_err_from() {
 		res_float_t src = res_float_err("msg", ERRINFO);
 		int line = __LINE__ - 1;
 		res_void_t dst = res_void_err_from(src.id, ERRINFO);
-		ASSERT(g_res_buff[dst.id].state == RES_STATE_ERR);
-		ASSERT(g_res_buff[dst.id].err.err_info.line == line);
-		ASSERT(!strcmp(g_res_buff[dst.id].err.err_info.func, __func__));
-		ASSERT(!strcmp(g_res_buff[dst.id].err.err_info.file, __FILE__));
-		ASSERT(!strcmp(g_res_buff[dst.id].err.msg, "msg"));
+		ASSERT(get_state(dst.id) == RES_STATE_ERR);
+		ASSERT(get_err(dst.id)->err_info->line == line);
+		ASSERT(!strcmp(get_err(dst.id)->err_info->func, __func__));
+		ASSERT(!strcmp(get_err(dst.id)->err_info->file, __FILE__));
+		ASSERT(!strcmp(get_err(dst.id)->msg, "msg"));
 		reset_globals();
 	}
 }
 
 void test_void_del() {
 	reset_globals();
-	{ // Happy path
+	{ // Inline
 		res_void_t res = res_void_ok(ERRINFO);
 		res_void_del(res, ERRINFO);
 		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
-		ASSERT(g_res_buff[res.id].state == RES_STATE_INVALID);
-		ASSERT(g_free_count == 1);
-		ASSERT(g_free_buff[0] == res.id);
+		ASSERT(!g_res_pools[RES_ERR_CLASS].free_count);
+		reset_globals();
+	}
+	{ // Happy path
+		res_void_t res = res_void_err("msg", ERRINFO);
+		res_void_del(res, ERRINFO);
+		ASSERT(g_res_fallback.state == RES_STATE_INVALID);
+		ASSERT(get_state(res.id) == RES_STATE_INVALID);
+		ASSERT(g_res_pools[RES_ERR_CLASS].free_count == 1);
+		ASSERT(*res_free_word_of(&g_res_pools[RES_ERR_CLASS], res_id_index(res.id)) == res_free_bit(res_id_index(res.id)));
 		reset_globals();
 	}
 }
@@ -0,0 +1,71 @@
+/*
+MIT License
+Copyright (c) 2025 András Broskó
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+/**
+ * \file tools/decode.c
+ * \brief Decoder of binary error logs.
+ * \details Turns a binary log written with res_log_open() back into the
+ * text format of printed errors.
+ * */
+
+#include "result_decode.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [-v] FILE\n"
+		"\t-v  Print the time and the thread of each error\n", name);
+}
+
+int main(int argc, char **argv) {
+	int verbose = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "vh")) != -1) {
+		if (opt == 'v') {
+			verbose = 1;
+		} else {
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	int fd = open(argv[optind], O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(argv[optind]);
+		return 1;
+	}
+	void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror(argv[optind]);
+		return 1;
+	}
+	long n = res_decode_log(map, (size_t)st.st_size, stdout, verbose);
+	munmap(map, (size_t)st.st_size);
+	if (n < 0) {
+		fprintf(stderr, "%s: not a binary error log\n", argv[optind]);
+		return 1;
+	}
+	return 0;
+}